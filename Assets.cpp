@@ -1608,6 +1608,46 @@ std::shared_ptr<Scene> Assets::LoadScene(std::wstring path)
 	// Create the scene
 	std::shared_ptr<Scene> scene = std::make_shared<Scene>(name, bounds);
 
+	// Check for octree settings
+	if (sceneJson.contains("octree"))
+	{
+		if (sceneJson["octree"].contains("looseness") && sceneJson["octree"]["looseness"].is_number())
+			scene->SetOctreeLooseness(sceneJson["octree"]["looseness"].get<float>());
+		if (sceneJson["octree"].contains("buildThreads") && sceneJson["octree"]["buildThreads"].is_number_unsigned())
+			scene->SetOctreeBuildThreads(sceneJson["octree"]["buildThreads"].get<unsigned int>());
+		if (sceneJson["octree"].contains("parallelBuildThreshold") && sceneJson["octree"]["parallelBuildThreshold"].is_number_unsigned())
+			scene->SetOctreeParallelThreshold(sceneJson["octree"]["parallelBuildThreshold"].get<size_t>());
+		if (sceneJson["octree"].contains("mortonBuildThreshold") && sceneJson["octree"]["mortonBuildThreshold"].is_number_unsigned())
+			scene->SetOctreeMortonThreshold(sceneJson["octree"]["mortonBuildThreshold"].get<size_t>());
+	}
+
+	// Check for culling structure, the octree unless asked otherwise
+	if (sceneJson.contains("spatialIndex") && sceneJson["spatialIndex"].is_string())
+	{
+		std::string spatialIndex = sceneJson["spatialIndex"].get<std::string>();
+		if (spatialIndex == "bvh")
+			scene->SetSpatialIndexType(SpatialIndexType::BVH);
+		else if (spatialIndex == "octree")
+			scene->SetSpatialIndexType(SpatialIndexType::Octree);
+	}
+
+	// Check for dynamic entity grid settings
+	if (sceneJson.contains("grid"))
+	{
+		if (sceneJson["grid"].contains("cellSize") && sceneJson["grid"]["cellSize"].is_number())
+			scene->SetGridCellSize(sceneJson["grid"]["cellSize"].get<float>());
+	}
+
+	// Check for broadphase, the octree unless asked otherwise
+	if (sceneJson.contains("broadphase") && sceneJson["broadphase"].is_string())
+	{
+		std::string broadphase = sceneJson["broadphase"].get<std::string>();
+		if (broadphase == "sweepAndPrune")
+			scene->SetBroadphaseType(BroadphaseType::SweepAndPrune);
+		else if (broadphase == "octree")
+			scene->SetBroadphaseType(BroadphaseType::Octree);
+	}
+
 
 	// Check for cameras
 	if (sceneJson.contains("cameras") && sceneJson["cameras"].is_array())
@@ -1801,6 +1841,10 @@ std::shared_ptr<Entity> Assets::ParseEntity(nlohmann::json jsonEntity)
 	}
 	entity = std::make_shared<Entity>(meshes, materials, name);
 
+	// Entities that move every frame are kept out of the octree
+	if (jsonEntity.contains("dynamic") && jsonEntity["dynamic"].is_boolean())
+		entity->SetDynamic(jsonEntity["dynamic"].get<bool>());
+
 	// Early out if transform is missing
 	if (!jsonEntity.contains("transform")) return entity;
 	nlohmann::json tr = jsonEntity["transform"];
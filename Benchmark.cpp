@@ -0,0 +1,3102 @@
+#include "Benchmark.h"
+#include "Octree.h"
+#include "Broadphase.h"
+#include "Bvh.h"
+#include "SpatialHashGrid.h"
+#include "CullingKernel.h"
+#include "CullingCache.h"
+#include "TransformStore.h"
+#include "Assets.h"
+
+#include <cfloat>
+#include <chrono>
+#include <random>
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+
+namespace
+{
+	typedef std::chrono::high_resolution_clock Clock;
+
+	// Frames simulated by the update benchmarks
+	const int UpdateFrames = 16;
+	// Fraction of entities that move each frame
+	const float MovedFraction = 0.1f;
+	// Queries averaged by the query benchmarks
+	const int QueryRepeats = 32;
+
+#ifdef _DEBUG
+	// Heap allocations seen since counting started
+	long allocationCount = 0;
+	_CRT_ALLOC_HOOK previousAllocHook = nullptr;
+
+	int CountAllocations(int allocType, void* userData, size_t size, int blockType,
+		long requestNumber, const unsigned char* filename, int lineNumber)
+	{
+		if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+			allocationCount++;
+		return previousAllocHook == nullptr ? TRUE :
+			previousAllocHook(allocType, userData, size, blockType, requestNumber, filename, lineNumber);
+	}
+#endif
+
+	void StartCountingAllocations()
+	{
+#ifdef _DEBUG
+		allocationCount = 0;
+		previousAllocHook = _CrtSetAllocHook(CountAllocations);
+#endif
+	}
+
+	/// <summary>
+	/// Stops counting heap allocations
+	/// </summary>
+	/// <returns>Allocations since StartCountingAllocations, or -1 if
+	/// the CRT can't report them (release builds)</returns>
+	long StopCountingAllocations()
+	{
+#ifdef _DEBUG
+		_CrtSetAllocHook(previousAllocHook);
+		return allocationCount;
+#else
+		return -1;
+#endif
+	}
+
+	double MillisecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	/// <summary>
+	/// Creates a cube of entities spaced closer than their size,
+	/// so each one overlaps its neighbours
+	/// </summary>
+	/// <param name="bounds">Set to bounds that hold the grid with room to move</param>
+	std::vector<std::shared_ptr<Entity>> CreateGrid(unsigned int count, float spacing, AABB& bounds)
+	{
+		std::shared_ptr<Mesh> mesh = Assets::GetInstance().GetMesh(L"Basic Meshes/sphere");
+		std::shared_ptr<Material> material = std::make_shared<Material>(nullptr, nullptr);
+
+		unsigned int side = (unsigned int)ceil(cbrt((double)count));
+		float half = side * spacing * 0.5f;
+		bounds.min = DirectX::XMFLOAT3(-half - 8.0f, -half - 8.0f, -half - 8.0f);
+		bounds.max = DirectX::XMFLOAT3(half + 8.0f, half + 8.0f, half + 8.0f);
+
+		std::vector<std::shared_ptr<Entity>> entities;
+		entities.reserve(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			std::shared_ptr<Entity> entity = std::make_shared<Entity>(mesh, material, "Benchmark");
+			entity->GetTransform()->SetPosition(
+				(i % side) * spacing - half,
+				(i / side % side) * spacing - half,
+				(i / (side * side)) * spacing - half);
+			entity->GetAABB();
+			entity->hasMoved = false;
+			entities.push_back(entity);
+		}
+		return entities;
+	}
+
+	/// <summary>
+	/// Creates entities spread randomly through the bounds.
+	/// The same seed always produces the same layout.
+	/// </summary>
+	std::vector<std::shared_ptr<Entity>> CreateEntities(unsigned int count, AABB bounds, unsigned int seed)
+	{
+		// Benchmark entities get their own material so they don't
+		// register callbacks on materials used by the scene
+		std::shared_ptr<Mesh> mesh = Assets::GetInstance().GetMesh(L"Basic Meshes/sphere");
+		std::shared_ptr<Material> material = std::make_shared<Material>(nullptr, nullptr);
+
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> x(bounds.min.x + 32.0f, bounds.max.x - 32.0f);
+		std::uniform_real_distribution<float> y(bounds.min.y + 32.0f, bounds.max.y - 32.0f);
+		std::uniform_real_distribution<float> z(bounds.min.z + 32.0f, bounds.max.z - 32.0f);
+
+		std::vector<std::shared_ptr<Entity>> entities;
+		entities.reserve(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			std::shared_ptr<Entity> entity = std::make_shared<Entity>(mesh, material, "Benchmark");
+			entity->GetTransform()->SetPosition(x(rng), y(rng), z(rng));
+			entity->GetAABB();
+			entity->hasMoved = false;
+			entities.push_back(entity);
+		}
+		return entities;
+	}
+
+	/// <summary>
+	/// Creates entities of uneven sizes, like imported architecture:
+	/// mostly small props, with some long walls and wide floors
+	/// </summary>
+	std::vector<std::shared_ptr<Entity>> CreateArchitecture(unsigned int count, AABB bounds, unsigned int seed)
+	{
+		std::vector<std::shared_ptr<Entity>> entities = CreateEntities(count, bounds, seed);
+
+		std::mt19937 rng(seed + 1);
+		std::uniform_real_distribution<float> prop(0.5f, 2.0f);
+		std::uniform_real_distribution<float> span(8.0f, 32.0f);
+		std::uniform_int_distribution<int> kind(0, 9);
+		for (std::shared_ptr<Entity>& entity : entities)
+		{
+			switch (kind(rng))
+			{
+			case 0: entity->GetTransform()->SetScale(span(rng), prop(rng), 0.5f); break; // Wall along x
+			case 1: entity->GetTransform()->SetScale(0.5f, prop(rng), span(rng)); break; // Wall along z
+			case 2: entity->GetTransform()->SetScale(span(rng), 0.5f, span(rng)); break; // Floor
+			default: entity->GetTransform()->SetScale(prop(rng)); break;
+			}
+			entity->GetAABB();
+			entity->hasMoved = false;
+		}
+		return entities;
+	}
+
+	/// <summary>
+	/// The bounds entities used to calculate, by transforming all eight
+	/// corners of their model bounds and taking the min and max
+	/// </summary>
+	AABB CornerAABB(AABB model, DirectX::XMMATRIX wm)
+	{
+		DirectX::XMFLOAT3 corners[8] = {
+			{model.min.x, model.min.y, model.min.z},
+			{model.max.x, model.min.y, model.min.z},
+			{model.min.x, model.max.y, model.min.z},
+			{model.max.x, model.max.y, model.min.z},
+			{model.min.x, model.min.y, model.max.z},
+			{model.max.x, model.min.y, model.max.z},
+			{model.min.x, model.max.y, model.max.z},
+			{model.max.x, model.max.y, model.max.z},
+		};
+		AABB aabb;
+		aabb.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		aabb.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		for (int c = 0; c < 8; c++)
+		{
+			DirectX::XMStoreFloat3(&corners[c],
+				DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&corners[c]), wm));
+			aabb.max.x = aabb.max.x > corners[c].x ? aabb.max.x : corners[c].x;
+			aabb.max.y = aabb.max.y > corners[c].y ? aabb.max.y : corners[c].y;
+			aabb.max.z = aabb.max.z > corners[c].z ? aabb.max.z : corners[c].z;
+			aabb.min.x = aabb.min.x < corners[c].x ? aabb.min.x : corners[c].x;
+			aabb.min.y = aabb.min.y < corners[c].y ? aabb.min.y : corners[c].y;
+			aabb.min.z = aabb.min.z < corners[c].z ? aabb.min.z : corners[c].z;
+		}
+		return aabb;
+	}
+
+	/// <summary>
+	/// The per entity clip space test that rendering used before the
+	/// octree traversal could cull individual entities
+	/// </summary>
+	bool ClipSpaceVisible(AABB aabb, DirectX::XMMATRIX VP)
+	{
+		DirectX::XMFLOAT4 corners[9] = {
+			{aabb.min.x, aabb.min.y, aabb.min.z, 1.0f},
+			{aabb.max.x, aabb.min.y, aabb.min.z, 1.0f},
+			{aabb.min.x, aabb.max.y, aabb.min.z, 1.0f},
+			{aabb.max.x, aabb.max.y, aabb.min.z, 1.0f},
+			{aabb.min.x, aabb.min.y, aabb.max.z, 1.0f},
+			{aabb.max.x, aabb.min.y, aabb.max.z, 1.0f},
+			{aabb.min.x, aabb.max.y, aabb.max.z, 1.0f},
+			{aabb.max.x, aabb.max.y, aabb.max.z, 1.0f},
+			{(aabb.min.x + aabb.max.x) / 2, (aabb.min.y + aabb.max.y) / 2, (aabb.min.z + aabb.max.z) / 2, 1.0f}
+		};
+		for (int c = 0; c < 9; c++)
+		{
+			DirectX::XMVECTOR cornerVec = DirectX::XMVector4Transform(DirectX::XMLoadFloat4(&corners[c]), VP);
+			DirectX::XMStoreFloat4(&corners[c], cornerVec);
+			if (corners[c].x >= -corners[c].w && corners[c].x <= corners[c].w &&
+				corners[c].y >= -corners[c].w && corners[c].y <= corners[c].w &&
+				corners[c].z >= 0.0f && corners[c].z <= corners[c].w)
+				return true;
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Builds a frustum the way cameras and lights used to, from corners placed
+	/// along the view's basis vectors, with each plane through three corners
+	/// </summary>
+	/// <param name="halfNear">Half width and height of the near rectangle</param>
+	/// <param name="halfFar">Half width and height of the far rectangle</param>
+	/// <param name="shiftNear">Offset of the near rectangle's center, for off-center views</param>
+	/// <param name="shiftFar">Offset of the far rectangle's center</param>
+	Frustum CornerFrustum(DirectX::XMFLOAT3 position, DirectX::XMFLOAT3 forward,
+		DirectX::XMFLOAT2 halfNear, DirectX::XMFLOAT2 halfFar, float nearClip, float farClip,
+		DirectX::XMFLOAT2 shiftNear = DirectX::XMFLOAT2(0, 0), DirectX::XMFLOAT2 shiftFar = DirectX::XMFLOAT2(0, 0))
+	{
+		using namespace DirectX;
+		XMVECTOR pos = XMLoadFloat3(&position);
+		XMVECTOR fwd = XMVector3Normalize(XMLoadFloat3(&forward));
+		XMVECTOR right = XMVector3Normalize(XMVector3Cross(XMVectorSet(0, 1, 0, 0), fwd));
+		XMVECTOR up = XMVector3Cross(fwd, right);
+
+		XMVECTOR nearCenter = XMVectorAdd(XMVectorAdd(pos, XMVectorScale(fwd, nearClip)),
+			XMVectorAdd(XMVectorScale(right, shiftNear.x), XMVectorScale(up, shiftNear.y)));
+		XMVECTOR farCenter = XMVectorAdd(XMVectorAdd(pos, XMVectorScale(fwd, farClip)),
+			XMVectorAdd(XMVectorScale(right, shiftFar.x), XMVectorScale(up, shiftFar.y)));
+		const float signs[8][2] = { {1, 1}, {-1, -1}, {-1, 1}, {1, -1}, {1, 1}, {-1, -1}, {-1, 1}, {1, -1} };
+		Frustum frustum;
+		for (int i = 0; i < 8; i++)
+		{
+			bool isFar = i < 4;
+			XMVECTOR corner = XMVectorAdd(isFar ? farCenter : nearCenter, XMVectorAdd(
+				XMVectorScale(right, signs[i][0] * (isFar ? halfFar.x : halfNear.x)),
+				XMVectorScale(up, signs[i][1] * (isFar ? halfFar.y : halfNear.y))));
+			XMStoreFloat3(&frustum.points[i], corner);
+		}
+
+		// Near, far, left, right, bottom, top, each through three of its corners
+		const int faces[6][3] = { {4, 5, 6}, {0, 1, 2}, {1, 2, 5}, {0, 3, 4}, {1, 3, 5}, {0, 2, 4} };
+		XMVECTOR center = XMVectorScale(XMVectorAdd(nearCenter, farCenter), 0.5f);
+		for (int f = 0; f < 6; f++)
+		{
+			XMVECTOR a = XMLoadFloat3(&frustum.points[faces[f][0]]);
+			XMVECTOR b = XMLoadFloat3(&frustum.points[faces[f][1]]);
+			XMVECTOR c = XMLoadFloat3(&frustum.points[faces[f][2]]);
+			XMVECTOR normal = XMVector3Normalize(XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a)));
+
+			// Face the normal into the frustum
+			if (XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(center, a))) < 0)
+				normal = XMVectorNegate(normal);
+			XMStoreFloat4(&frustum.normals[f], normal);
+			frustum.normals[f].w = XMVectorGetX(XMVector3Dot(normal, a));
+		}
+		return frustum;
+	}
+
+	/// <summary>
+	/// Checks two trees have the same nodes holding the same entities
+	/// </summary>
+	/// <param name="ordered">Whether entities must also be in the same order within a node</param>
+	bool SameTree(Octree::Node* a, Octree::Node* b, bool ordered = true)
+	{
+		if (a->GetActiveOctants() != b->GetActiveOctants())
+			return false;
+
+		std::vector<std::shared_ptr<Entity>> aEntities = a->GetEntities();
+		std::vector<std::shared_ptr<Entity>> bEntities = b->GetEntities();
+		if (!ordered)
+		{
+			std::sort(aEntities.begin(), aEntities.end());
+			std::sort(bEntities.begin(), bEntities.end());
+		}
+		if (aEntities != bEntities)
+			return false;
+
+		for (int i = 0; i < NUM_CHILDREN; i++)
+		{
+			if (a->GetActiveOctants() & (1 << i) &&
+				!SameTree(a->GetChildren()[i], b->GetChildren()[i], ordered))
+				return false;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Puts each pair's entities in address order, then sorts the pairs,
+	/// so pair lists from different sources can be compared
+	/// </summary>
+	void NormalizePairs(std::vector<Octree::EntityPair>& pairs)
+	{
+		for (Octree::EntityPair& pair : pairs)
+		{
+			if (pair.b < pair.a)
+				std::swap(pair.a, pair.b);
+		}
+		std::sort(pairs.begin(), pairs.end(), [](const Octree::EntityPair& x, const Octree::EntityPair& y)
+			{ return x.a < y.a || (x.a == y.a && x.b < y.b); });
+	}
+
+	bool SamePairs(std::vector<Octree::EntityPair>& x, std::vector<Octree::EntityPair>& y)
+	{
+		if (x.size() != y.size())
+			return false;
+		for (size_t i = 0; i < x.size(); i++)
+		{
+			if (x[i].a != y[i].a || x[i].b != y[i].b)
+				return false;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Reference broadphase, tests every pair of entities. If moved isn't
+	/// empty only pairs with at least one of those entities are tested.
+	/// </summary>
+	void BruteForcePairs(std::vector<std::shared_ptr<Entity>>& entities,
+		std::vector<Entity*>& moved, std::vector<Octree::EntityPair>& out)
+	{
+		out.clear();
+		std::vector<AABB> boxes;
+		boxes.reserve(entities.size());
+		for (std::shared_ptr<Entity>& entity : entities)
+			boxes.push_back(entity->GetAABB());
+
+		if (moved.empty())
+		{
+			for (size_t i = 0; i < entities.size(); i++)
+				for (size_t j = i + 1; j < entities.size(); j++)
+					if (boxes[i].Overlaps(boxes[j]))
+						out.push_back({ entities[i].get(), entities[j].get() });
+			return;
+		}
+
+		// Pairs of two moved entities are only reported from the lower index
+		std::sort(moved.begin(), moved.end());
+		std::vector<bool> isMoved(entities.size(), false);
+		for (size_t i = 0; i < entities.size(); i++)
+			isMoved[i] = std::binary_search(moved.begin(), moved.end(), entities[i].get());
+
+		for (size_t i = 0; i < entities.size(); i++)
+		{
+			if (!isMoved[i])
+				continue;
+			for (size_t j = 0; j < entities.size(); j++)
+			{
+				if (j == i || (isMoved[j] && j < i))
+					continue;
+				if (boxes[i].Overlaps(boxes[j]))
+					out.push_back({ entities[i].get(), entities[j].get() });
+			}
+		}
+	}
+
+	/// <summary>
+	/// Moves an entity by an offset
+	/// </summary>
+	void Nudge(std::shared_ptr<Entity>& entity, float x, float y, float z)
+	{
+		entity->GetTransform()->MoveAbsolute(x, y, z);
+	}
+
+	/// <summary>
+	/// Nudges a random subset of the entities, same seed gives the same moves
+	/// </summary>
+	void MoveEntities(std::vector<std::shared_ptr<Entity>>& entities, std::mt19937& rng)
+	{
+		std::uniform_int_distribution<size_t> pick(0, entities.size() - 1);
+		std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+		for (size_t i = 0, n = (size_t)(entities.size() * MovedFraction); i < n; i++)
+			Nudge(entities[pick(rng)], offset(rng), offset(rng), offset(rng));
+	}
+
+	/// <summary>
+	/// Counts the entities waiting to be relocated, so a report can show
+	/// that a timed update actually had work to do
+	/// </summary>
+	size_t CountMoved(std::vector<std::shared_ptr<Entity>>& entities)
+	{
+		size_t moved = 0;
+		for (std::shared_ptr<Entity>& entity : entities)
+			if (entity->hasMoved) moved++;
+		return moved;
+	}
+
+	/// <summary>
+	/// Runs the octree and sweep and prune broadphases over the same frames
+	/// of movement, timing each and checking they find the same pairs
+	/// </summary>
+	/// <param name="moveAll">Whether every entity jitters each frame,
+	/// instead of MovedFraction of them moving further</param>
+	/// <returns>Whether both broadphases found the same pairs every frame</returns>
+	bool CompareBroadphases(std::vector<std::shared_ptr<Entity>>& entities, AABB bounds, bool moveAll,
+		double& octreeTime, double& sweepTime, size_t& pairCount)
+	{
+		std::shared_ptr<Octree::Node> octree = std::make_shared<Octree::Node>(bounds, entities);
+		octree->Build();
+		OctreeBroadphase octreeBroadphase(octree);
+		SweepAndPrune sweepAndPrune(entities);
+
+		std::mt19937 rng(5678);
+		std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+		std::vector<Octree::EntityPair> octreePairs;
+		std::vector<Octree::EntityPair> sweepPairs;
+		bool same = true;
+		octreeTime = 0.0;
+		sweepTime = 0.0;
+		pairCount = 0;
+		for (int frame = 0; frame < UpdateFrames; frame++)
+		{
+			if (moveAll)
+			{
+				for (std::shared_ptr<Entity>& entity : entities)
+					Nudge(entity, jitter(rng), jitter(rng), jitter(rng));
+			}
+			else
+				MoveEntities(entities, rng);
+
+			// Sweep and prune goes first, since the octree clears hasMoved
+			Clock::time_point start = Clock::now();
+			sweepAndPrune.Update(sweepPairs);
+			sweepTime += MillisecondsSince(start);
+
+			start = Clock::now();
+			octreeBroadphase.Update(octreePairs);
+			octreeTime += MillisecondsSince(start);
+
+			pairCount += octreePairs.size();
+			NormalizePairs(octreePairs);
+			NormalizePairs(sweepPairs);
+			same = same && SamePairs(octreePairs, sweepPairs);
+		}
+		octreeTime /= UpdateFrames;
+		sweepTime /= UpdateFrames;
+		pairCount /= UpdateFrames;
+		return same;
+	}
+
+	/// <summary>
+	/// The hot paths of a transform that stores Euler angles, as Transform
+	/// did before it stored a quaternion, to compare against
+	/// </summary>
+	struct EulerTransform
+	{
+		DirectX::XMFLOAT3 position = DirectX::XMFLOAT3(0, 0, 0);
+		DirectX::XMFLOAT3 pitchYawRoll = DirectX::XMFLOAT3(0, 0, 0);
+		DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3(1, 1, 1);
+		DirectX::XMFLOAT4X4 worldMatrix;
+		DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
+		bool matricesDirty = true;
+
+		void MoveRelative(float x, float y, float z)
+		{
+			using namespace DirectX;
+			XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
+			XMVECTOR dir = XMVector3Rotate(XMVectorSet(x, y, z, 0), rotQuat);
+			XMStoreFloat3(&position, XMLoadFloat3(&position) + dir);
+			matricesDirty = true;
+		}
+		void Rotate(float p, float y, float r)
+		{
+			pitchYawRoll.x += p;
+			pitchYawRoll.y += y;
+			pitchYawRoll.z += r;
+			matricesDirty = true;
+		}
+		DirectX::XMFLOAT4X4 GetWorldMatrix()
+		{
+			using namespace DirectX;
+			if (matricesDirty)
+			{
+				XMMATRIX wm = XMMatrixScalingFromVector(XMLoadFloat3(&scale)) *
+					XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll)) *
+					XMMatrixTranslationFromVector(XMLoadFloat3(&position));
+				XMStoreFloat4x4(&worldMatrix, wm);
+				XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(wm)));
+				matricesDirty = false;
+			}
+			return worldMatrix;
+		}
+	};
+
+	/// <summary>
+	/// The octree layout the storage benchmark compares Octree::Node against.
+	/// Nodes live in one contiguous pool and reference each other with 32-bit
+	/// indices, children are stored as a block of eight starting at firstChild
+	/// (with activeOctants marking which are in use), and entity references
+	/// live in shared index arrays instead of per-node vectors.
+	/// Only the tight build, the update and the frustum query are kept, the
+	/// scene's octree features aren't, so it only lives here.
+	/// </summary>
+	class PooledOctree
+	{
+	public:
+		PooledOctree(AABB _bounds, std::vector<std::shared_ptr<Entity>>& _entities)
+		{
+			nodes.push_back({});
+			InitNode(0, _bounds, Invalid);
+			pending = _entities;
+		}
+
+		void Build()
+		{
+			// Give every pending entity a slot
+			std::vector<unsigned int> slots;
+			for (std::shared_ptr<Entity>& entityPtr : pending)
+				slots.push_back(AllocateSlot(entityPtr));
+			pending.clear();
+
+			std::vector<unsigned int> temp(slots.size());
+			std::vector<unsigned char> octants(slots.size());
+			BuildNode(0, slots, temp, octants, 0, (unsigned int)slots.size());
+		}
+
+		void Update()
+		{
+			// Entities that left the root wait to come back
+			size_t kept = 0;
+			for (size_t i = 0; i < pending.size(); i++)
+			{
+				if (nodes[0].bounds.Contains(pending[i]->GetAABB()))
+					Insert(0, AllocateSlot(pending[i]));
+				else
+					pending[kept++] = pending[i];
+			}
+			pending.resize(kept);
+			UpdateNode(0);
+		}
+
+		void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out) { GatherRelevant(0, frustum, out); }
+
+		unsigned int GetNodeCount()
+		{
+			// Count active nodes, freed blocks and inactive octants are not nodes
+			unsigned int count = 0;
+			std::vector<unsigned int> stack = { 0 };
+			while (!stack.empty())
+			{
+				unsigned int node = stack.back();
+				stack.pop_back();
+				count++;
+				for (unsigned char flags = nodes[node].activeOctants, i = 0; flags > 0; flags >>= 1, i++)
+					if (flags & (1 << 0)) // Active Child
+						stack.push_back(nodes[node].firstChild + i);
+			}
+			return count;
+		}
+
+		// Approximate heap footprint of the tree (excluding the entities themselves)
+		size_t GetMemoryUsage()
+		{
+			return sizeof(PooledOctree) +
+				nodes.capacity() * sizeof(PoolNode) +
+				freeBlocks.capacity() * sizeof(unsigned int) +
+				entities.capacity() * sizeof(std::shared_ptr<Entity>) +
+				(entityNode.capacity() + entityNext.capacity() + entityPrev.capacity()) * sizeof(unsigned int) +
+				freeSlots.capacity() * sizeof(unsigned int) +
+				pending.capacity() * sizeof(std::shared_ptr<Entity>) +
+				movedSlots.capacity() * sizeof(unsigned int);
+		}
+
+	private:
+		// Marks an unused index
+		static constexpr unsigned int Invalid = 0xFFFFFFFF;
+		static constexpr short MaxLifespan = 8;
+
+		struct PoolNode
+		{
+			AABB bounds;
+			unsigned int parent;
+			unsigned int firstChild;	// First of eight contiguous children
+			unsigned int firstEntity;	// Head of this node's entity list
+			unsigned int entityCount;
+			unsigned char activeOctants;
+			short maxLifespan;
+			short currentLifespan;
+		};
+
+		// All nodes, the root is always index 0
+		std::vector<PoolNode> nodes;
+		// Blocks of eight children that can be reused
+		std::vector<unsigned int> freeBlocks;
+
+		// Shared entity storage, indexed by entity slot
+		std::vector<std::shared_ptr<Entity>> entities;
+		std::vector<unsigned int> entityNode;
+		std::vector<unsigned int> entityNext;
+		std::vector<unsigned int> entityPrev;
+		std::vector<unsigned int> freeSlots;
+
+		std::vector<std::shared_ptr<Entity>> pending;
+		std::vector<unsigned int> movedSlots;
+
+		unsigned int AllocateSlot(std::shared_ptr<Entity> _entity)
+		{
+			if (!freeSlots.empty())
+			{
+				unsigned int slot = freeSlots.back();
+				freeSlots.pop_back();
+				entities[slot] = _entity;
+				return slot;
+			}
+			entities.push_back(_entity);
+			entityNode.push_back(Invalid);
+			entityNext.push_back(Invalid);
+			entityPrev.push_back(Invalid);
+			return (unsigned int)entities.size() - 1;
+		}
+
+		// Gives a node a block of eight (inactive) children, returns the first
+		unsigned int AllocateChildren(unsigned int node)
+		{
+			if (nodes[node].firstChild != Invalid)
+				return nodes[node].firstChild;
+
+			unsigned int first;
+			if (!freeBlocks.empty())
+			{
+				first = freeBlocks.back();
+				freeBlocks.pop_back();
+			}
+			else
+			{
+				first = (unsigned int)nodes.size();
+				nodes.resize(nodes.size() + NUM_CHILDREN);
+			}
+
+			// Note: nodes may have been reallocated above
+			nodes[node].firstChild = first;
+			return first;
+		}
+
+		void FreeChildren(unsigned int node)
+		{
+			unsigned int first = nodes[node].firstChild;
+			if (first == Invalid)
+				return;
+			for (unsigned char flags = nodes[node].activeOctants, i = 0; flags > 0; flags >>= 1, i++)
+				if (flags & (1 << 0)) // Active Child
+					FreeChildren(first + i);
+			nodes[node].activeOctants = 0x00;
+			nodes[node].firstChild = Invalid;
+			freeBlocks.push_back(first);
+		}
+
+		void InitNode(unsigned int node, AABB _bounds, unsigned int _parent)
+		{
+			PoolNode& n = nodes[node];
+			n.bounds = _bounds;
+			n.parent = _parent;
+			n.firstChild = Invalid;
+			n.firstEntity = Invalid;
+			n.entityCount = 0;
+			n.activeOctants = 0x00;
+			n.maxLifespan = MaxLifespan;
+			n.currentLifespan = -1;
+		}
+
+		void Link(unsigned int node, unsigned int slot)
+		{
+			PoolNode& n = nodes[node];
+			entityNode[slot] = node;
+			entityPrev[slot] = Invalid;
+			entityNext[slot] = n.firstEntity;
+			if (n.firstEntity != Invalid)
+				entityPrev[n.firstEntity] = slot;
+			n.firstEntity = slot;
+			n.entityCount++;
+		}
+
+		void Unlink(unsigned int slot)
+		{
+			PoolNode& n = nodes[entityNode[slot]];
+			if (entityPrev[slot] != Invalid)
+				entityNext[entityPrev[slot]] = entityNext[slot];
+			else
+				n.firstEntity = entityNext[slot];
+			if (entityNext[slot] != Invalid)
+				entityPrev[entityNext[slot]] = entityPrev[slot];
+			n.entityCount--;
+
+			entityNode[slot] = Invalid;
+			entityNext[slot] = Invalid;
+			entityPrev[slot] = Invalid;
+		}
+
+		// Sorts slots[first, first + count) into this node and its children
+		void BuildNode(unsigned int node, std::vector<unsigned int>& slots, std::vector<unsigned int>& temp,
+			std::vector<unsigned char>& octants, unsigned int first, unsigned int count)
+		{
+			const unsigned char stays = NUM_CHILDREN;
+
+			// Too few entities or too small
+			DirectX::XMFLOAT3 dim = nodes[node].bounds.Dimensions();
+			if (count <= 1 || dim.x < MIN_BOUNDS || dim.y < MIN_BOUNDS || dim.z < MIN_BOUNDS)
+			{
+				for (unsigned int i = first; i < first + count; i++)
+					Link(node, slots[i]);
+				return;
+			}
+
+			AABB octantBounds[NUM_CHILDREN];
+			for (int i = 0; i < NUM_CHILDREN; i++)
+				octantBounds[i] = Octree::CalculateOctantBounds(nodes[node].bounds, Octree::Octant(1 << i));
+
+			// Determine what entities fully fit within octants
+			unsigned int octantCounts[NUM_CHILDREN + 1] = {};
+			for (unsigned int i = first; i < first + count; i++)
+			{
+				AABB aabb = entities[slots[i]]->GetAABB();
+				octants[i] = stays;
+				for (unsigned char j = 0; j < NUM_CHILDREN; j++)
+				{
+					if (octantBounds[j].Contains(aabb))
+					{
+						octants[i] = j;
+						break;
+					}
+				}
+				octantCounts[octants[i]]++;
+			}
+
+			// Group the slots by octant (stable), entities that stay go last
+			unsigned int octantStarts[NUM_CHILDREN + 1];
+			unsigned int cursor[NUM_CHILDREN + 1];
+			unsigned int offset = first;
+			for (int j = 0; j <= NUM_CHILDREN; j++)
+			{
+				octantStarts[j] = cursor[j] = offset;
+				offset += octantCounts[j];
+			}
+			for (unsigned int i = first; i < first + count; i++)
+				temp[cursor[octants[i]]++] = slots[i];
+			std::copy(temp.begin() + first, temp.begin() + first + count, slots.begin() + first);
+
+			// Objects that didn't fit in a child
+			for (unsigned int i = octantStarts[stays]; i < first + count; i++)
+				Link(node, slots[i]);
+
+			for (int i = 0; i < NUM_CHILDREN; i++)
+			{
+				if (octantCounts[i] != 0)
+				{
+					unsigned int child = AllocateChildren(node) + i;
+					InitNode(child, octantBounds[i], node);
+					nodes[node].activeOctants |= (1 << i);
+					BuildNode(child, slots, temp, octants, octantStarts[i], octantCounts[i]);
+				}
+			}
+		}
+
+		bool Insert(unsigned int node, unsigned int slot)
+		{
+			AABB aabb = entities[slot]->GetAABB();
+
+			// If object doesn't fit
+			if (!nodes[node].bounds.Contains(aabb))
+				return nodes[node].parent == Invalid ? false : Insert(nodes[node].parent, slot);
+
+			// No Other Entities or Bounds Too Small
+			DirectX::XMFLOAT3 dim = nodes[node].bounds.Dimensions();
+			if (nodes[node].entityCount == 0 || dim.x < MIN_BOUNDS || dim.y < MIN_BOUNDS || dim.z < MIN_BOUNDS)
+			{
+				Link(node, slot);
+				return true;
+			}
+
+			// Find Octant that fits entity entirely
+			for (int i = 0; i < NUM_CHILDREN; i++)
+			{
+				bool active = (nodes[node].activeOctants & (1 << i)) != 0;
+				AABB octantBounds = active ?
+					nodes[nodes[node].firstChild + i].bounds :
+					Octree::CalculateOctantBounds(nodes[node].bounds, Octree::Octant(1 << i));
+
+				if (octantBounds.Contains(aabb))
+				{
+					if (active)
+						return Insert(nodes[node].firstChild + i, slot);
+
+					unsigned int child = AllocateChildren(node) + i;
+					InitNode(child, octantBounds, node);
+					nodes[node].activeOctants |= (1 << i);
+					Link(child, slot);
+					return true;
+				}
+			}
+
+			// Can't fit in any child octant
+			Link(node, slot);
+			return true;
+		}
+
+		void UpdateNode(unsigned int node)
+		{
+			// Check if this node/octant should be deleted
+			{
+				PoolNode& n = nodes[node];
+				if (n.entityCount == 0)
+				{
+					if (n.activeOctants == 0x00)
+					{
+						if (n.currentLifespan == -1) // initial check
+							n.currentLifespan = n.maxLifespan;
+						else if (n.currentLifespan > 0)
+							n.currentLifespan--;
+					}
+				}
+				else if (n.currentLifespan != -1)
+				{
+					if (n.maxLifespan <= 64)
+						n.maxLifespan <<= 2; // Extend lifespan if has objects
+					n.currentLifespan = -1;
+				}
+			}
+
+			// Prune child nodes that should be deleted
+			for (unsigned char flags = nodes[node].activeOctants, i = 0; flags > 0; flags >>= 1, i++)
+			{
+				unsigned int child = nodes[node].firstChild + i;
+				if (flags & (1 << 0) && nodes[child].currentLifespan == 0) // Marked for deletion
+				{
+					if (nodes[child].entityCount > 0) // Revive if has objects
+						nodes[child].currentLifespan = -1;
+					else
+					{
+						FreeChildren(child);
+						nodes[node].activeOctants ^= (1 << i);
+					}
+				}
+			}
+			if (nodes[node].activeOctants == 0x00 && nodes[node].firstChild != Invalid)
+				FreeChildren(node);
+
+			// Get Moved Object that were in this node previously
+			size_t movedStart = movedSlots.size();
+			for (unsigned int slot = nodes[node].firstEntity; slot != Invalid; slot = entityNext[slot])
+				if (entities[slot]->hasMoved)
+					movedSlots.push_back(slot);
+
+			for (unsigned char flags = nodes[node].activeOctants, i = 0; flags > 0; flags >>= 1, i++)
+				if (flags & (1 << 0)) // Active Child
+					UpdateNode(nodes[node].firstChild + i);
+
+			// Move Moved Objects into new nodes
+			for (size_t m = movedStart; m < movedSlots.size(); m++)
+			{
+				unsigned int slot = movedSlots[m];
+				AABB aabb = entities[slot]->GetAABB();
+
+				// Find region that contains this entity
+				unsigned int current = node;
+				while (!nodes[current].bounds.Contains(aabb) && nodes[current].parent != Invalid)
+					current = nodes[current].parent;
+
+				Unlink(slot);
+				entities[slot]->hasMoved = false;
+				if (!Insert(current, slot))
+				{
+					// Left the tree entirely, wait for it to come back
+					pending.push_back(entities[slot]);
+					entities[slot].reset();
+					freeSlots.push_back(slot);
+				}
+			}
+			movedSlots.resize(movedStart);
+		}
+
+		void GatherRelevant(unsigned int node, Frustum& frustum, std::vector<Entity*>& out)
+		{
+			for (int i = 0; i < 6; i++)
+				if (!nodes[node].bounds.IntersectsPlane(frustum.normals[i]))
+					return;
+
+			for (unsigned int slot = nodes[node].firstEntity; slot != Invalid; slot = entityNext[slot])
+				out.push_back(entities[slot].get());
+
+			for (unsigned char flags = nodes[node].activeOctants, i = 0; flags > 0; flags >>= 1, i++)
+				if (flags & (1 << 0)) // Child exists
+					GatherRelevant(nodes[node].firstChild + i, frustum, out);
+		}
+	};
+}
+
+/// <summary>
+/// Compares the pointer based Octree::Node against the index based layout in PooledOctree
+/// </summary>
+/// <param name="frustum">Frustum used for the query timings</param>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::OctreeStorage(Frustum& frustum, unsigned int entityCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	// Identical layouts for both trees, since updating a tree consumes hasMoved
+	std::vector<std::shared_ptr<Entity>> nodeEntities = CreateEntities(entityCount, bounds, 1234);
+	std::vector<std::shared_ptr<Entity>> poolEntities = CreateEntities(entityCount, bounds, 1234);
+
+	// Build
+	Clock::time_point start = Clock::now();
+	Octree::Node node(bounds, nodeEntities);
+	node.Build();
+	double nodeBuild = MillisecondsSince(start);
+
+	start = Clock::now();
+	PooledOctree pool(bounds, poolEntities);
+	pool.Build();
+	double poolBuild = MillisecondsSince(start);
+
+	// Update
+	std::mt19937 nodeRng(5678);
+	double nodeUpdate = 0;
+	size_t nodeMoved = 0;
+	for (int i = 0; i < UpdateFrames; i++)
+	{
+		MoveEntities(nodeEntities, nodeRng);
+		nodeMoved += CountMoved(nodeEntities);
+		start = Clock::now();
+		node.Update();
+		nodeUpdate += MillisecondsSince(start);
+	}
+
+	std::mt19937 poolRng(5678);
+	double poolUpdate = 0;
+	size_t poolMoved = 0;
+	for (int i = 0; i < UpdateFrames; i++)
+	{
+		MoveEntities(poolEntities, poolRng);
+		poolMoved += CountMoved(poolEntities);
+		start = Clock::now();
+		pool.Update();
+		poolUpdate += MillisecondsSince(start);
+	}
+
+	// Query
+	start = Clock::now();
+	std::vector<Entity*> nodeRelevant;
+	node.GetRelevantEntities(frustum, nodeRelevant);
+	size_t nodeVisible = nodeRelevant.size();
+	double nodeQuery = MillisecondsSince(start);
+
+	start = Clock::now();
+	std::vector<Entity*> poolRelevant;
+	pool.GetRelevantEntities(frustum, poolRelevant);
+	size_t poolVisible = poolRelevant.size();
+	double poolQuery = MillisecondsSince(start);
+
+	char buf[1024];
+	snprintf(buf, sizeof(buf),
+		"Octree storage, %u entities\n"
+		"          build(ms)  update/frame(ms)  moved/frame  query(ms)  visible  nodes    memory(KB)\n"
+		"Node    %10.2f  %16.3f  %11zu  %9.3f  %7zu  %7u  %10zu\n"
+		"Pool    %10.2f  %16.3f  %11zu  %9.3f  %7zu  %7u  %10zu\n",
+		entityCount,
+		nodeBuild, nodeUpdate / UpdateFrames, nodeMoved / UpdateFrames, nodeQuery, nodeVisible, node.GetNodeCount(), node.GetMemoryUsage() / 1024,
+		poolBuild, poolUpdate / UpdateFrames, poolMoved / UpdateFrames, poolQuery, poolVisible, pool.GetNodeCount(), pool.GetMemoryUsage() / 1024);
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Times Octree::Node::Update with a handful of moving entities at 10k, 100k
+/// and 1M entities. Only moved entities are visited, so the time should stay
+/// flat as the tree grows.
+/// </summary>
+/// <param name="movedCount">Entities moved each frame</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::OctreeUpdate(unsigned int movedCount)
+{
+	const unsigned int entityCounts[] = { 10000, 100000, 1000000 };
+
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::string report = "Octree update, " + std::to_string(movedCount) + " moved entities per frame, average of " +
+		std::to_string(UpdateFrames) + " frames\n"
+		"entities    nodes  relocated/frame  update(ms)  consistent\n";
+
+	for (unsigned int entityCount : entityCounts)
+	{
+		std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+		Octree::Node node(bounds, entities);
+		node.Build();
+
+		std::mt19937 rng(5678);
+		std::uniform_int_distribution<size_t> pick(0, entities.size() - 1);
+		std::uniform_real_distribution<float> offset(-8.0f, 8.0f);
+		double update = 0;
+		size_t relocated = 0;
+		for (int i = 0; i < UpdateFrames; i++)
+		{
+			for (unsigned int m = 0; m < movedCount; m++)
+				Nudge(entities[pick(rng)], offset(rng), offset(rng), offset(rng));
+			relocated += node.GetMovedEntities().size();
+			Clock::time_point start = Clock::now();
+			node.Update();
+			update += MillisecondsSince(start);
+		}
+
+		// Every entity should be held by a node that contains it
+		bool consistent = true;
+		for (std::shared_ptr<Entity>& entity : entities)
+		{
+			if (entity->octreeNode == nullptr ||
+				!entity->octreeNode->GetLooseBounds().Contains(entity->GetAABB()))
+				consistent = false;
+		}
+
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%8u  %7u  %15zu  %10.4f  %10s\n",
+			entityCount, node.GetNodeCount(), relocated / UpdateFrames, update / UpdateFrames, consistent ? "yes" : "NO");
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Spawns and despawns a batch of short lived entities every frame, against
+/// rebuilding the tree, which was the only way to remove entities before.
+/// Also despawns batches that are still pending and batches that have just
+/// moved, which are removed from the pending and moved lists by index.
+/// </summary>
+/// <param name="churnCount">Entities spawned and despawned each frame</param>
+/// <param name="entityCount">Entities that stay in the tree</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::SpawnDespawn(unsigned int churnCount, unsigned int entityCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+	Octree::Node node(bounds, entities);
+	node.Build();
+
+	// Each frame despawns the previous frame's batch after spawning its own
+	std::vector<std::shared_ptr<Entity>> previous;
+	double spawn = 0;
+	double despawn = 0;
+	Clock::time_point start;
+	for (int i = 0; i < UpdateFrames; i++)
+	{
+		std::vector<std::shared_ptr<Entity>> batch = CreateEntities(churnCount, bounds, 100 + i);
+
+		start = Clock::now();
+		for (std::shared_ptr<Entity>& entity : batch)
+			node.AddToPending(entity);
+		node.Update();
+		spawn += MillisecondsSince(start);
+
+		start = Clock::now();
+		for (std::shared_ptr<Entity>& entity : previous)
+			node.Remove(entity.get());
+		despawn += MillisecondsSince(start);
+
+		previous.swap(batch);
+	}
+	for (std::shared_ptr<Entity>& entity : previous)
+		node.Remove(entity.get());
+	node.Update();
+
+	// Despawned before the Update that would have inserted them
+	size_t removed = 0;
+	double pendingDespawn = 0;
+	for (int i = 0; i < UpdateFrames; i++)
+	{
+		std::vector<std::shared_ptr<Entity>> batch = CreateEntities(churnCount, bounds, 200 + i);
+		for (std::shared_ptr<Entity>& entity : batch)
+			node.AddToPending(entity);
+
+		start = Clock::now();
+		for (std::shared_ptr<Entity>& entity : batch)
+			removed += node.Remove(entity.get()) ? 1 : 0;
+		pendingDespawn += MillisecondsSince(start);
+		node.Update();
+	}
+
+	// Despawned after moving, before the Update that would have relocated them
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+	double movedDespawn = 0;
+	for (int i = 0; i < UpdateFrames; i++)
+	{
+		std::vector<std::shared_ptr<Entity>> batch = CreateEntities(churnCount, bounds, 300 + i);
+		for (std::shared_ptr<Entity>& entity : batch)
+			node.AddToPending(entity);
+		node.Update();
+		for (std::shared_ptr<Entity>& entity : batch)
+			Nudge(entity, offset(rng), offset(rng), offset(rng));
+
+		start = Clock::now();
+		for (std::shared_ptr<Entity>& entity : batch)
+			removed += node.Remove(entity.get()) ? 1 : 0;
+		movedDespawn += MillisecondsSince(start);
+		node.Update();
+	}
+	size_t remaining = node.GetAllEntities().size();
+
+	// Rebuilding a tree of the same size
+	entities.insert(entities.end(), previous.begin(), previous.end());
+	start = Clock::now();
+	Octree::Node rebuilt(bounds, entities);
+	rebuilt.Build();
+	double rebuild = MillisecondsSince(start);
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Spawn and despawn, %u entities per frame in a tree of %u, average of %d frames\n"
+		"spawn(ms)  despawn(ms)  pending despawn(ms)  moved despawn(ms)  rebuild(ms)\n"
+		"%9.3f  %11.3f  %19.3f  %17.3f  %11.2f\n"
+		"Pending and moved entities removed: %zu (expected %u)\n"
+		"Entities left after despawning: %zu (expected %u)\n",
+		churnCount, entityCount, UpdateFrames,
+		spawn / UpdateFrames, despawn / UpdateFrames, pendingDespawn / UpdateFrames,
+		movedDespawn / UpdateFrames, rebuild,
+		removed, churnCount * UpdateFrames * 2,
+		remaining, entityCount);
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Builds a tree whose root is far smaller than the scene, moves entities
+/// further out, and checks every visible entity is still found
+/// </summary>
+/// <param name="frustum">Frustum used for the visibility check</param>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::RootGrowth(Frustum& frustum, unsigned int entityCount)
+{
+	AABB sceneBounds;
+	sceneBounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	sceneBounds.max = DirectX::XMFLOAT3(256, 256, 256);
+	AABB rootBounds;
+	rootBounds.min = DirectX::XMFLOAT3(-32, -32, -32);
+	rootBounds.max = DirectX::XMFLOAT3(32, 32, 32);
+
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, sceneBounds, 1234);
+	Clock::time_point start = Clock::now();
+	Octree::Node node(rootBounds, entities);
+	node.Build();
+	double build = MillisecondsSince(start);
+	AABB builtBounds = node.GetBounds();
+
+	// Send some entities far enough away to use up the growth limit
+	std::mt19937 rng(5678);
+	std::uniform_int_distribution<size_t> pick(0, entities.size() - 1);
+	std::uniform_real_distribution<float> offset(-100000.0f, 100000.0f);
+	for (int i = 0; i < UpdateFrames; i++)
+	{
+		for (int m = 0; m < 8; m++)
+			Nudge(entities[pick(rng)], offset(rng), offset(rng), offset(rng));
+		node.Update();
+	}
+
+	// Brute force visibility
+	size_t expected = 0;
+	for (std::shared_ptr<Entity>& entity : entities)
+	{
+		AABB aabb = entity->GetAABB();
+		bool visible = true;
+		for (int i = 0; i < 6 && visible; i++)
+			visible = aabb.IntersectsPlane(frustum.normals[i]);
+		if (visible)
+			expected++;
+	}
+	std::vector<Entity*> visible;
+	node.GetVisibleEntities(frustum, visible);
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Root growth, %u entities in +-256 with a +-32 root\n"
+		"Built in %.2f ms, root width grew from 64 to %.0f, then to %.0f after outliers\n"
+		"Entities in tree: %zu, overflowing: %zu\n"
+		"Visible: %zu, brute force: %zu\n",
+		entityCount,
+		build, builtBounds.Dimensions().x, node.GetBounds().Dimensions().x,
+		node.GetAllEntities().size(), node.GetOverflowCount(),
+		visible.size(), expected);
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Compares octree ray casts, nearest hit and 8 nearest hits,
+/// against testing every entity's bounds
+/// </summary>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <param name="rayCount">Rays cast by each method</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::Raycast(unsigned int entityCount, unsigned int rayCount)
+{
+	const unsigned int k = 8;
+
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+	Octree::Node node(bounds, entities);
+	node.Build();
+
+	// Rays from inside the scene in random directions
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> position(-224.0f, 224.0f);
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	std::vector<Ray> rays(rayCount);
+	for (Ray& ray : rays)
+	{
+		ray.origin = DirectX::XMFLOAT3(position(rng), position(rng), position(rng));
+		DirectX::XMStoreFloat3(&ray.direction, DirectX::XMVector3Normalize(
+			DirectX::XMVectorSet(direction(rng), direction(rng), direction(rng), 0.0f)));
+	}
+
+	// Brute force, keeping every hit for the k nearest comparison
+	std::vector<std::vector<Octree::RayHit>> expected(rayCount);
+	Clock::time_point start = Clock::now();
+	for (unsigned int r = 0; r < rayCount; r++)
+	{
+		for (std::shared_ptr<Entity>& entity : entities)
+		{
+			float tNear, tFar;
+			if (entity->GetAABB().Intersects(rays[r], tNear, tFar))
+				expected[r].push_back({ entity.get(), tNear });
+		}
+	}
+	double bruteForce = MillisecondsSince(start);
+	for (std::vector<Octree::RayHit>& hits : expected)
+	{
+		std::sort(hits.begin(), hits.end(),
+			[](const Octree::RayHit& a, const Octree::RayHit& b) { return a.t < b.t; });
+	}
+
+	// Nearest hit
+	unsigned int nearestMismatches = 0;
+	start = Clock::now();
+	for (unsigned int r = 0; r < rayCount; r++)
+	{
+		Octree::RayHit hit;
+		bool found = node.Raycast(rays[r], FLT_MAX, hit);
+		if (found != (expected[r].size() > 0) || (found && hit.t != expected[r][0].t))
+			nearestMismatches++;
+	}
+	double nearest = MillisecondsSince(start);
+
+	// k nearest hits
+	unsigned int kMismatches = 0;
+	std::vector<Octree::RayHit> hits;
+	hits.reserve(k);
+	start = Clock::now();
+	for (unsigned int r = 0; r < rayCount; r++)
+	{
+		node.Raycast(rays[r], FLT_MAX, k, hits);
+		size_t count = expected[r].size() < k ? expected[r].size() : k;
+		bool same = hits.size() == count;
+		for (size_t i = 0; i < count && same; i++)
+			same = hits[i].t == expected[r][i].t;
+		if (!same)
+			kMismatches++;
+	}
+	double kNearest = MillisecondsSince(start);
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Ray casts, %u entities, %u rays\n"
+		"                 total(ms)  mismatches\n"
+		"Brute force   %12.2f\n"
+		"Nearest       %12.2f  %10u\n"
+		"%u nearest     %12.2f  %10u\n",
+		entityCount, rayCount,
+		bruteForce,
+		nearest, nearestMismatches,
+		k, kNearest, kMismatches);
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Compares the octree sphere, box and k nearest queries against
+/// testing every entity, at 10k, 100k and 1M entities
+/// </summary>
+/// <returns>A printable report</returns>
+std::string Benchmark::RangeQueries()
+{
+	const unsigned int entityCounts[] = { 10000, 100000, 1000000 };
+	const float radius = 16.0f;
+	const unsigned int k = 8;
+
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::string report = "Octree range queries, radius " + std::to_string((int)radius) + ", " +
+		std::to_string(k) + " nearest, total of " + std::to_string(QueryRepeats) + " queries\n"
+		"entities  query    octree(ms)  brute(ms)  mismatches\n";
+
+	for (unsigned int entityCount : entityCounts)
+	{
+		std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+		Octree::Node node(bounds, entities);
+		node.Build();
+
+		std::mt19937 rng(5678);
+		std::uniform_real_distribution<float> position(-224.0f, 224.0f);
+		std::vector<DirectX::XMFLOAT3> points(QueryRepeats);
+		for (DirectX::XMFLOAT3& point : points)
+			point = DirectX::XMFLOAT3(position(rng), position(rng), position(rng));
+
+		std::vector<Entity*> found;
+		std::vector<Octree::Neighbor> nearest;
+		std::vector<float> sqDistances;
+		double octreeTime[3] = {};
+		double bruteTime[3] = {};
+		unsigned int mismatches[3] = {};
+
+		for (DirectX::XMFLOAT3& point : points)
+		{
+			AABB box;
+			box.min = DirectX::XMFLOAT3(point.x - radius, point.y - radius, point.z - radius);
+			box.max = DirectX::XMFLOAT3(point.x + radius, point.y + radius, point.z + radius);
+
+			// Sphere
+			found.clear();
+			Clock::time_point start = Clock::now();
+			node.QuerySphere(point, radius, found);
+			octreeTime[0] += MillisecondsSince(start);
+			size_t expected = 0;
+			start = Clock::now();
+			for (std::shared_ptr<Entity>& entity : entities)
+				if (entity->GetAABB().Intersects(point, radius))
+					expected++;
+			bruteTime[0] += MillisecondsSince(start);
+			if (found.size() != expected)
+				mismatches[0]++;
+
+			// Box
+			found.clear();
+			start = Clock::now();
+			node.QueryAABB(box, found);
+			octreeTime[1] += MillisecondsSince(start);
+			expected = 0;
+			start = Clock::now();
+			for (std::shared_ptr<Entity>& entity : entities)
+				if (entity->GetAABB().Intersects(box))
+					expected++;
+			bruteTime[1] += MillisecondsSince(start);
+			if (found.size() != expected)
+				mismatches[1]++;
+
+			// k nearest
+			start = Clock::now();
+			node.QueryKNearest(point, k, nearest);
+			octreeTime[2] += MillisecondsSince(start);
+			sqDistances.clear();
+			start = Clock::now();
+			for (std::shared_ptr<Entity>& entity : entities)
+				sqDistances.push_back(entity->GetAABB().SqDistPointAABB(point));
+			std::partial_sort(sqDistances.begin(), sqDistances.begin() + k, sqDistances.end());
+			bruteTime[2] += MillisecondsSince(start);
+			bool same = nearest.size() == k;
+			for (unsigned int i = 0; i < k && same; i++)
+				same = nearest[i].sqDistance == sqDistances[i];
+			if (!same)
+				mismatches[2]++;
+		}
+
+		const char* names[3] = { "sphere", "box", "nearest" };
+		for (int q = 0; q < 3; q++)
+		{
+			char buf[128];
+			snprintf(buf, sizeof(buf), "%8u  %-7s  %10.3f  %9.2f  %10u\n",
+				entityCount, names[q], octreeTime[q], bruteTime[q], mismatches[q]);
+			report += buf;
+		}
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Times the octree broadphase over every entity, and over only the
+/// entities that moved in a frame, checking both against testing every pair
+/// </summary>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::Broadphase(unsigned int entityCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-96, -96, -96);
+	bounds.max = DirectX::XMFLOAT3(96, 96, 96);
+
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+	Octree::Node node(bounds, entities);
+	node.Build();
+
+	// Every pair
+	std::vector<Octree::EntityPair> pairs;
+	std::vector<Octree::EntityPair> expected;
+	std::vector<Entity*> moved;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < UpdateFrames; i++)
+		node.GetCollisionPairs(pairs);
+	double full = MillisecondsSince(start) / UpdateFrames;
+	size_t fullCount = pairs.size();
+
+	start = Clock::now();
+	BruteForcePairs(entities, moved, expected);
+	double bruteForce = MillisecondsSince(start);
+	NormalizePairs(pairs);
+	NormalizePairs(expected);
+	bool fullSame = SamePairs(pairs, expected);
+
+	// Only pairs with moved entities, found while updating
+	std::mt19937 rng(5678);
+	MoveEntities(entities, rng);
+	for (std::shared_ptr<Entity>& entity : entities)
+		if (entity->hasMoved)
+			moved.push_back(entity.get());
+	start = Clock::now();
+	node.Update(pairs);
+	double movedTime = MillisecondsSince(start);
+	size_t movedCount = pairs.size();
+
+	BruteForcePairs(entities, moved, expected);
+	NormalizePairs(pairs);
+	NormalizePairs(expected);
+	bool movedSame = SamePairs(pairs, expected);
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Broadphase, %u entities\n"
+		"                   time(ms)    pairs  matches brute force\n"
+		"Every pair      %10.3f  %7zu  %s\n"
+		"Moved (%5zu)    %10.3f  %7zu  %s\n"
+		"Brute force     %10.2f\n"
+		"(moved time includes relocating them)\n",
+		entityCount,
+		full, fullCount, fullSame ? "yes" : "NO",
+		moved.size(), movedTime, movedCount, movedSame ? "yes" : "NO",
+		bruteForce);
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Compares the octree and sweep and prune broadphases on a dense grid
+/// where every entity moves each frame, and a sparse open scene where
+/// only some do
+/// </summary>
+/// <param name="entityCount">Number of entities in each test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::BroadphaseComparison(unsigned int entityCount)
+{
+	// Dense grid, every entity overlaps its neighbours and jitters each frame
+	AABB gridBounds;
+	std::vector<std::shared_ptr<Entity>> grid = CreateGrid(entityCount, 0.9f, gridBounds);
+	double gridOctree, gridSweep;
+	size_t gridPairs;
+	bool gridSame = CompareBroadphases(grid, gridBounds, true, gridOctree, gridSweep, gridPairs);
+
+	// Sparse open scene, a fraction of the entities move each frame
+	AABB openBounds;
+	openBounds.min = DirectX::XMFLOAT3(-512, -512, -512);
+	openBounds.max = DirectX::XMFLOAT3(512, 512, 512);
+	std::vector<std::shared_ptr<Entity>> open = CreateEntities(entityCount, openBounds, 1234);
+	double openOctree, openSweep;
+	size_t openPairs;
+	bool openSame = CompareBroadphases(open, openBounds, false, openOctree, openSweep, openPairs);
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Broadphase comparison, %u entities, ms per frame\n"
+		"              octree  sweep&prune  pairs/frame  same pairs\n"
+		"Dense grid  %8.3f  %11.3f  %11zu  %s\n"
+		"Sparse open %8.3f  %11.3f  %11zu  %s\n",
+		entityCount,
+		gridOctree, gridSweep, gridPairs, gridSame ? "yes" : "NO",
+		openOctree, openSweep, openPairs, openSame ? "yes" : "NO");
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Compares culling with the octree, tight and loose, against the SAH
+/// built BVH, on a scene of unevenly sized static architecture
+/// </summary>
+/// <param name="frustum">Frustum to cull with</param>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::SpatialIndexCulling(Frustum& frustum, unsigned int entityCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::string report = "Spatial index culling, " + std::to_string(entityCount) +
+		" entities of uneven sizes, average of " + std::to_string(QueryRepeats) + " queries\n"
+		"              build(ms)   nodes  cull(ms)  visible  refit(ms)  matches octree\n";
+
+	std::vector<unsigned int> expected;
+	const float loosenesses[] = { 1.0f, 2.0f };
+	for (int i = 0; i < 3; i++)
+	{
+		// Identical layouts for each index, since an entity can only be in one octree
+		// and updating consumes hasMoved. Scene indices identify the same entity across copies.
+		std::vector<std::shared_ptr<Entity>> entities = CreateArchitecture(entityCount, bounds, 1234);
+		for (unsigned int e = 0; e < entities.size(); e++)
+			entities[e]->sceneIndex = e;
+
+		std::shared_ptr<SpatialIndex> index;
+		std::shared_ptr<Octree::Node> octree;
+		unsigned int nodeCount = 0;
+		Clock::time_point start = Clock::now();
+		if (i < 2)
+		{
+			octree = std::make_shared<Octree::Node>(bounds, entities, nullptr, loosenesses[i]);
+			octree->Build();
+			index = std::make_shared<OctreeIndex>(octree);
+		}
+		else
+			index = std::make_shared<Bvh>(entities);
+		double buildTime = MillisecondsSince(start);
+
+		if (octree)
+		{
+			std::vector<unsigned int> nodesPerDepth;
+			std::vector<unsigned int> entitiesPerDepth;
+			octree->GetDepthStatistics(nodesPerDepth, entitiesPerDepth);
+			for (unsigned int nodes : nodesPerDepth)
+				nodeCount += nodes;
+		}
+		else
+			nodeCount = std::static_pointer_cast<Bvh>(index)->GetNodeCount();
+
+		std::vector<Entity*> visible;
+		start = Clock::now();
+		for (int q = 0; q < QueryRepeats; q++)
+		{
+			visible.clear();
+			index->GetVisibleEntities(frustum, visible);
+		}
+		double cullTime = MillisecondsSince(start) / QueryRepeats;
+
+		std::vector<unsigned int> visibleIndices;
+		for (Entity* entity : visible)
+			visibleIndices.push_back(entity->sceneIndex);
+		std::sort(visibleIndices.begin(), visibleIndices.end());
+		if (i == 0)
+			expected = visibleIndices;
+		bool same = visibleIndices == expected;
+
+		// Moving entities, relocated by the octree or refit by the BVH
+		std::mt19937 rng(5678);
+		MoveEntities(entities, rng);
+		start = Clock::now();
+		index->Update();
+		if (octree)
+			octree->Update();
+		double refitTime = MillisecondsSince(start);
+
+		char buf[256];
+		snprintf(buf, sizeof(buf), "%-12s %10.3f %7u %9.3f %8zu %10.3f  %s\n",
+			i == 0 ? "Octree" : (i == 1 ? "Loose octree" : "BVH"),
+			buildTime, nodeCount, cullTime, visible.size(), refitTime, same ? "yes" : "NO");
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Compares keeping entities that move every frame in the octree against
+/// keeping them in a spatial hash grid beside a static octree
+/// </summary>
+/// <param name="frustum">Frustum to cull with</param>
+/// <param name="staticCount">Entities that never move</param>
+/// <param name="dynamicCount">Entities that move every frame</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::DynamicEntities(Frustum& frustum, unsigned int staticCount, unsigned int dynamicCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::string report = "Dynamic entities, " + std::to_string(staticCount) + " static and " +
+		std::to_string(dynamicCount) + " moving every frame\n"
+		"                  update(ms)  cull(ms)  visible  matches octree\n";
+
+	std::vector<unsigned int> expected;
+	for (int useGrid = 0; useGrid < 2; useGrid++)
+	{
+		// Identical layouts for both, scene indices identify the same entity across copies
+		std::vector<std::shared_ptr<Entity>> staticEntities = CreateEntities(staticCount, bounds, 1234);
+		std::vector<std::shared_ptr<Entity>> dynamicEntities = CreateEntities(dynamicCount, bounds, 4321);
+		for (unsigned int e = 0; e < staticCount; e++)
+			staticEntities[e]->sceneIndex = e;
+		for (unsigned int e = 0; e < dynamicCount; e++)
+			dynamicEntities[e]->sceneIndex = staticCount + e;
+
+		std::vector<std::shared_ptr<Entity>> octreeEntities = staticEntities;
+		if (!useGrid)
+			octreeEntities.insert(octreeEntities.end(), dynamicEntities.begin(), dynamicEntities.end());
+		Octree::Node octree(bounds, octreeEntities);
+		octree.Build();
+		SpatialHashGrid grid;
+		if (useGrid)
+		{
+			for (std::shared_ptr<Entity>& entity : dynamicEntities)
+				grid.AddEntity(entity);
+		}
+
+		std::mt19937 rng(5678);
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+		double updateTime = 0.0;
+		for (int frame = 0; frame < UpdateFrames; frame++)
+		{
+			for (std::shared_ptr<Entity>& entity : dynamicEntities)
+				Nudge(entity, offset(rng), offset(rng), offset(rng));
+
+			Clock::time_point start = Clock::now();
+			if (useGrid)
+			{
+				grid.Update();
+				grid.ClearMoved();
+			}
+			octree.Update();
+			updateTime += MillisecondsSince(start);
+		}
+		updateTime /= UpdateFrames;
+
+		std::vector<Entity*> visible;
+		Clock::time_point start = Clock::now();
+		for (int q = 0; q < QueryRepeats; q++)
+		{
+			visible.clear();
+			octree.GetVisibleEntities(frustum, visible);
+			if (useGrid)
+				grid.GetVisibleEntities(frustum, visible);
+		}
+		double cullTime = MillisecondsSince(start) / QueryRepeats;
+
+		std::vector<unsigned int> visibleIndices;
+		for (Entity* entity : visible)
+			visibleIndices.push_back(entity->sceneIndex);
+		std::sort(visibleIndices.begin(), visibleIndices.end());
+		if (!useGrid)
+			expected = visibleIndices;
+
+		char buf[256];
+		snprintf(buf, sizeof(buf), "%-16s %11.3f %9.3f %8zu  %s\n",
+			useGrid ? "Octree + grid" : "Octree only",
+			updateTime, cullTime, visible.size(), visibleIndices == expected ? "yes" : "NO");
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Compares the spatial hash grid's ray casts, sphere queries and box
+/// queries against testing every entity, with some entities placed
+/// past the range of a cell key, where their key would wrap onto a cell
+/// near the origin, and every entity moved before querying
+/// </summary>
+/// <param name="entityCount">Number of entities near the origin</param>
+/// <param name="queryCount">Queries of each kind</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::GridQueries(unsigned int entityCount, unsigned int queryCount)
+{
+	const unsigned int farCount = 64;
+	const float wrap = (float)(1 << 21) * GRID_CELL_SIZE;
+
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount + farCount, bounds, 1234);
+	for (unsigned int e = 0; e < entityCount + farCount; e++)
+	{
+		entities[e]->sceneIndex = e;
+		if (e < entityCount)
+			continue;
+		DirectX::XMFLOAT3 position = entities[e]->GetTransform()->GetPosition();
+		if (e % 2 == 0)
+			position.x += wrap;
+		else
+			position.z -= wrap;
+		entities[e]->GetTransform()->SetPosition(position);
+		entities[e]->GetAABB();
+		entities[e]->hasMoved = false;
+	}
+
+	SpatialHashGrid grid;
+	for (std::shared_ptr<Entity>& entity : entities)
+		grid.AddEntity(entity);
+
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+	for (int frame = 0; frame < UpdateFrames; frame++)
+	{
+		for (std::shared_ptr<Entity>& entity : entities)
+			Nudge(entity, offset(rng), offset(rng), offset(rng));
+		grid.Update();
+		grid.ClearMoved();
+	}
+
+	// Random queries inside the scene, and every tenth one at a far entity
+	std::uniform_real_distribution<float> position(-224.0f, 224.0f);
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> size(2.0f, 16.0f);
+	std::uniform_int_distribution<unsigned int> farEntity(entityCount, entityCount + farCount - 1);
+	std::vector<Ray> rays(queryCount);
+	std::vector<DirectX::XMFLOAT3> centers(queryCount);
+	std::vector<float> radii(queryCount);
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		DirectX::XMStoreFloat3(&rays[q].direction, DirectX::XMVector3Normalize(
+			DirectX::XMVectorSet(direction(rng), direction(rng), direction(rng), 0.0f)));
+		centers[q] = DirectX::XMFLOAT3(position(rng), position(rng), position(rng));
+		if (q % 10 == 0)
+			centers[q] = entities[farEntity(rng)]->GetTransform()->GetPosition();
+		rays[q].origin = DirectX::XMFLOAT3(
+			centers[q].x - rays[q].direction.x * 32.0f,
+			centers[q].y - rays[q].direction.y * 32.0f,
+			centers[q].z - rays[q].direction.z * 32.0f);
+		radii[q] = size(rng);
+	}
+
+	std::vector<float> expectedHits(queryCount, FLT_MAX);
+	std::vector<std::vector<unsigned int>> expectedSpheres(queryCount);
+	std::vector<std::vector<unsigned int>> expectedBoxes(queryCount);
+	double bruteForce[3] = {};
+	Clock::time_point start = Clock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		for (std::shared_ptr<Entity>& entity : entities)
+		{
+			float tNear, tFar;
+			if (entity->GetAABB().Intersects(rays[q], tNear, tFar) && tNear < expectedHits[q])
+				expectedHits[q] = tNear;
+		}
+	}
+	bruteForce[0] = MillisecondsSince(start);
+	start = Clock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+		for (std::shared_ptr<Entity>& entity : entities)
+			if (entity->GetAABB().Intersects(centers[q], radii[q]))
+				expectedSpheres[q].push_back(entity->sceneIndex);
+	bruteForce[1] = MillisecondsSince(start);
+	start = Clock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		AABB box;
+		box.min = DirectX::XMFLOAT3(centers[q].x - radii[q], centers[q].y - radii[q], centers[q].z - radii[q]);
+		box.max = DirectX::XMFLOAT3(centers[q].x + radii[q], centers[q].y + radii[q], centers[q].z + radii[q]);
+		for (std::shared_ptr<Entity>& entity : entities)
+			if (entity->GetAABB().Intersects(box))
+				expectedBoxes[q].push_back(entity->sceneIndex);
+	}
+	bruteForce[2] = MillisecondsSince(start);
+
+	unsigned int mismatches[3] = {};
+	double gridTime[3] = {};
+	start = Clock::now();
+	for (unsigned int q = 0; q < queryCount; q++)
+	{
+		Octree::RayHit hit;
+		bool found = grid.Raycast(rays[q], FLT_MAX, hit);
+		if (found != (expectedHits[q] < FLT_MAX) || (found && hit.t != expectedHits[q]))
+			mismatches[0]++;
+	}
+	gridTime[0] = MillisecondsSince(start);
+
+	std::vector<Entity*> found;
+	std::vector<unsigned int> indices;
+	for (int kind = 1; kind < 3; kind++)
+	{
+		start = Clock::now();
+		for (unsigned int q = 0; q < queryCount; q++)
+		{
+			found.clear();
+			if (kind == 1)
+				grid.QuerySphere(centers[q], radii[q], found);
+			else
+			{
+				AABB box;
+				box.min = DirectX::XMFLOAT3(centers[q].x - radii[q], centers[q].y - radii[q], centers[q].z - radii[q]);
+				box.max = DirectX::XMFLOAT3(centers[q].x + radii[q], centers[q].y + radii[q], centers[q].z + radii[q]);
+				grid.QueryAABB(box, found);
+			}
+
+			indices.clear();
+			for (Entity* entity : found)
+				indices.push_back(entity->sceneIndex);
+			std::sort(indices.begin(), indices.end());
+			if (indices != (kind == 1 ? expectedSpheres[q] : expectedBoxes[q]))
+				mismatches[kind]++;
+		}
+		gridTime[kind] = MillisecondsSince(start);
+	}
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Grid queries, %u entities and %u past the cell key range, %u of each query\n"
+		"          brute force(ms)  grid(ms)  mismatches  matches\n"
+		"Raycast   %15.2f %9.2f %11u  %s\n"
+		"Sphere    %15.2f %9.2f %11u  %s\n"
+		"Box       %15.2f %9.2f %11u  %s\n",
+		entityCount, farCount, queryCount,
+		bruteForce[0], gridTime[0], mismatches[0], mismatches[0] == 0 ? "yes" : "NO",
+		bruteForce[1], gridTime[1], mismatches[1], mismatches[1] == 0 ? "yes" : "NO",
+		bruteForce[2], gridTime[2], mismatches[2], mismatches[2] == 0 ? "yes" : "NO");
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Compares the allocating frustum query against the one that
+/// fills a caller owned buffer, at 10k, 100k and 1M entities
+/// </summary>
+/// <param name="frustum">Frustum used for the queries</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::OctreeQuery(Frustum& frustum)
+{
+	const unsigned int entityCounts[] = { 10000, 100000, 1000000 };
+
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::string report = "Octree frustum query, average of " + std::to_string(QueryRepeats) + " queries\n"
+		"entities  visible   vector(ms)  allocs   buffer(ms)  allocs\n";
+
+	for (unsigned int entityCount : entityCounts)
+	{
+		std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+		Octree::Node node(bounds, entities);
+		node.Build();
+
+		// Returns a new vector of shared pointers
+		size_t visible = 0;
+		StartCountingAllocations();
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < QueryRepeats; i++)
+			visible = node.GetRelevantEntities(frustum).size();
+		double vectorTime = MillisecondsSince(start) / QueryRepeats;
+		long vectorAllocs = StopCountingAllocations();
+
+		// Fills a reused buffer of raw pointers (sized by a first query)
+		std::vector<Entity*> buffer;
+		node.GetRelevantEntities(frustum, buffer);
+		StartCountingAllocations();
+		start = Clock::now();
+		for (int i = 0; i < QueryRepeats; i++)
+		{
+			buffer.clear();
+			node.GetRelevantEntities(frustum, buffer);
+		}
+		double bufferTime = MillisecondsSince(start) / QueryRepeats;
+		long bufferAllocs = StopCountingAllocations();
+
+		char buf[256];
+		if (vectorAllocs < 0)
+			snprintf(buf, sizeof(buf), "%8u  %7zu  %10.3f  %6s  %10.3f  %6s\n",
+				entityCount, visible, vectorTime, "n/a", bufferTime, "n/a");
+		else
+			snprintf(buf, sizeof(buf), "%8u  %7zu  %10.3f  %6ld  %10.3f  %6ld\n",
+				entityCount, visible, vectorTime, vectorAllocs / QueryRepeats, bufferTime, bufferAllocs / QueryRepeats);
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Compares node culling followed by a clip space test of every entity
+/// against the plane mask traversal that only tests entities in nodes
+/// crossing a frustum plane
+/// </summary>
+/// <param name="frustum">Frustum to cull with</param>
+/// <param name="view">View matrix matching the frustum</param>
+/// <param name="projection">Projection matrix matching the frustum</param>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::FrustumCulling(Frustum& frustum,
+	DirectX::XMFLOAT4X4 view,
+	DirectX::XMFLOAT4X4 projection,
+	unsigned int entityCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+	Octree::Node node(bounds, entities);
+	node.Build();
+
+	DirectX::XMMATRIX VP = DirectX::XMMatrixMultiply(
+		DirectX::XMLoadFloat4x4(&view), DirectX::XMLoadFloat4x4(&projection));
+	std::vector<Entity*> buffer;
+
+	// Node culling, then every entity in a surviving node in clip space
+	size_t clipVisible = 0;
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < QueryRepeats; i++)
+	{
+		buffer.clear();
+		node.GetRelevantEntities(frustum, buffer);
+		size_t kept = 0;
+		for (size_t e = 0; e < buffer.size(); e++)
+			if (ClipSpaceVisible(buffer[e]->GetAABB(), VP))
+				buffer[kept++] = buffer[e];
+		buffer.resize(kept);
+		clipVisible = kept;
+	}
+	double clipTime = MillisecondsSince(start) / QueryRepeats;
+
+	// Plane mask traversal
+	size_t maskVisible = 0;
+	start = Clock::now();
+	for (int i = 0; i < QueryRepeats; i++)
+	{
+		buffer.clear();
+		node.GetVisibleEntities(frustum, buffer);
+		maskVisible = buffer.size();
+	}
+	double maskTime = MillisecondsSince(start) / QueryRepeats;
+
+	char buf[512];
+	snprintf(buf, sizeof(buf),
+		"Frustum culling, %u entities, average of %d queries\n"
+		"                  time(ms)  visible\n"
+		"Clip space      %10.3f  %7zu\n"
+		"Plane mask      %10.3f  %7zu\n",
+		entityCount, QueryRepeats,
+		clipTime, clipVisible,
+		maskTime, maskVisible);
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Culls flat lists of boxes without a hierarchy, comparing the per box
+/// clip space test and plane test against the structure of arrays kernels
+/// at 10 thousand to 1 million boxes
+/// </summary>
+/// <param name="frustum">Frustum to cull with</param>
+/// <param name="view">View matrix matching the frustum</param>
+/// <param name="projection">Projection matrix matching the frustum</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::CullingKernels(Frustum& frustum,
+	DirectX::XMFLOAT4X4 view,
+	DirectX::XMFLOAT4X4 projection)
+{
+	const unsigned int boxCounts[] = { 10000, 100000, 1000000 };
+	typedef unsigned int (*Kernel)(Frustum&, const Culling::BoundsSoA&, unsigned int, unsigned int,
+		unsigned char, unsigned int*);
+	struct NamedKernel { const char* name; Kernel kernel; };
+	const NamedKernel kernels[] = {
+		{ "SoA scalar", Culling::CullScalar },
+#ifdef CULLING_SSE
+		{ "SoA SSE", Culling::CullSSE },
+#endif
+#ifdef CULLING_AVX2
+		{ "SoA AVX2", Culling::CullAVX2 },
+#endif
+	};
+
+	DirectX::XMMATRIX VP = DirectX::XMMatrixMultiply(
+		DirectX::XMLoadFloat4x4(&view), DirectX::XMLoadFloat4x4(&projection));
+
+	std::string report = "Culling kernels, boxes culled without a hierarchy\n"
+		"boxes    method         time(ms)  visible  matches planes\n";
+	for (unsigned int boxCount : boxCounts)
+	{
+		// Boxes of a few sizes spread through the same space as the other benchmarks
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> position(-224.0f, 224.0f);
+		std::uniform_real_distribution<float> size(0.25f, 2.0f);
+		std::vector<AABB> boxes(boxCount);
+		Culling::BoundsSoA bounds;
+		bounds.Resize(boxCount);
+		for (unsigned int b = 0; b < boxCount; b++)
+		{
+			DirectX::XMFLOAT3 center(position(rng), position(rng), position(rng));
+			float half = size(rng);
+			boxes[b].min = DirectX::XMFLOAT3(center.x - half, center.y - half, center.z - half);
+			boxes[b].max = DirectX::XMFLOAT3(center.x + half, center.y + half, center.z + half);
+			bounds.Set(b, boxes[b]);
+		}
+
+		// Fewer repeats for larger lists, so each size takes about as long
+		int repeats = QueryRepeats * 10000 / (int)boxCount;
+		repeats = repeats > 0 ? repeats : 1;
+		std::vector<unsigned int> visible(boxCount);
+		char buf[128];
+
+		// The clip space test rendering used to run on every entity
+		unsigned int clipVisible = 0;
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < repeats; r++)
+		{
+			clipVisible = 0;
+			for (unsigned int b = 0; b < boxCount; b++)
+			{
+				visible[clipVisible] = b;
+				clipVisible += ClipSpaceVisible(boxes[b], VP) ? 1 : 0;
+			}
+		}
+		snprintf(buf, sizeof(buf), "%-8u %-12s %10.3f %8u  %s\n",
+			boxCount, "Clip space", MillisecondsSince(start) / repeats, clipVisible, "-");
+		report += buf;
+
+		// The same plane test the octree runs on each entity
+		unsigned int planeVisible = 0;
+		start = Clock::now();
+		for (int r = 0; r < repeats; r++)
+		{
+			planeVisible = 0;
+			for (unsigned int b = 0; b < boxCount; b++)
+			{
+				bool inside = true;
+				for (int i = 0; i < 6 && inside; i++)
+					inside = boxes[b].IntersectsPlane(frustum.normals[i]);
+				visible[planeVisible] = b;
+				planeVisible += inside ? 1 : 0;
+			}
+		}
+		snprintf(buf, sizeof(buf), "%-8u %-12s %10.3f %8u  %s\n",
+			boxCount, "AoS planes", MillisecondsSince(start) / repeats, planeVisible, "-");
+		report += buf;
+		std::vector<unsigned int> expected(visible.begin(), visible.begin() + planeVisible);
+
+		for (const NamedKernel& named : kernels)
+		{
+			unsigned int kernelVisible = 0;
+			start = Clock::now();
+			for (int r = 0; r < repeats; r++)
+				kernelVisible = named.kernel(frustum, bounds, 0, boxCount, ALL_PLANES, visible.data());
+			double time = MillisecondsSince(start) / repeats;
+
+			bool matches = kernelVisible == planeVisible &&
+				std::equal(expected.begin(), expected.end(), visible.begin());
+			snprintf(buf, sizeof(buf), "%-8u %-12s %10.3f %8u  %s\n",
+				boxCount, named.name, time, kernelVisible, matches ? "yes" : "NO");
+			report += buf;
+		}
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Compares the precision and speed of each Frustum::Intersects mode on
+/// boxes scattered around the frustum. The exact test decides which boxes
+/// really overlap, the others should only add false positives.
+/// </summary>
+/// <param name="frustum">Frustum to test against</param>
+/// <param name="boxCount">Number of boxes to test</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::FrustumTests(Frustum& frustum, unsigned int boxCount)
+{
+	const FrustumTest tests[] = { FrustumTest::Fast, FrustumTest::Refined, FrustumTest::Exact };
+	const char* testNames[] = { "Fast", "Refined", "Exact" };
+
+	// Scatter boxes through the frustum's bounds grown by a quarter
+	// each way, so plenty land just outside its edges and corners
+	AABB around;
+	around.min = frustum.points[0];
+	around.max = frustum.points[0];
+	for (int i = 1; i < 8; i++)
+	{
+		DirectX::XMFLOAT3& p = frustum.points[i];
+		around.min = DirectX::XMFLOAT3(p.x < around.min.x ? p.x : around.min.x,
+			p.y < around.min.y ? p.y : around.min.y, p.z < around.min.z ? p.z : around.min.z);
+		around.max = DirectX::XMFLOAT3(p.x > around.max.x ? p.x : around.max.x,
+			p.y > around.max.y ? p.y : around.max.y, p.z > around.max.z ? p.z : around.max.z);
+	}
+	DirectX::XMFLOAT3 size = around.Dimensions();
+	float diagonal = sqrtf(size.x * size.x + size.y * size.y + size.z * size.z);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> x(around.min.x - size.x * 0.25f, around.max.x + size.x * 0.25f);
+	std::uniform_real_distribution<float> y(around.min.y - size.y * 0.25f, around.max.y + size.y * 0.25f);
+	std::uniform_real_distribution<float> z(around.min.z - size.z * 0.25f, around.max.z + size.z * 0.25f);
+	std::uniform_real_distribution<float> half(diagonal * 0.001f, diagonal * 0.05f);
+	std::vector<AABB> boxes(boxCount);
+	for (AABB& box : boxes)
+	{
+		DirectX::XMFLOAT3 center(x(rng), y(rng), z(rng));
+		float h = half(rng);
+		box.min = DirectX::XMFLOAT3(center.x - h, center.y - h, center.z - h);
+		box.max = DirectX::XMFLOAT3(center.x + h, center.y + h, center.z + h);
+	}
+
+	std::vector<char> overlaps(boxCount);
+	for (unsigned int b = 0; b < boxCount; b++)
+		overlaps[b] = frustum.Intersects(boxes[b], FrustumTest::Exact);
+
+	std::string report = "Frustum tests, " + std::to_string(boxCount) + " boxes around the frustum\n"
+		"mode      time(ms)  accepted  false positives  missed\n";
+	for (int t = 0; t < 3; t++)
+	{
+		unsigned int accepted = 0;
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < QueryRepeats; r++)
+		{
+			accepted = 0;
+			for (AABB& box : boxes)
+				accepted += frustum.Intersects(box, tests[t]) ? 1 : 0;
+		}
+		double time = MillisecondsSince(start) / QueryRepeats;
+
+		unsigned int falsePositives = 0;
+		unsigned int missed = 0;
+		for (unsigned int b = 0; b < boxCount; b++)
+		{
+			bool result = frustum.Intersects(boxes[b], tests[t]);
+			falsePositives += result && !overlaps[b] ? 1 : 0;
+			missed += !result && overlaps[b] ? 1 : 0;
+		}
+
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%-8s %9.3f %9u %16u %7u\n",
+			testNames[t], time, accepted, falsePositives, missed);
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Checks Frustum::FromViewProjection against frusta built from corners
+/// for perspective and orthographic views in several directions, then
+/// times both ways of building one
+/// </summary>
+/// <returns>A printable report</returns>
+std::string Benchmark::FrustumExtraction()
+{
+	using namespace DirectX;
+	struct View { const char* name; bool perspective; bool reversedZ; bool offCenter; XMFLOAT3 position; XMFLOAT3 forward; };
+	const View views[] = {
+		{ "Perspective", true, false, false, XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1) },
+		{ "Perspective", true, false, false, XMFLOAT3(12, -3, 40), XMFLOAT3(0.6f, 0.3f, -0.4f) },
+		{ "Perspective", true, false, false, XMFLOAT3(-50, 8, 2), XMFLOAT3(-0.2f, -0.9f, 0.1f) },
+		{ "Orthographic", false, false, false, XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 1) },
+		{ "Orthographic", false, false, false, XMFLOAT3(30, 20, -10), XMFLOAT3(0.5f, -0.7f, 0.5f) },
+		{ "Reversed Z persp", true, true, false, XMFLOAT3(12, -3, 40), XMFLOAT3(0.6f, 0.3f, -0.4f) },
+		{ "Reversed Z ortho", false, true, false, XMFLOAT3(30, 20, -10), XMFLOAT3(0.5f, -0.7f, 0.5f) },
+		{ "Off-center persp", true, false, true, XMFLOAT3(12, -3, 40), XMFLOAT3(0.6f, 0.3f, -0.4f) },
+		{ "Off-center ortho", false, false, true, XMFLOAT3(30, 20, -10), XMFLOAT3(0.5f, -0.7f, 0.5f) },
+	};
+	const float fov = XM_PIDIV4;
+	const float aspect = 16.0f / 9.0f;
+	const float nearClip = 0.05f;
+	const float farClip = 100.0f;
+	const float orthoSize = 30.0f;
+	// Largest error, relative to the far distance, still counted as the same
+	// frustum. Perspective depth loses precision toward the far plane.
+	const float epsilon = 1e-3f;
+
+	// Maps clip space z to w - z, swapping the depths of the near and far planes
+	const XMMATRIX reverseZ = XMMATRIX(
+		1, 0, 0, 0,
+		0, 1, 0, 0,
+		0, 0, -1, 0,
+		0, 0, 1, 1);
+
+	std::string report = "Frustum extraction against corner derivation\n"
+		"view              normal err  plane err  corner err  matches\n";
+	for (const View& view : views)
+	{
+		float tanHalf = tanf(fov * 0.5f);
+		XMFLOAT2 halfNear = view.perspective ?
+			XMFLOAT2(tanHalf * nearClip * aspect, tanHalf * nearClip) :
+			XMFLOAT2(orthoSize * aspect * 0.5f, orthoSize * 0.5f);
+		XMFLOAT2 halfFar = view.perspective ?
+			XMFLOAT2(tanHalf * farClip * aspect, tanHalf * farClip) : halfNear;
+
+		// Off-center views shift the view rectangle by part of its size,
+		// the shift growing with distance for perspective
+		XMFLOAT2 shiftNear = view.offCenter ?
+			XMFLOAT2(halfNear.x * 0.4f, halfNear.y * -0.25f) : XMFLOAT2(0, 0);
+		XMFLOAT2 shiftFar = view.perspective ?
+			XMFLOAT2(shiftNear.x * farClip / nearClip, shiftNear.y * farClip / nearClip) : shiftNear;
+
+		XMVECTOR pos = XMLoadFloat3(&view.position);
+		XMVECTOR fwd = XMLoadFloat3(&view.forward);
+		XMMATRIX V = XMMatrixLookToLH(pos, fwd, XMVectorSet(0, 1, 0, 0));
+		XMMATRIX P;
+		if (view.offCenter)
+		{
+			float left = shiftNear.x - halfNear.x, right = shiftNear.x + halfNear.x;
+			float bottom = shiftNear.y - halfNear.y, top = shiftNear.y + halfNear.y;
+			P = view.perspective ?
+				XMMatrixPerspectiveOffCenterLH(left, right, bottom, top, nearClip, farClip) :
+				XMMatrixOrthographicOffCenterLH(left, right, bottom, top, nearClip, farClip);
+		}
+		else
+		{
+			P = view.perspective ?
+				XMMatrixPerspectiveFovLH(fov, aspect, nearClip, farClip) :
+				XMMatrixOrthographicLH(orthoSize * aspect, orthoSize, nearClip, farClip);
+		}
+		if (view.reversedZ)
+			P = XMMatrixMultiply(P, reverseZ);
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(V, P));
+
+		Frustum extracted = Frustum::FromViewProjection(viewProjection);
+		Frustum corners = CornerFrustum(view.position, view.forward,
+			halfNear, halfFar, nearClip, farClip, shiftNear, shiftFar);
+
+		// Largest differences, the plane offset and corners relative to the far distance
+		float normalError = 0.0f, planeError = 0.0f, cornerError = 0.0f;
+		for (int i = 0; i < 6; i++)
+		{
+			XMFLOAT4 a = extracted.normals[i];
+			XMFLOAT4 b = corners.normals[i];
+			float n = fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z);
+			float w = fabsf(a.w - b.w) / farClip;
+			normalError = n > normalError ? n : normalError;
+			planeError = w > planeError ? w : planeError;
+		}
+		for (int i = 0; i < 8; i++)
+		{
+			XMFLOAT3 a = extracted.points[i];
+			XMFLOAT3 b = corners.points[i];
+			float d = (fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z)) / farClip;
+			cornerError = d > cornerError ? d : cornerError;
+		}
+
+		bool matches = normalError <= epsilon && planeError <= epsilon && cornerError <= epsilon;
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%-16s %11.2e %10.2e %11.2e  %s\n",
+			view.name, normalError, planeError, cornerError, matches ? "yes" : "NO");
+		report += buf;
+	}
+
+	// Rebuilding the camera's frustum each way
+	const int builds = 100000;
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+		XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0, 0, 1, 0), XMVectorSet(0, 1, 0, 0)),
+		XMMatrixPerspectiveFovLH(fov, aspect, nearClip, farClip)));
+	volatile float sink = 0.0f; // Keeps the builds from being optimized away
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < builds; i++)
+	{
+		viewProjection._41 = (float)(i & 7);
+		sink = Frustum::FromViewProjection(viewProjection).normals[0].w;
+	}
+	double extractTime = MillisecondsSince(start) * 1000.0 / builds;
+
+	float tanHalf = tanf(fov * 0.5f);
+	start = Clock::now();
+	for (int i = 0; i < builds; i++)
+	{
+		sink = CornerFrustum(XMFLOAT3((float)(i & 7), 0, 0), XMFLOAT3(0, 0, 1),
+			XMFLOAT2(tanHalf * nearClip * aspect, tanHalf * nearClip),
+			XMFLOAT2(tanHalf * farClip * aspect, tanHalf * farClip),
+			nearClip, farClip).normals[0].w;
+	}
+	double cornerTime = MillisecondsSince(start) * 1000.0 / builds;
+
+	char buf[160];
+	snprintf(buf, sizeof(buf), "Build time: extraction %.3fus, corners %.3fus\n",
+		extractTime, cornerTime);
+	report += buf;
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Replays camera paths over a scene where a few entities move every
+/// frame, comparing the octree's plane mask culling with and without
+/// a culling cache for the entities in straddling nodes
+/// </summary>
+/// <param name="recordedPath">View-projection matrices recorded from the camera,
+/// replayed alongside the built in paths when not empty</param>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::TemporalCulling(std::vector<DirectX::XMFLOAT4X4>& recordedPath, unsigned int entityCount)
+{
+	using namespace DirectX;
+	const int pathFrames = 120;
+	const unsigned int movingCount = entityCount / 100;
+
+	AABB bounds;
+	bounds.min = XMFLOAT3(-256, -256, -256);
+	bounds.max = XMFLOAT3(256, 256, 256);
+
+	// Built in paths: standing still, walking forward and turning on the spot,
+	// at about the speeds Camera::Update moves at 60 frames a second
+	struct Path { std::string name; std::vector<XMFLOAT4X4> frames; };
+	std::vector<Path> paths(3);
+	paths[0].name = "Still";
+	paths[1].name = "Walk";
+	paths[2].name = "Turn";
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 200.0f);
+	for (int f = 0; f < pathFrames; f++)
+	{
+		XMVECTOR up = XMVectorSet(0, 1, 0, 0);
+		XMMATRIX views[3] = {
+			XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0, 0, 1, 0), up),
+			XMMatrixLookToLH(XMVectorSet(0, 0, f * 0.1f, 0), XMVectorSet(0, 0, 1, 0), up),
+			XMMatrixLookToLH(XMVectorZero(), XMVectorSet(sinf(f * 0.01f), 0, cosf(f * 0.01f), 0), up)
+		};
+		for (int p = 0; p < 3; p++)
+		{
+			XMFLOAT4X4 viewProjection;
+			XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(views[p], projection));
+			paths[p].frames.push_back(viewProjection);
+		}
+	}
+	if (!recordedPath.empty())
+		paths.push_back({ "Recorded", recordedPath });
+
+	std::string report = "Temporal culling, " + std::to_string(entityCount) + " entities, " +
+		std::to_string(movingCount) + " moving each frame\n"
+		"path      frames  planes(ms)  cached(ms)  reused  first plane  matches\n";
+	for (Path& path : paths)
+	{
+		std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+		for (unsigned int e = 0; e < entityCount; e++)
+			entities[e]->sceneIndex = e;
+		Octree::Node octree(bounds, entities);
+		octree.Build();
+
+		CullingCache cache;
+		std::mt19937 rng(5678);
+		std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+		std::vector<Entity*> planeVisible;
+		std::vector<Entity*> cachedVisible;
+		double planeTime = 0.0;
+		double cachedTime = 0.0;
+		bool matches = true;
+		for (XMFLOAT4X4& viewProjection : path.frames)
+		{
+			for (unsigned int e = 0; e < movingCount; e++)
+				Nudge(entities[e], offset(rng), offset(rng), offset(rng));
+			octree.Update();
+			Frustum frustum = Frustum::FromViewProjection(viewProjection);
+
+			Clock::time_point start = Clock::now();
+			planeVisible.clear();
+			octree.GetVisibleEntities(frustum, planeVisible);
+			planeTime += MillisecondsSince(start);
+
+			start = Clock::now();
+			cachedVisible.clear();
+			octree.GetVisibleEntities(frustum, cachedVisible, &cache);
+			cachedTime += MillisecondsSince(start);
+
+			std::sort(planeVisible.begin(), planeVisible.end());
+			std::sort(cachedVisible.begin(), cachedVisible.end());
+			matches = matches && planeVisible == cachedVisible;
+		}
+
+		char buf[160];
+		snprintf(buf, sizeof(buf), "%-9s %6zu %11.3f %11.3f %6.1f%% %11.1f%%  %s\n",
+			path.name.c_str(), path.frames.size(),
+			planeTime / path.frames.size(), cachedTime / path.frames.size(),
+			cache.GetReuseRate() * 100.0f, cache.GetFirstPlaneHitRate() * 100.0f,
+			matches ? "yes" : "NO");
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Drops frustum culled entities below several projected size thresholds,
+/// checking each estimate against the entity's corners projected to the screen.
+/// Estimates come from the sphere around the box, so at the edges of the view,
+/// where perspective stretches things, they can come in under the real size.
+/// </summary>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::ContributionCulling(unsigned int entityCount)
+{
+	using namespace DirectX;
+	const float thresholds[] = { 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+	const float screenHeight = 1080.0f;
+
+	// A large scene with props of many sizes, looked at down a long view
+	AABB bounds;
+	bounds.min = XMFLOAT3(-2048, -2048, -2048);
+	bounds.max = XMFLOAT3(2048, 2048, 2048);
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+	std::mt19937 rng(5678);
+	std::uniform_real_distribution<float> scale(0.05f, 1.0f);
+	for (std::shared_ptr<Entity>& entity : entities)
+	{
+		entity->GetTransform()->SetScale(scale(rng));
+		entity->GetAABB();
+		entity->hasMoved = false;
+	}
+	Octree::Node octree(bounds, entities);
+	octree.Build();
+
+	XMFLOAT4X4 view;
+	XMFLOAT4X4 projection;
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&view, XMMatrixLookToLH(
+		XMVectorSet(0, 0, -2048, 0), XMVectorSet(0.2f, 0.1f, 1, 0), XMVectorSet(0, 1, 0, 0)));
+	XMStoreFloat4x4(&projection, XMMatrixPerspectiveFovLH(XM_PIDIV4, 16.0f / 9.0f, 0.1f, 4096.0f));
+	XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&projection)));
+	Frustum frustum = Frustum::FromViewProjection(viewProjection);
+	ScreenProjection screen = ScreenProjection::FromMatrices(viewProjection, projection, screenHeight);
+
+	std::vector<Entity*> visible;
+	octree.GetVisibleEntities(frustum, visible);
+
+	// The box's corners projected, its larger side on screen in pixels
+	XMMATRIX vp = XMLoadFloat4x4(&viewProjection);
+	std::vector<float> projectedSizes(visible.size());
+	for (size_t e = 0; e < visible.size(); e++)
+	{
+		AABB box = visible[e]->GetAABB();
+		float minX = FLT_MAX, minY = FLT_MAX;
+		float maxX = -FLT_MAX, maxY = -FLT_MAX;
+		bool behind = false;
+		for (int c = 0; c < 8; c++)
+		{
+			XMVECTOR corner = XMVector3Transform(XMVectorSet(
+				c & 1 ? box.max.x : box.min.x,
+				c & 2 ? box.max.y : box.min.y,
+				c & 4 ? box.max.z : box.min.z, 1.0f), vp);
+			float w = XMVectorGetW(corner);
+			behind = behind || w <= 0.0f;
+			float px = XMVectorGetX(corner) / w;
+			float py = XMVectorGetY(corner) / w;
+			minX = px < minX ? px : minX;
+			maxX = px > maxX ? px : maxX;
+			minY = py < minY ? py : minY;
+			maxY = py > maxY ? py : maxY;
+		}
+		// NDC spans two units across the screen's height, and as many
+		// pixels across its width as its height per unit of y
+		float width = (maxX - minX) * screenHeight * 0.5f * projection._22 / projection._11;
+		float height = (maxY - minY) * screenHeight * 0.5f;
+		projectedSizes[e] = behind ? FLT_MAX : (width > height ? width : height);
+	}
+
+	std::string report = "Contribution culling, " + std::to_string(entityCount) + " entities, " +
+		std::to_string(visible.size()) + " in the frustum\n"
+		"min size(px)  time(ms)   kept  dropped  underestimated\n";
+	for (float threshold : thresholds)
+	{
+		unsigned int kept = 0;
+		Clock::time_point start = Clock::now();
+		for (int r = 0; r < QueryRepeats; r++)
+		{
+			kept = 0;
+			for (Entity* entity : visible)
+				kept += screen.GetSize(entity->GetAABB()) >= threshold ? 1 : 0;
+		}
+		double time = MillisecondsSince(start) / QueryRepeats;
+
+		// Dropped although the projected corners span the threshold
+		unsigned int underestimated = 0;
+		for (size_t e = 0; e < visible.size(); e++)
+		{
+			if (screen.GetSize(visible[e]->GetAABB()) < threshold && projectedSizes[e] >= threshold)
+				underestimated++;
+		}
+
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%12.1f %9.3f %6u %8zu %15u\n",
+			threshold, time, kept, visible.size() - kept, underestimated);
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Times the octree build on 1, 4 and 16 threads and checks
+/// the parallel builds match the single threaded tree
+/// </summary>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::ParallelBuild(unsigned int entityCount)
+{
+	const unsigned int threadCounts[] = { 1, 4, 16 };
+
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	// Every build shares one set of entities, with their AABBs already computed
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+
+	std::string report = "Parallel octree build, " + std::to_string(entityCount) + " entities\n"
+		"threads  build(ms)  speedup  identical\n";
+
+	Octree::Node serial(bounds, entities);
+	double serialTime = 0;
+	for (unsigned int threads : threadCounts)
+	{
+		Octree::Node node(bounds, entities);
+		Clock::time_point start = Clock::now();
+		node.Build(threads);
+		double time = MillisecondsSince(start);
+
+		if (threads == 1)
+		{
+			serialTime = time;
+			serial.Build();
+		}
+
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%7u  %9.2f  %6.2fx  %9s\n",
+			threads, time, serialTime / time, SameTree(&serial, &node) ? "yes" : "NO");
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Compares the recursive Build against the Morton code bulk loader, then
+/// checks they still match for flat boxes lying on cell boundaries and for
+/// a root too deep for Morton codes
+/// </summary>
+/// <param name="entityCount">Number of entities in the test scene</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::MortonBuild(unsigned int entityCount)
+{
+	AABB bounds;
+	bounds.min = DirectX::XMFLOAT3(-256, -256, -256);
+	bounds.max = DirectX::XMFLOAT3(256, 256, 256);
+
+	// Both builds share one set of entities, with their AABBs already computed
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+
+	Octree::Node recursive(bounds, entities);
+	Clock::time_point start = Clock::now();
+	recursive.Build();
+	double recursiveTime = MillisecondsSince(start);
+
+	Octree::Node morton(bounds, entities);
+	start = Clock::now();
+	morton.BuildMorton();
+	double mortonTime = MillisecondsSince(start);
+
+	// Boxes with no thickness lying on the center planes and finer cell boundaries
+	std::vector<std::shared_ptr<Entity>> flat = CreateEntities(entityCount / 10, bounds, 4321);
+	const float planes[] = { 0.0f, 128.0f, -64.0f, 32.0f };
+	for (size_t e = 0; e < flat.size(); e++)
+	{
+		DirectX::XMFLOAT3 position = flat[e]->GetTransform()->GetPosition();
+		float plane = planes[e % 4];
+		switch (e % 3)
+		{
+		case 0: flat[e]->GetTransform()->SetPosition(plane, position.y, position.z); flat[e]->GetTransform()->SetScale(0.0f, 1.0f, 1.0f); break;
+		case 1: flat[e]->GetTransform()->SetPosition(position.x, plane, position.z); flat[e]->GetTransform()->SetScale(1.0f, 0.0f, 1.0f); break;
+		default: flat[e]->GetTransform()->SetPosition(position.x, position.y, plane); flat[e]->GetTransform()->SetScale(1.0f, 1.0f, 0.0f); break;
+		}
+		flat[e]->GetAABB();
+		flat[e]->hasMoved = false;
+	}
+	Octree::Node flatRecursive(bounds, flat);
+	flatRecursive.Build();
+	Octree::Node flatMorton(bounds, flat);
+	flatMorton.BuildMorton();
+
+	// A root Build would subdivide past MORTON_MAX_LEVEL, with a dense cluster of tiny entities at its center
+	AABB hugeBounds;
+	float huge = MIN_BOUNDS * (float)(1 << MORTON_MAX_LEVEL);
+	hugeBounds.min = DirectX::XMFLOAT3(-huge, -huge, -huge);
+	hugeBounds.max = DirectX::XMFLOAT3(huge, huge, huge);
+	AABB clusterBounds;
+	clusterBounds.min = DirectX::XMFLOAT3(-34, -34, -34);
+	clusterBounds.max = DirectX::XMFLOAT3(34, 34, 34);
+	std::vector<std::shared_ptr<Entity>> cluster = CreateEntities(entityCount / 10, clusterBounds, 5678);
+	for (std::shared_ptr<Entity>& entity : cluster)
+	{
+		entity->GetTransform()->SetScale(0.05f);
+		entity->GetAABB();
+		entity->hasMoved = false;
+	}
+	Octree::Node deepRecursive(hugeBounds, cluster);
+	deepRecursive.Build();
+	Octree::Node deepMorton(hugeBounds, cluster);
+	deepMorton.BuildMorton();
+
+	char buf[768];
+	snprintf(buf, sizeof(buf),
+		"Octree bulk build, %u entities\n"
+		"            build(ms)    nodes\n"
+		"Build     %10.2f  %7u\n"
+		"Morton    %10.2f  %7u\n"
+		"Speedup %.2fx, same nodes and entities: %s\n"
+		"Flat boxes on cell boundaries, same: %s\n"
+		"Root deeper than MORTON_MAX_LEVEL, same: %s\n",
+		entityCount,
+		recursiveTime, recursive.GetNodeCount(),
+		mortonTime, morton.GetNodeCount(),
+		recursiveTime / mortonTime,
+		SameTree(&recursive, &morton, false) ? "yes" : "NO",
+		SameTree(&flatRecursive, &flatMorton, false) ? "yes" : "NO",
+		SameTree(&deepRecursive, &deepMorton, false) ? "yes" : "NO");
+
+	printf("%s", buf);
+	return std::string(buf);
+}
+
+/// <summary>
+/// Rebuilds the world matrices of a set of transforms each way: per object
+/// the way Transform did before the transform store, per slot in the store
+/// as each is asked for, and in one batch from the store. With every
+/// transform moved and with a tenth of them moved.
+/// </summary>
+/// <param name="transformCount">Number of transforms to update</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::TransformUpdate(unsigned int transformCount)
+{
+	using namespace DirectX;
+	const float movedFractions[] = { 1.0f, MovedFraction };
+	TransformStore& store = TransformStore::GetInstance();
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-256.0f, 256.0f);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	std::vector<Transform> transforms(transformCount);
+	std::vector<EulerTransform> eulers(transformCount);
+	for (unsigned int t = 0; t < transformCount; t++)
+	{
+		XMFLOAT3 pitchYawRoll(angle(rng), angle(rng), angle(rng));
+		XMFLOAT3 scales(scale(rng), scale(rng), scale(rng));
+		transforms[t].SetRotation(pitchYawRoll);
+		transforms[t].SetScale(scales);
+		eulers[t].pitchYawRoll = pitchYawRoll;
+		eulers[t].scale = scales;
+	}
+
+	// Every way moves the same transforms to the same places each frame
+	std::vector<XMFLOAT3> positions(transformCount);
+	for (XMFLOAT3& p : positions)
+		p = XMFLOAT3(position(rng), position(rng), position(rng));
+
+	std::string report = "Transform update, " + std::to_string(transformCount) + " transforms\n"
+		"moved  per object(ms)  per slot(ms)  batched(ms)  speedup  max difference\n";
+	for (float fraction : movedFractions)
+	{
+		unsigned int movedCount = (unsigned int)(transformCount * fraction);
+		std::vector<XMFLOAT4X4> single(movedCount);
+
+		double objectTime = 0.0;
+		double singleTime = 0.0;
+		double batchTime = 0.0;
+		for (int frame = 0; frame < UpdateFrames; frame++)
+		{
+			for (unsigned int t = 0; t < movedCount; t++)
+			{
+				eulers[t].position = positions[t];
+				eulers[t].matricesDirty = true;
+			}
+			Clock::time_point start = Clock::now();
+			for (unsigned int t = 0; t < movedCount; t++)
+				eulers[t].GetWorldMatrix();
+			objectTime += MillisecondsSince(start);
+
+			for (unsigned int t = 0; t < movedCount; t++)
+				transforms[t].SetPosition(positions[t]);
+			start = Clock::now();
+			for (unsigned int t = 0; t < movedCount; t++)
+				single[t] = transforms[t].GetWorldMatrix();
+			singleTime += MillisecondsSince(start);
+
+			for (unsigned int t = 0; t < movedCount; t++)
+				transforms[t].SetPosition(positions[t]);
+			start = Clock::now();
+			store.UpdateWorldMatrices();
+			batchTime += MillisecondsSince(start);
+		}
+
+		float maxDifference = 0.0f;
+		for (unsigned int t = 0; t < movedCount; t++)
+		{
+			XMFLOAT4X4 batched = transforms[t].GetWorldMatrix();
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					float difference = fabsf(batched.m[i][j] - single[t].m[i][j]);
+					maxDifference = difference > maxDifference ? difference : maxDifference;
+				}
+			}
+		}
+
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%4.0f%% %15.3f %13.3f %12.3f %7.2fx %15g\n",
+			fraction * 100.0f, objectTime / UpdateFrames, singleTime / UpdateFrames,
+			batchTime / UpdateFrames, objectTime / batchTime, maxDifference);
+		report += buf;
+	}
+	report += "(speedup of batched over per object, difference between per slot and batched)\n";
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Moves the roots of a deep and a wide hierarchy, then brings every world
+/// matrix up to date, asking each transform in turn and in one batch
+/// </summary>
+/// <param name="depth">Levels in each chain of the deep hierarchy</param>
+/// <param name="transformCount">Transforms in each hierarchy</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::TransformHierarchy(unsigned int depth, unsigned int transformCount)
+{
+	using namespace DirectX;
+	TransformStore& store = TransformStore::GetInstance();
+
+	std::string report = "Transform hierarchy, " + std::to_string(transformCount) + " transforms\n"
+		"shape                  one at a time(ms)  batched(ms)  max difference\n";
+	for (int shape = 0; shape < 2; shape++)
+	{
+		// Deep: chains of the given depth, wide: one root with everything else under it
+		std::vector<Transform> transforms(transformCount);
+		std::vector<Transform*> roots;
+		for (unsigned int t = 0; t < transformCount; t++)
+		{
+			transforms[t].SetPosition(0.001f, 0.0f, 0.0f);
+			transforms[t].SetRotation(0.0f, 0.001f, 0.0f);
+			bool root = shape == 0 ? t % depth == 0 : t == 0;
+			if (root)
+				roots.push_back(&transforms[t]);
+			else
+				(shape == 0 ? transforms[t - 1] : transforms[0]).AddChild(&transforms[t], false);
+		}
+		store.UpdateWorldMatrices();
+
+		std::vector<XMFLOAT4X4> single(transformCount);
+		double singleTime = 0.0;
+		double batchTime = 0.0;
+		for (int frame = 0; frame < UpdateFrames; frame++)
+		{
+			for (Transform* root : roots)
+				root->MoveAbsolute(0.0f, 0.001f, 0.0f);
+			Clock::time_point start = Clock::now();
+			for (unsigned int t = 0; t < transformCount; t++)
+				single[t] = transforms[t].GetWorldMatrix();
+			singleTime += MillisecondsSince(start);
+
+			// Moved to where they already are, so both ways give the same matrices
+			for (Transform* root : roots)
+				root->SetPosition(root->GetPosition());
+			start = Clock::now();
+			store.UpdateWorldMatrices();
+			batchTime += MillisecondsSince(start);
+		}
+
+		float maxDifference = 0.0f;
+		for (unsigned int t = 0; t < transformCount; t++)
+		{
+			XMFLOAT4X4 batched = transforms[t].GetWorldMatrix();
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					float difference = fabsf(batched.m[i][j] - single[t].m[i][j]);
+					maxDifference = difference > maxDifference ? difference : maxDifference;
+				}
+			}
+		}
+
+		std::string name = shape == 0 ?
+			std::to_string(transformCount / depth) + " x " + std::to_string(depth) + " deep" :
+			"1 x " + std::to_string(transformCount - 1) + " wide";
+		char buf[160];
+		snprintf(buf, sizeof(buf), "%-22s %18.3f %12.3f %15g\n",
+			name.c_str(), singleTime / UpdateFrames, batchTime / UpdateFrames, maxDifference);
+		report += buf;
+	}
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Times moving, rotating and then rebuilding the world matrix of each
+/// transform, against the same steps on Euler angles
+/// </summary>
+/// <param name="transformCount">Number of transforms to update</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::TransformOperations(unsigned int transformCount)
+{
+	using namespace DirectX;
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::vector<Transform> transforms(transformCount);
+	std::vector<EulerTransform> eulers(transformCount);
+	for (unsigned int t = 0; t < transformCount; t++)
+	{
+		XMFLOAT3 pitchYawRoll(angle(rng) * 0.5f, angle(rng), 0.0f);
+		transforms[t].SetRotation(pitchYawRoll);
+		eulers[t].pitchYawRoll = pitchYawRoll;
+	}
+
+	// Each step over every transform, a frame at a time
+	double times[2][3] = {};
+	for (int frame = 0; frame < UpdateFrames; frame++)
+	{
+		Clock::time_point start = Clock::now();
+		for (EulerTransform& euler : eulers)
+			euler.MoveRelative(0.0f, 0.0f, 0.01f);
+		times[0][0] += MillisecondsSince(start);
+		start = Clock::now();
+		for (EulerTransform& euler : eulers)
+			euler.Rotate(0.0f, 0.001f, 0.0f);
+		times[0][1] += MillisecondsSince(start);
+		start = Clock::now();
+		for (EulerTransform& euler : eulers)
+			euler.GetWorldMatrix();
+		times[0][2] += MillisecondsSince(start);
+
+		start = Clock::now();
+		for (Transform& transform : transforms)
+			transform.MoveRelative(0.0f, 0.0f, 0.01f);
+		times[1][0] += MillisecondsSince(start);
+		start = Clock::now();
+		for (Transform& transform : transforms)
+			transform.Rotate(0.0f, 0.001f, 0.0f);
+		times[1][1] += MillisecondsSince(start);
+		start = Clock::now();
+		for (Transform& transform : transforms)
+			transform.GetWorldMatrix();
+		times[1][2] += MillisecondsSince(start);
+	}
+
+	// Both should have ended up in the same place
+	float maxDifference = 0.0f;
+	for (unsigned int t = 0; t < transformCount; t++)
+	{
+		XMFLOAT4X4 a = transforms[t].GetWorldMatrix();
+		XMFLOAT4X4 b = eulers[t].GetWorldMatrix();
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				float difference = fabsf(a.m[i][j] - b.m[i][j]);
+				maxDifference = difference > maxDifference ? difference : maxDifference;
+			}
+		}
+	}
+
+	std::string report = "Transform operations, " + std::to_string(transformCount) + " transforms, ns per call\n"
+		"rotation    move  rotate  world matrix\n";
+	const char* names[] = { "Euler", "Quaternion" };
+	double toNanoseconds = 1000000.0 / ((double)UpdateFrames * transformCount);
+	for (int r = 0; r < 2; r++)
+	{
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%-10s %5.1f %7.1f %13.1f\n",
+			names[r], times[r][0] * toNanoseconds, times[r][1] * toNanoseconds, times[r][2] * toNanoseconds);
+		report += buf;
+	}
+	char buf[64];
+	snprintf(buf, sizeof(buf), "Max difference: %g\n", maxDifference);
+	report += buf;
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Works out the inverse transpose of every world matrix with a full 4x4
+/// inverse, the way it used to be done each time a transform moved, and
+/// through the transform store's cofactor and uniform scale paths. Also
+/// reports the per object constant data each draw uploads with and
+/// without WORLD_MATRIX_3X4.
+/// </summary>
+/// <param name="transformCount">Number of transforms to invert</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::NormalMatrices(unsigned int transformCount)
+{
+	using namespace DirectX;
+	const char* names[] = { "Non-uniform", "Uniform" };
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> position(-256.0f, 256.0f);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+	std::string report = "Normal matrices, " + std::to_string(transformCount) + " transforms, ns per matrix\n"
+		"scale        full inverse  store  speedup  max difference\n";
+	for (int uniform = 0; uniform < 2; uniform++)
+	{
+		std::vector<Transform> transforms(transformCount);
+		std::vector<XMFLOAT3> positions(transformCount);
+		for (unsigned int t = 0; t < transformCount; t++)
+		{
+			positions[t] = XMFLOAT3(position(rng), position(rng), position(rng));
+			transforms[t].SetPosition(positions[t]);
+			transforms[t].SetRotation(angle(rng), angle(rng), angle(rng));
+			float s = scale(rng);
+			if (uniform)
+				transforms[t].SetScale(s);
+			else
+				transforms[t].SetScale(s, scale(rng), scale(rng));
+		}
+
+		std::vector<XMFLOAT4X4> worlds(transformCount);
+		std::vector<XMFLOAT4X4> full(transformCount);
+		std::vector<XMFLOAT4X4> stored(transformCount);
+		double fullTime = 0.0;
+		double storeTime = 0.0;
+		for (int frame = 0; frame < UpdateFrames; frame++)
+		{
+			// Every world matrix is rebuilt, so every inverse transpose is out of date
+			for (unsigned int t = 0; t < transformCount; t++)
+				transforms[t].SetPosition(positions[t]);
+			TransformStore::GetInstance().UpdateWorldMatrices();
+			for (unsigned int t = 0; t < transformCount; t++)
+				worlds[t] = transforms[t].GetWorldMatrix();
+
+			Clock::time_point start = Clock::now();
+			for (unsigned int t = 0; t < transformCount; t++)
+			{
+				XMMATRIX wm = XMLoadFloat4x4(&worlds[t]);
+				XMStoreFloat4x4(&full[t], XMMatrixInverse(0, XMMatrixTranspose(wm)));
+			}
+			fullTime += MillisecondsSince(start);
+
+			start = Clock::now();
+			for (unsigned int t = 0; t < transformCount; t++)
+				stored[t] = transforms[t].GetWorldInverseTransposeMatrix();
+			storeTime += MillisecondsSince(start);
+		}
+
+		float maxDifference = 0.0f;
+		for (unsigned int t = 0; t < transformCount; t++)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				for (int j = 0; j < 4; j++)
+				{
+					float difference = fabsf(full[t].m[i][j] - stored[t].m[i][j]);
+					maxDifference = difference > maxDifference ? difference : maxDifference;
+				}
+			}
+		}
+
+		double toNanoseconds = 1000000.0 / ((double)UpdateFrames * transformCount);
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%-12s %12.1f %6.1f %7.2fx %15g\n",
+			names[uniform], fullTime * toNanoseconds, storeTime * toNanoseconds,
+			fullTime / storeTime, maxDifference);
+		report += buf;
+	}
+
+	// Each draw reserves whole 256 byte chunks of the upload heap either way,
+	// but only copies and the shader only reads what's actually used
+	unsigned int fullBytes = (unsigned int)(2 * sizeof(XMFLOAT4X4));
+	unsigned int reducedBytes = (unsigned int)sizeof(XMFLOAT3X4);
+	char buf[192];
+	snprintf(buf, sizeof(buf),
+		"Per draw constants: %u bytes, %u with WORLD_MATRIX_3X4\n"
+		"Copied per frame at one draw each: %.1f MB less\n",
+		fullBytes, reducedBytes,
+		(double)(fullBytes - reducedBytes) * transformCount / (1024.0 * 1024.0));
+	report += buf;
+
+	printf("%s", report.c_str());
+	return report;
+}
+
+/// <summary>
+/// Recalculates the bounds of rotated and scaled entities by transforming
+/// eight corners each, with Arvo's method one entity at a time as GetAABB
+/// does, and with Arvo's method four entities at a time as the scene does
+/// </summary>
+/// <param name="entityCount">Number of entities to move</param>
+/// <returns>A printable report</returns>
+std::string Benchmark::EntityBounds(unsigned int entityCount)
+{
+	using namespace DirectX;
+	AABB bounds;
+	bounds.min = XMFLOAT3(-256, -256, -256);
+	bounds.max = XMFLOAT3(256, 256, 256);
+	std::vector<std::shared_ptr<Entity>> entities = CreateEntities(entityCount, bounds, 1234);
+
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> angle(-XM_PI, XM_PI);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	std::vector<XMFLOAT3> positions(entityCount);
+	std::vector<AABB> models(entityCount);
+	for (unsigned int e = 0; e < entityCount; e++)
+	{
+		std::shared_ptr<Transform> transform = entities[e]->GetTransform();
+		transform->SetRotation(angle(rng), angle(rng), angle(rng));
+		transform->SetScale(scale(rng), scale(rng), scale(rng));
+		positions[e] = transform->GetPosition();
+		models[e] = entities[e]->GetMeshes()[0]->GetAABB();
+	}
+
+	// Every entity moves every frame, world matrices are built before timing
+	std::vector<Entity*> moved(entityCount);
+	std::vector<AABB> corners(entityCount);
+	double times[3] = {};
+	for (int frame = 0; frame < UpdateFrames; frame++)
+	{
+		for (unsigned int e = 0; e < entityCount; e++)
+			entities[e]->GetTransform()->SetPosition(positions[e]);
+		TransformStore::GetInstance().UpdateWorldMatrices();
+
+		Clock::time_point start = Clock::now();
+		for (unsigned int e = 0; e < entityCount; e++)
+		{
+			XMFLOAT4X4 world = entities[e]->GetTransform()->GetWorldMatrix();
+			corners[e] = CornerAABB(models[e], XMLoadFloat4x4(&world));
+		}
+		times[0] += MillisecondsSince(start);
+
+		start = Clock::now();
+		for (unsigned int e = 0; e < entityCount; e++)
+			entities[e]->GetAABB();
+		times[1] += MillisecondsSince(start);
+
+		for (unsigned int e = 0; e < entityCount; e++)
+			entities[e]->SetTransformDirty();
+		start = Clock::now();
+		for (unsigned int e = 0; e < entityCount; e++)
+			moved[e] = entities[e].get();
+		Entity::UpdateAABBs(moved);
+		times[2] += MillisecondsSince(start);
+	}
+
+	// Arvo's bounds are exact, so all three should agree
+	float maxDifference = 0.0f;
+	for (unsigned int e = 0; e < entityCount; e++)
+	{
+		AABB batched = entities[e]->GetAABB();
+		float differences[6] = {
+			batched.min.x - corners[e].min.x, batched.min.y - corners[e].min.y, batched.min.z - corners[e].min.z,
+			batched.max.x - corners[e].max.x, batched.max.y - corners[e].max.y, batched.max.z - corners[e].max.z };
+		for (float difference : differences)
+			maxDifference = fabsf(difference) > maxDifference ? fabsf(difference) : maxDifference;
+	}
+
+	std::string report = "Entity bounds, " + std::to_string(entityCount) + " moved entities\n"
+		"method          ms per frame  ns per entity  speedup\n";
+	const char* names[] = { "Eight corners", "Arvo", "Arvo batched" };
+	for (int m = 0; m < 3; m++)
+	{
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%-15s %12.3f %14.1f %7.2fx\n",
+			names[m], times[m] / UpdateFrames,
+			times[m] * 1000000.0 / ((double)UpdateFrames * entityCount), times[0] / times[m]);
+		report += buf;
+	}
+	char buf[64];
+	snprintf(buf, sizeof(buf), "Max difference: %g\n", maxDifference);
+	report += buf;
+
+	printf("%s", report.c_str());
+	return report;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Collision.h"
+
+/// <summary>
+/// In-engine benchmarks for the scene's spatial structures.
+/// Each function prints its report to the console and returns it for display.
+/// </summary>
+namespace Benchmark
+{
+	std::string OctreeStorage(Frustum& frustum, unsigned int entityCount = 100000);
+	std::string OctreeQuery(Frustum& frustum);
+	std::string OctreeUpdate(unsigned int movedCount = 5);
+	std::string SpawnDespawn(unsigned int churnCount = 10000, unsigned int entityCount = 100000);
+	std::string RootGrowth(Frustum& frustum, unsigned int entityCount = 100000);
+	std::string Raycast(unsigned int entityCount = 100000, unsigned int rayCount = 1000);
+	std::string RangeQueries();
+	std::string Broadphase(unsigned int entityCount = 50000);
+	std::string BroadphaseComparison(unsigned int entityCount = 32768);
+	std::string SpatialIndexCulling(Frustum& frustum, unsigned int entityCount = 100000);
+	std::string DynamicEntities(Frustum& frustum, unsigned int staticCount = 100000, unsigned int dynamicCount = 10000);
+	std::string GridQueries(unsigned int entityCount = 10000, unsigned int queryCount = 1000);
+	std::string FrustumCulling(Frustum& frustum,
+		DirectX::XMFLOAT4X4 view,
+		DirectX::XMFLOAT4X4 projection,
+		unsigned int entityCount = 100000);
+	std::string FrustumExtraction();
+	std::string TemporalCulling(std::vector<DirectX::XMFLOAT4X4>& recordedPath, unsigned int entityCount = 100000);
+	std::string ContributionCulling(unsigned int entityCount = 100000);
+	std::string FrustumTests(Frustum& frustum, unsigned int boxCount = 100000);
+	std::string CullingKernels(Frustum& frustum,
+		DirectX::XMFLOAT4X4 view,
+		DirectX::XMFLOAT4X4 projection);
+	std::string ParallelBuild(unsigned int entityCount = 200000);
+	std::string MortonBuild(unsigned int entityCount = 200000);
+	std::string TransformUpdate(unsigned int transformCount = 100000);
+	std::string TransformHierarchy(unsigned int depth = 1000, unsigned int transformCount = 100000);
+	std::string TransformOperations(unsigned int transformCount = 100000);
+	std::string NormalMatrices(unsigned int transformCount = 100000);
+	std::string EntityBounds(unsigned int entityCount = 100000);
+}
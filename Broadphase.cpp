@@ -0,0 +1,181 @@
+#include "Broadphase.h"
+
+#include <algorithm>
+
+namespace
+{
+    float Component(const DirectX::XMFLOAT3& v, int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Octree
+///////////////////////////////////////////////////////////////////////////////
+
+OctreeBroadphase::OctreeBroadphase(std::shared_ptr<Octree::Node> _octree)
+    : octree(_octree) {}
+
+void OctreeBroadphase::AddEntity(std::shared_ptr<Entity> entity) {}
+void OctreeBroadphase::RemoveEntity(Entity* entity) {}
+
+/// <summary>
+/// Relocates the moved entities in the octree, finding their pairs as it goes
+/// </summary>
+void OctreeBroadphase::Update(std::vector<Octree::EntityPair>& movedPairs)
+{
+    octree->Update(movedPairs);
+}
+
+void OctreeBroadphase::GetAllPairs(std::vector<Octree::EntityPair>& out)
+{
+    octree->GetCollisionPairs(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sweep and prune
+///////////////////////////////////////////////////////////////////////////////
+
+SweepAndPrune::SweepAndPrune() : axis(0) {}
+SweepAndPrune::SweepAndPrune(std::vector<std::shared_ptr<Entity>>& entities) : axis(0)
+{
+    proxies.reserve(entities.size());
+    for (std::shared_ptr<Entity>& entityPtr : entities)
+        proxies.push_back({ entityPtr->GetAABB(), entityPtr.get(), false });
+
+    // Nothing is sorted yet, so skip the insertion sort
+    std::sort(proxies.begin(), proxies.end(), [](const Proxy& a, const Proxy& b)
+        { return a.box.min.x < b.box.min.x; });
+}
+
+/// <summary>
+/// Adds an entity at the end of the list, the next update's insertion
+/// sort moves it into place
+/// </summary>
+void SweepAndPrune::AddEntity(std::shared_ptr<Entity> entity)
+{
+    proxies.push_back({ entity->GetAABB(), entity.get(), false });
+}
+
+/// <summary>
+/// Removes an entity in linear time, keeping the others in order
+/// </summary>
+void SweepAndPrune::RemoveEntity(Entity* entity)
+{
+    for (size_t i = 0; i < proxies.size(); i++)
+    {
+        if (proxies[i].entity == entity)
+        {
+            proxies.erase(proxies.begin() + i);
+            return;
+        }
+    }
+}
+
+int SweepAndPrune::GetAxis() { return axis; }
+
+/// <summary>
+/// Re-sorts the moved entities' bounds and finds their pairs
+/// </summary>
+void SweepAndPrune::Update(std::vector<Octree::EntityPair>& movedPairs)
+{
+    movedPairs.clear();
+    RefreshBoxes();
+    Sort();
+    Sweep(true, movedPairs);
+}
+
+void SweepAndPrune::GetAllPairs(std::vector<Octree::EntityPair>& out)
+{
+    out.clear();
+    RefreshBoxes();
+    Sort();
+    Sweep(false, out);
+}
+
+void SweepAndPrune::RefreshBoxes()
+{
+    for (Proxy& proxy : proxies)
+    {
+        proxy.moved = proxy.entity->hasMoved;
+        if (proxy.moved)
+            proxy.box = proxy.entity->GetAABB();
+    }
+}
+
+/// <summary>
+/// Insertion sort by the boxes' minimum along the sweep axis.
+/// Entities only move a little between frames, so each box
+/// shifts a few places at most.
+/// </summary>
+void SweepAndPrune::Sort()
+{
+    for (size_t i = 1; i < proxies.size(); i++)
+    {
+        Proxy proxy = proxies[i];
+        float key = Component(proxy.box.min, axis);
+        size_t j = i;
+        while (j > 0 && Component(proxies[j - 1].box.min, axis) > key)
+        {
+            proxies[j] = proxies[j - 1];
+            j--;
+        }
+        proxies[j] = proxy;
+    }
+}
+
+/// <summary>
+/// Tests each box against the boxes that start before it ends along
+/// the sweep axis. Also measures the variance of the box centers, and
+/// switches to the axis with the most for the next sweep.
+/// </summary>
+/// <param name="movedOnly">Whether to skip pairs where neither entity moved</param>
+void SweepAndPrune::Sweep(bool movedOnly, std::vector<Octree::EntityPair>& out)
+{
+    if (proxies.empty())
+        return;
+
+    double sum[3] = { 0.0, 0.0, 0.0 };
+    double sumSquared[3] = { 0.0, 0.0, 0.0 };
+    for (size_t i = 0; i < proxies.size(); i++)
+    {
+        Proxy& proxy = proxies[i];
+        for (int a = 0; a < 3; a++)
+        {
+            double center = (Component(proxy.box.min, a) + Component(proxy.box.max, a)) * 0.5;
+            sum[a] += center;
+            sumSquared[a] += center * center;
+        }
+
+        // Sorted by minimum, so once a box starts past this one's end so do the rest
+        float end = Component(proxy.box.max, axis);
+        for (size_t j = i + 1; j < proxies.size() && Component(proxies[j].box.min, axis) < end; j++)
+        {
+            if (movedOnly && !proxy.moved && !proxies[j].moved)
+                continue;
+            if (proxy.box.Overlaps(proxies[j].box))
+                out.push_back({ proxy.entity, proxies[j].entity });
+        }
+    }
+
+    double variance[3];
+    int bestAxis = 0;
+    double count = (double)proxies.size();
+    for (int a = 0; a < 3; a++)
+    {
+        double mean = sum[a] / count;
+        variance[a] = sumSquared[a] / count - mean * mean;
+        if (variance[a] > variance[bestAxis])
+            bestAxis = a;
+    }
+
+    // A new axis scrambles the order, too much for an insertion sort,
+    // so only switch when it's clearly better
+    if (bestAxis != axis && variance[bestAxis] > variance[axis] * AXIS_SWITCH_RATIO)
+    {
+        axis = bestAxis;
+        std::sort(proxies.begin(), proxies.end(), [this](const Proxy& a, const Proxy& b)
+            { return Component(a.box.min, axis) < Component(b.box.min, axis); });
+    }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#define AXIS_SWITCH_RATIO 1.25f // Variance a new sweep axis needs over the current one
+
+#include <memory>
+#include <vector>
+#include "Octree.h"
+
+// Broadphases a scene can find its colliding entities with
+enum class BroadphaseType
+{
+	Octree,
+	SweepAndPrune
+};
+
+/// <summary>
+/// Finds the pairs of entities whose bounds overlap.
+/// Each update reports the pairs where at least one entity moved since
+/// the last update, using Entity::hasMoved, so it has to run before
+/// the scene's octree clears those flags.
+/// </summary>
+class Broadphase
+{
+public:
+	virtual ~Broadphase() {}
+
+	// Modifiers
+	virtual void AddEntity(std::shared_ptr<Entity> entity) = 0;
+	virtual void RemoveEntity(Entity* entity) = 0;
+
+	// Functions
+	virtual void Update(std::vector<Octree::EntityPair>& movedPairs) = 0;
+	virtual void GetAllPairs(std::vector<Octree::EntityPair>& out) = 0;
+};
+
+/// <summary>
+/// Finds pairs with the scene's octree while it relocates moved entities.
+/// The scene adds and removes entities from the octree itself.
+/// </summary>
+class OctreeBroadphase : public Broadphase
+{
+public:
+	OctreeBroadphase(std::shared_ptr<Octree::Node> _octree);
+
+	// Modifiers
+	void AddEntity(std::shared_ptr<Entity> entity) override;
+	void RemoveEntity(Entity* entity) override;
+
+	// Functions
+	void Update(std::vector<Octree::EntityPair>& movedPairs) override;
+	void GetAllPairs(std::vector<Octree::EntityPair>& out) override;
+
+private:
+	std::shared_ptr<Octree::Node> octree;
+};
+
+/// <summary>
+/// Sort and sweep over one axis of the entities' bounds.
+/// Boxes stay sorted by their minimum between frames, so an insertion
+/// sort restores the order in close to linear time when entities move
+/// a little each frame. The sweep axis is the one the box centers vary
+/// the most along, measured during each sweep.
+/// Suits dense scenes where most entities move, which would keep an
+/// octree relocating every frame.
+/// </summary>
+class SweepAndPrune : public Broadphase
+{
+public:
+	SweepAndPrune();
+	SweepAndPrune(std::vector<std::shared_ptr<Entity>>& entities);
+
+	// Modifiers
+	void AddEntity(std::shared_ptr<Entity> entity) override;
+	void RemoveEntity(Entity* entity) override;
+
+	// Getters
+	int GetAxis();
+
+	// Functions
+	void Update(std::vector<Octree::EntityPair>& movedPairs) override;
+	void GetAllPairs(std::vector<Octree::EntityPair>& out) override;
+
+private:
+	// An entity and copies of its bounds and hasMoved, so sorting
+	// and sweeping don't go through the entity
+	struct Proxy
+	{
+		AABB box;
+		Entity* entity;
+		bool moved;
+	};
+
+	std::vector<Proxy> proxies;
+	int axis; // 0 = x, 1 = y, 2 = z
+
+	// Helpers
+	void RefreshBoxes();
+	void Sort();
+	void Sweep(bool movedOnly, std::vector<Octree::EntityPair>& out);
+};
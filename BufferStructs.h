@@ -5,6 +5,10 @@
 #define MAX_LIGHTS 128
 #define MAX_SHADOWLIGHTS 5
 
+// Uncomment to send only a 3x4 world matrix per object and have the vertex
+// shader make the normal matrix. Must match the definition in ShaderIncludes.hlsli
+//#define WORLD_MATRIX_3X4
+
 // These should also match lights in shaders
 #define LIGHT_TYPE_DIRECTIONAL	0
 #define LIGHT_TYPE_POINT		1
@@ -44,8 +48,12 @@ struct VSPerFrameData
 
 struct VSPerObjectData
 {
+#ifdef WORLD_MATRIX_3X4
+	DirectX::XMFLOAT3X4 world;	// Transposed, the last column is always (0, 0, 0, 1)
+#else
 	DirectX::XMFLOAT4X4 world;
 	DirectX::XMFLOAT4X4 worldInvTranspose;
+#endif
 };
 
 struct VSEmitterPerFrameData
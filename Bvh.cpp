@@ -0,0 +1,381 @@
+#include "Bvh.h"
+
+#include <algorithm>
+
+namespace
+{
+    AABB EmptyAABB()
+    {
+        AABB out;
+        out.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+        out.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        return out;
+    }
+
+    void GrowToContain(AABB& bounds, const AABB& box)
+    {
+        bounds.min.x = bounds.min.x < box.min.x ? bounds.min.x : box.min.x;
+        bounds.min.y = bounds.min.y < box.min.y ? bounds.min.y : box.min.y;
+        bounds.min.z = bounds.min.z < box.min.z ? bounds.min.z : box.min.z;
+        bounds.max.x = bounds.max.x > box.max.x ? bounds.max.x : box.max.x;
+        bounds.max.y = bounds.max.y > box.max.y ? bounds.max.y : box.max.y;
+        bounds.max.z = bounds.max.z > box.max.z ? bounds.max.z : box.max.z;
+    }
+
+    void GrowToContain(AABB& bounds, const DirectX::XMFLOAT3& point)
+    {
+        bounds.min.x = bounds.min.x < point.x ? bounds.min.x : point.x;
+        bounds.min.y = bounds.min.y < point.y ? bounds.min.y : point.y;
+        bounds.min.z = bounds.min.z < point.z ? bounds.min.z : point.z;
+        bounds.max.x = bounds.max.x > point.x ? bounds.max.x : point.x;
+        bounds.max.y = bounds.max.y > point.y ? bounds.max.y : point.y;
+        bounds.max.z = bounds.max.z > point.z ? bounds.max.z : point.z;
+    }
+
+    // Half the surface area, the constant doesn't change which split is cheapest
+    float HalfArea(const AABB& box)
+    {
+        if (box.max.x < box.min.x)
+            return 0.0f; // Empty
+        float x = box.max.x - box.min.x;
+        float y = box.max.y - box.min.y;
+        float z = box.max.z - box.min.z;
+        return x * y + y * z + z * x;
+    }
+
+    float Component(const DirectX::XMFLOAT3& v, int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors
+///////////////////////////////////////////////////////////////////////////////
+
+Bvh::Bvh() : dirty(false), depth(0) {}
+Bvh::Bvh(std::vector<std::shared_ptr<Entity>>& _entities)
+    : entities(_entities), dirty(false), depth(0)
+{
+    Build();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Modifiers
+///////////////////////////////////////////////////////////////////////////////
+
+void Bvh::AddEntity(std::shared_ptr<Entity> entity)
+{
+    entities.push_back(entity);
+    dirty = true;
+}
+
+/// <summary>
+/// Removes an entity in linear time, the tree is rebuilt on the next update.
+/// The slot is left empty until then, so the nodes' entity runs stay valid
+/// and culls skip it.
+/// </summary>
+void Bvh::RemoveEntity(Entity* entity)
+{
+    for (size_t i = 0; i < entities.size(); i++)
+    {
+        if (entities[i].get() == entity)
+        {
+            entities[i] = nullptr;
+            dirty = true;
+            return;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Getters
+///////////////////////////////////////////////////////////////////////////////
+
+void Bvh::GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    if (!nodes.empty())
+        CullNode(0, frustum, out, ALL_PLANES, true);
+}
+
+void Bvh::GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    if (!nodes.empty())
+        CullNode(0, frustum, out, ALL_PLANES, false);
+}
+
+unsigned int Bvh::GetNodeCount() { return (unsigned int)nodes.size(); }
+unsigned int Bvh::GetDepth() { return depth; }
+
+///////////////////////////////////////////////////////////////////////////////
+// Functions
+///////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Builds the tree from scratch, reordering the entities so each
+/// node's entities are contiguous
+/// </summary>
+void Bvh::Build()
+{
+    nodes.clear();
+    boxes.clear();
+    cullBounds.Clear();
+    dirty = false;
+    depth = 0;
+
+    // Drop the slots left by removed entities
+    entities.erase(std::remove(entities.begin(), entities.end(), nullptr), entities.end());
+    if (entities.empty())
+        return;
+
+    std::vector<BuildItem> items(entities.size());
+    for (unsigned int i = 0; i < entities.size(); i++)
+    {
+        items[i].box = entities[i]->GetAABB();
+        items[i].center = items[i].box.Center();
+        items[i].entity = i;
+    }
+
+    // A binary tree with leaves of at least one entity has fewer than 2n nodes
+    nodes.reserve(entities.size() * 2);
+    nodes.push_back({ EmptyAABB(), 0, (unsigned int)entities.size(), 0 });
+    BuildNode(0, items, 1, depth);
+
+    // Put the entities in leaf order
+    std::vector<std::shared_ptr<Entity>> ordered(entities.size());
+    boxes.resize(entities.size());
+    cullBounds.Resize(entities.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        ordered[i] = entities[items[i].entity];
+        boxes[i] = items[i].box;
+        cullBounds.Set(i, boxes[i]);
+    }
+    entities.swap(ordered);
+}
+
+/// <summary>
+/// Refreshes the bounds of moved entities and every node above them,
+/// keeping the tree's shape. Children are always stored after their
+/// parent, so one backwards pass refits every node.
+/// </summary>
+void Bvh::Refit()
+{
+    bool anyMoved = false;
+    for (size_t i = 0; i < entities.size(); i++)
+    {
+        if (entities[i] != nullptr && entities[i]->hasMoved)
+        {
+            boxes[i] = entities[i]->GetAABB();
+            cullBounds.Set(i, boxes[i]);
+            anyMoved = true;
+        }
+    }
+    if (!anyMoved)
+        return;
+
+    for (size_t n = nodes.size(); n-- > 0;)
+    {
+        Node& node = nodes[n];
+        if (node.left == 0)
+        {
+            node.bounds = EmptyAABB();
+            for (unsigned int i = node.firstEntity; i < node.firstEntity + node.entityCount; i++)
+                GrowToContain(node.bounds, boxes[i]);
+        }
+        else
+        {
+            node.bounds = nodes[node.left].bounds;
+            GrowToContain(node.bounds, nodes[node.left + 1].bounds);
+        }
+    }
+}
+
+/// <summary>
+/// Rebuilds the tree if entities were added or removed, otherwise refits it
+/// </summary>
+void Bvh::Update()
+{
+    if (dirty)
+        Build();
+    else
+        Refit();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Splits a node where the surface area heuristic says a ray or frustum
+/// is cheapest to test, or keeps it as a leaf if no split beats testing
+/// every entity. Candidate splits are the boundaries between bins of
+/// entity centers along each axis.
+/// </summary>
+/// <param name="node">Node to split, its entity range is already set</param>
+/// <param name="items">Build items, the node's range is partitioned in place</param>
+/// <param name="level">Depth of this node, the root is 1</param>
+/// <param name="maxLevel">Deepest node so far</param>
+void Bvh::BuildNode(unsigned int node, std::vector<BuildItem>& items, unsigned int level, unsigned int& maxLevel)
+{
+    maxLevel = level > maxLevel ? level : maxLevel;
+    unsigned int first = nodes[node].firstEntity;
+    unsigned int count = nodes[node].entityCount;
+
+    AABB bounds = EmptyAABB();
+    AABB centerBounds = EmptyAABB();
+    for (unsigned int i = first; i < first + count; i++)
+    {
+        GrowToContain(bounds, items[i].box);
+        GrowToContain(centerBounds, items[i].center);
+    }
+    nodes[node].bounds = bounds;
+    if (count < BVH_MIN_LEAF_SIZE)
+        return;
+
+    // Find the cheapest split
+    float bestCost = FLT_MAX;
+    int bestAxis = -1;
+    int bestBin = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float minCenter = Component(centerBounds.min, axis);
+        float extent = Component(centerBounds.max, axis) - minCenter;
+        if (extent <= 0.0f)
+            continue;
+
+        // Fill the bins
+        AABB binBounds[BVH_BIN_COUNT];
+        unsigned int binCounts[BVH_BIN_COUNT] = {};
+        for (int b = 0; b < BVH_BIN_COUNT; b++)
+            binBounds[b] = EmptyAABB();
+        float scale = BVH_BIN_COUNT / extent;
+        for (unsigned int i = first; i < first + count; i++)
+        {
+            int b = (int)((Component(items[i].center, axis) - minCenter) * scale);
+            b = b < BVH_BIN_COUNT - 1 ? b : BVH_BIN_COUNT - 1;
+            binCounts[b]++;
+            GrowToContain(binBounds[b], items[i].box);
+        }
+
+        // Sweep from the right, then from the left, to cost each boundary
+        float rightArea[BVH_BIN_COUNT - 1];
+        unsigned int rightCount[BVH_BIN_COUNT - 1];
+        AABB accumulated = EmptyAABB();
+        unsigned int accumulatedCount = 0;
+        for (int b = BVH_BIN_COUNT - 1; b > 0; b--)
+        {
+            GrowToContain(accumulated, binBounds[b]);
+            accumulatedCount += binCounts[b];
+            rightArea[b - 1] = HalfArea(accumulated);
+            rightCount[b - 1] = accumulatedCount;
+        }
+        accumulated = EmptyAABB();
+        accumulatedCount = 0;
+        for (int b = 0; b < BVH_BIN_COUNT - 1; b++)
+        {
+            GrowToContain(accumulated, binBounds[b]);
+            accumulatedCount += binCounts[b];
+            if (accumulatedCount == 0 || rightCount[b] == 0)
+                continue;
+
+            float cost = HalfArea(accumulated) * accumulatedCount + rightArea[b] * rightCount[b];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    // Compare against keeping every entity here
+    float area = HalfArea(bounds);
+    float leafCost = (float)count;
+    float splitCost = area > 0.0f ? BVH_TRAVERSAL_COST + bestCost / area : FLT_MAX;
+    if (count <= BVH_MAX_LEAF_SIZE && (bestAxis == -1 || leafCost <= splitCost))
+        return;
+
+    // Partition the range around the split
+    unsigned int middle;
+    if (bestAxis == -1)
+    {
+        // Every center is the same point, any split is as good as another
+        middle = first + count / 2;
+    }
+    else
+    {
+        float minCenter = Component(centerBounds.min, bestAxis);
+        float scale = BVH_BIN_COUNT / (Component(centerBounds.max, bestAxis) - minCenter);
+        BuildItem* split = std::partition(items.data() + first, items.data() + first + count,
+            [=](const BuildItem& item)
+            {
+                int b = (int)((Component(item.center, bestAxis) - minCenter) * scale);
+                b = b < BVH_BIN_COUNT - 1 ? b : BVH_BIN_COUNT - 1;
+                return b <= bestBin;
+            });
+        middle = (unsigned int)(split - items.data());
+    }
+
+    // Children are allocated together, after their parent
+    unsigned int left = (unsigned int)nodes.size();
+    nodes[node].left = left;
+    nodes.push_back({ EmptyAABB(), first, middle - first, 0 });
+    nodes.push_back({ EmptyAABB(), middle, first + count - middle, 0 });
+    BuildNode(left, items, level + 1, maxLevel);
+    BuildNode(left + 1, items, level + 1, maxLevel);
+}
+
+/// <summary>
+/// Frustum traversal that remembers which planes this node is fully inside of,
+/// so children only test the planes their parent straddled
+/// </summary>
+/// <param name="planeMask">Bit i set if plane i still needs testing</param>
+/// <param name="testEntities">Whether to test entities in straddling leaves</param>
+void Bvh::CullNode(unsigned int node, Frustum& frustum, std::vector<Entity*>& out,
+    unsigned char planeMask, bool testEntities)
+{
+    Node& current = nodes[node];
+    for (int i = 0; i < 6; i++)
+    {
+        if (!(planeMask & (1 << i)))
+            continue;
+
+        PlaneSide side = current.bounds.ClassifyPlane(frustum.normals[i]);
+        if (side == PlaneSide::Outside)
+            return;
+        if (side == PlaneSide::Inside)
+            planeMask &= ~(1 << i);
+    }
+
+    unsigned int first = current.firstEntity;
+    unsigned int last = first + current.entityCount;
+    if (planeMask == 0 || (current.left == 0 && !testEntities))
+    {
+        // Fully inside, or not testing entities, take the whole run
+        for (unsigned int i = first; i < last; i++)
+        {
+            if (entities[i] != nullptr)
+                out.push_back(entities[i].get());
+        }
+        return;
+    }
+
+    if (current.left == 0)
+    {
+        // Test entities against the planes this leaf straddles.
+        // Leaves never hold more than BVH_MAX_LEAF_SIZE entities.
+        unsigned int visible[BVH_MAX_LEAF_SIZE];
+        unsigned int visibleCount = Culling::Cull(frustum, cullBounds, first, current.entityCount, planeMask, visible);
+        for (unsigned int v = 0; v < visibleCount; v++)
+        {
+            if (entities[visible[v]] != nullptr)
+                out.push_back(entities[visible[v]].get());
+        }
+        return;
+    }
+
+    unsigned int left = current.left;
+    CullNode(left, frustum, out, planeMask, testEntities);
+    CullNode(left + 1, frustum, out, planeMask, testEntities);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#define BVH_BIN_COUNT 16		// Buckets each axis is split into when searching for a split
+#define BVH_MIN_LEAF_SIZE 2		// Entities below which a node is never split
+#define BVH_MAX_LEAF_SIZE 16	// Entities above which a node is always split
+#define BVH_TRAVERSAL_COST 1.0f	// Cost of visiting a node, relative to testing one entity
+
+#include <vector>
+#include "SpatialIndex.h"
+#include "CullingKernel.h"
+
+/// <summary>
+/// A bounding volume hierarchy built with the binned surface area heuristic.
+/// Each node's bounds fit its entities exactly instead of being fixed
+/// octants, which suits static architecture of uneven sizes.
+/// Nodes live in one array with children allocated in pairs, and every
+/// node's entities are one contiguous run, so a node fully inside the
+/// frustum is copied out without visiting its children, and a leaf's
+/// entities are tested together by the SIMD culling kernel.
+/// Moving entities refit the bounds in place, while adding or removing
+/// entities rebuilds the tree on the next update.
+/// </summary>
+class Bvh : public SpatialIndex
+{
+public:
+	// Constructors
+	Bvh();
+	Bvh(std::vector<std::shared_ptr<Entity>>& _entities);
+
+	// Modifiers
+	void AddEntity(std::shared_ptr<Entity> entity) override;
+	void RemoveEntity(Entity* entity) override;
+
+	// Getters
+	void GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out) override;
+	void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out) override;
+	unsigned int GetNodeCount();
+	unsigned int GetDepth();
+
+	// Functions
+	void Build();
+	void Refit();
+	void Update() override;
+
+private:
+	struct Node
+	{
+		AABB bounds;
+		unsigned int firstEntity;	// Start of this subtree's entities
+		unsigned int entityCount;
+		unsigned int left;			// Right child is left + 1, 0 for leaves
+	};
+
+	// An entity while building, with the bounds and center used to bin it
+	struct BuildItem
+	{
+		AABB box;
+		DirectX::XMFLOAT3 center;
+		unsigned int entity;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<std::shared_ptr<Entity>> entities;
+	std::vector<AABB> boxes;	// Entity bounds, in the same order as entities
+	Culling::BoundsSoA cullBounds;	// The same bounds as center and extent arrays
+	bool dirty;					// Entities were added or removed since the last build
+	unsigned int depth;
+
+	// Helpers
+	void BuildNode(unsigned int node, std::vector<BuildItem>& items, unsigned int level, unsigned int& maxLevel);
+	void CullNode(unsigned int node, Frustum& frustum, std::vector<Entity*>& out,
+		unsigned char planeMask, bool testEntities);
+};
@@ -24,7 +24,8 @@ Camera::Camera(
 	farClip(farClip),
 	projectionType(projType),
 	orthographicWidth(2.0f),
-	dirtyView(true)
+	dirtyView(true),
+	dirtyFrustum(true)
 {
 	transform.SetPosition(x, y, z);
 
@@ -49,7 +50,9 @@ Camera::Camera(
 	nearClip(nearClip),
 	farClip(farClip),
 	projectionType(projType),
-	dirtyView(true)
+	orthographicWidth(2.0f),
+	dirtyView(true),
+	dirtyFrustum(true)
 {
 	transform.SetPosition(position);
 
@@ -95,12 +98,9 @@ void Camera::Update(float dt)
 		transform.SetRotation(rot);
 	}
 
-	// Update the view when changed
+	// Update the view when changed, the frustum follows when it's next needed
 	if (dirtyView) 
-	{ 
 		UpdateViewMatrix(); 
-		UpdateFrustum();
-	}
 
 }
 
@@ -119,6 +119,7 @@ void Camera::UpdateViewMatrix()
 	XMStoreFloat4x4(&viewMatrix, view);
 
 	dirtyView = false;
+	dirtyFrustum = true;
 }
 
 // Updates the projection matrix
@@ -147,168 +148,20 @@ void Camera::UpdateProjectionMatrix(float aspectRatio)
 	}
 
 	XMStoreFloat4x4(&projMatrix, P);
+	dirtyFrustum = true;
 }
 
+// Rebuilds the frustum from the view and projection matrices,
+// so it follows orthographic projections and projection changes too
 void Camera::UpdateFrustum()
 {
-	// Get normals from ViewProjection Matrix
-	// Not Working
-	// https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
-	/*
-	{
-		DirectX::XMFLOAT4X4 viewTemp = GetView();
-		DirectX::XMFLOAT4X4 projTemp = GetProjection();
-		DirectX::XMFLOAT4X4 vp;
-		DirectX::XMStoreFloat4x4(&vp,
-			DirectX::XMMatrixMultiply(
-				DirectX::XMLoadFloat4x4(&projTemp),
-				DirectX::XMLoadFloat4x4(&viewTemp)
-			));
-
-		frustum.normals[0].x = vp._13;					// Near Face
-		frustum.normals[0].y = vp._23;
-		frustum.normals[0].z = vp._33;
-		frustum.normals[0].w = vp._43;
-
-		frustum.normals[1].x = vp._14 - vp._13;			// Far Face
-		frustum.normals[1].y = vp._24 - vp._23;
-		frustum.normals[1].z = vp._34 - vp._33;
-		frustum.normals[1].w = vp._44 - vp._43;
-
-		frustum.normals[2].x = vp._14 + vp._11;			// Left Face
-		frustum.normals[2].y = vp._24 + vp._21;			
-		frustum.normals[2].z = vp._34 + vp._31;
-		frustum.normals[2].w = vp._44 + vp._41;
-
-		frustum.normals[3].x = vp._14 - vp._11;			// Right Face
-		frustum.normals[3].y = vp._24 - vp._21;
-		frustum.normals[3].z = vp._34 - vp._31;
-		frustum.normals[3].w = vp._44 - vp._41;
-
-		frustum.normals[4].x = vp._14 + vp._12;			// Bottom Face
-		frustum.normals[4].y = vp._24 + vp._22;
-		frustum.normals[4].z = vp._34 + vp._32;
-		frustum.normals[4].w = vp._44 + vp._42;
-
-		frustum.normals[5].x = vp._14 - vp._12;			// Top Face
-		frustum.normals[5].y = vp._24 - vp._22;
-		frustum.normals[5].z = vp._34 - vp._32;
-		frustum.normals[5].z = vp._44 - vp._42;
-	}
-	*/
-	
-	// Variables
-	const float halfFarHeight = std::tan(fieldOfView * 0.5f) * farClip;
-	const float halfFarWidth = halfFarHeight * aspectRatio;
-	const float halfNearHeight = std::tan(fieldOfView * 0.5f) * nearClip;
-	const float halfNearWidth = halfNearHeight * aspectRatio;
-
-	DirectX::XMFLOAT3 fwdTemp = transform.GetForward();
-	DirectX::XMFLOAT3 upTemp = transform.GetUp();
-	DirectX::XMFLOAT3 rightTemp = transform.GetRight();
-	DirectX::XMVECTOR fwd = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&fwdTemp));
-	DirectX::XMVECTOR up = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&upTemp));
-	DirectX::XMVECTOR right = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&rightTemp));
-
-	DirectX::XMVECTOR frontMultFar = DirectX::XMVectorScale(fwd, farClip);
-	DirectX::XMVECTOR rightMultFarWidth = DirectX::XMVectorScale(right, halfFarWidth);
-	DirectX::XMVECTOR upMultFarHeight = DirectX::XMVectorScale(up, halfFarHeight);
-
-	DirectX::XMVECTOR frontMultNear = DirectX::XMVectorScale(fwd, nearClip);
-	DirectX::XMVECTOR rightMultNearWidth = DirectX::XMVectorScale(right, halfNearWidth);
-	DirectX::XMVECTOR upMultNearHeight = DirectX::XMVectorScale(up, halfNearHeight);
-
-	DirectX::XMFLOAT3 posTemp = transform.GetPosition();
-	DirectX::XMVECTOR pos = DirectX::XMLoadFloat3(&posTemp);
-	DirectX::XMVECTOR farCenter = DirectX::XMVectorAdd(frontMultFar, pos);
-	DirectX::XMVECTOR nearCenter = DirectX::XMVectorAdd(frontMultNear, pos);
-
-	// Points
-	{
-		DirectX::XMStoreFloat3(&frustum.points[0],		// Top Right Far
-			DirectX::XMVectorAdd(farCenter,
-				DirectX::XMVectorAdd(upMultFarHeight, rightMultFarWidth)
-			));
-		DirectX::XMStoreFloat3(&frustum.points[1],		// Bottom Left Far
-			DirectX::XMVectorSubtract(farCenter,
-				DirectX::XMVectorAdd(upMultFarHeight, rightMultFarWidth)
-			));
-		DirectX::XMStoreFloat3(&frustum.points[2],		// Top Left Far
-			DirectX::XMVectorAdd(farCenter,
-				DirectX::XMVectorSubtract(upMultFarHeight, rightMultFarWidth)
-			));
-		DirectX::XMStoreFloat3(&frustum.points[3],		// Bottom Right Far
-			DirectX::XMVectorSubtract(farCenter,
-				DirectX::XMVectorSubtract(upMultFarHeight, rightMultFarWidth)
-			));
-
-
-		DirectX::XMStoreFloat3(&frustum.points[4],		// Top Right Near
-			DirectX::XMVectorAdd(nearCenter,
-				DirectX::XMVectorAdd(upMultNearHeight, rightMultNearWidth)
-			));
-		DirectX::XMStoreFloat3(&frustum.points[5],		// Bottom Left Near
-			DirectX::XMVectorSubtract(nearCenter,
-				DirectX::XMVectorAdd(upMultNearHeight, rightMultNearWidth)
-			));
-		DirectX::XMStoreFloat3(&frustum.points[6],		// Top Left Near
-			DirectX::XMVectorAdd(nearCenter,
-				DirectX::XMVectorSubtract(upMultNearHeight, rightMultNearWidth)
-			));
-		DirectX::XMStoreFloat3(&frustum.points[7],		// Bottom Right Near
-			DirectX::XMVectorSubtract(nearCenter,
-				DirectX::XMVectorSubtract(upMultNearHeight, rightMultNearWidth)
-			));
-	}
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMMatrixMultiply(
+		XMLoadFloat4x4(&viewMatrix),
+		XMLoadFloat4x4(&projMatrix)));
+	frustum = Frustum::FromViewProjection(viewProjection);
 
-	// Calculate Normals
-	// https://learnopengl.com/Guest-Articles/2021/Scene/Frustum-Culling
-	{
-		frustum.normals[0] = DirectX::XMFLOAT4(		// Near Face
-			fwdTemp.x,
-			fwdTemp.y,
-			fwdTemp.z,
-			1.0
-		);
-		frustum.normals[0].w = CalcD(frustum.normals[0], frustum.points[4]);
-
-		frustum.normals[1] = DirectX::XMFLOAT4(		// Far Face
-			-fwdTemp.x,
-			-fwdTemp.y,
-			-fwdTemp.z,
-			1.0
-		);
-		frustum.normals[1].w = CalcD(frustum.normals[1], frustum.points[0]);
-
-		DirectX::XMStoreFloat4(&frustum.normals[2],		// Left Face
-			DirectX::XMVector3Cross(
-				up,
-				DirectX::XMVectorAdd(frontMultFar, rightMultFarWidth)
-			));
-		frustum.normals[2].w = CalcD(frustum.normals[2], frustum.points[1]);
-
-		DirectX::XMStoreFloat4(&frustum.normals[3],		// Right Face
-			DirectX::XMVector3Cross(
-				DirectX::XMVectorSubtract(frontMultFar, rightMultFarWidth),
-				up
-			));
-		frustum.normals[3].w = CalcD(frustum.normals[3], frustum.points[0]);
-
-		DirectX::XMStoreFloat4(&frustum.normals[4],		// Bottom Face
-			DirectX::XMVector3Cross(
-				DirectX::XMVectorAdd(frontMultFar, upMultFarHeight),
-				right
-			));
-		frustum.normals[4].w = CalcD(frustum.normals[4], frustum.points[1]);
-
-		DirectX::XMStoreFloat4(&frustum.normals[5],		// Top Face
-			DirectX::XMVector3Cross(
-				right,
-				DirectX::XMVectorSubtract(frontMultFar, upMultFarHeight)
-			));
-		frustum.normals[5].w = CalcD(frustum.normals[5], frustum.points[0]);
-	}
-	
+	dirtyFrustum = false;
 }
 
 DirectX::XMFLOAT4X4 Camera::GetView()
@@ -382,12 +235,12 @@ void Camera::SetProjectionType(CameraProjectionType type)
 Frustum Camera::GetFrustum() 
 { 
 	if (dirtyView)
-	{
 		UpdateViewMatrix();
+	if (dirtyFrustum)
 		UpdateFrustum();
-	}
 	return frustum; 
 }
+CullingCache* Camera::GetCullingCache() { return &cullingCache; }
 
 /*
 std::shared_ptr<Camera> Camera::Parse(nlohmann::json jsonCamera)
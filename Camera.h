@@ -4,6 +4,7 @@
 
 #include "Transform.h"
 #include "Collision.h"
+#include "CullingCache.h"
 #include "nlohmann/json.hpp"
 
 
@@ -72,6 +73,7 @@ public:
 	void SetProjectionType(CameraProjectionType type);
 
 	Frustum GetFrustum();
+	CullingCache* GetCullingCache();
 
 private:
 	// Camera matrices
@@ -89,9 +91,11 @@ private:
 	float farClip;
 	float orthographicWidth;
 	bool dirtyView;
+	bool dirtyFrustum;
 
 	CameraProjectionType projectionType;
 
 	Frustum frustum;
+	CullingCache cullingCache; // Last cull of this camera's frustum
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 #include <DirectXMath.h>
+#include <cfloat>
+#include <cmath>
 
 inline float Dot(DirectX::XMFLOAT3 vec1, DirectX::XMFLOAT3 vec2)
 {
@@ -32,6 +34,13 @@ inline float CalcD(DirectX::XMFLOAT4 vec1, DirectX::XMFLOAT3 vec2)
 		vec1.z * vec2.z;
 }
 
+// Where a box lies relative to a plane
+enum class PlaneSide {
+	Outside = 0,	// Fully behind the plane
+	Straddling = 1,	// Crosses the plane
+	Inside = 2		// Fully in front of the plane
+};
+
 struct Ray
 {
 	DirectX::XMFLOAT3 origin;
@@ -67,6 +76,15 @@ struct AABB
 		return sqDist;
 	}
 
+	// Returns the squared distance between a point p and the furthest corner of the box
+	float SqMaxDistPointAABB(DirectX::XMFLOAT3 p)
+	{
+		float dx = (p.x - this->min.x) > (this->max.x - p.x) ? (p.x - this->min.x) : (this->max.x - p.x);
+		float dy = (p.y - this->min.y) > (this->max.y - p.y) ? (p.y - this->min.y) : (this->max.y - p.y);
+		float dz = (p.z - this->min.z) > (this->max.z - p.z) ? (p.z - this->min.z) : (this->max.z - p.z);
+		return dx * dx + dy * dy + dz * dz;
+	}
+
 	bool Contains(DirectX::XMFLOAT3 point)
 	{
 		return
@@ -132,6 +150,29 @@ struct AABB
 		return sqDist <= radius * radius;
 	}
 
+	bool Intersects(AABB other)
+	{
+		return
+			this->min.x <= other.max.x &&
+			this->max.x >= other.min.x &&
+			this->min.y <= other.max.y &&
+			this->max.y >= other.min.y &&
+			this->min.z <= other.max.z &&
+			this->max.z >= other.min.z;
+	}
+
+	// Same as Intersects, but boxes that only touch don't count
+	bool Overlaps(AABB other)
+	{
+		return
+			this->min.x < other.max.x &&
+			this->max.x > other.min.x &&
+			this->min.y < other.max.y &&
+			this->max.y > other.min.y &&
+			this->min.z < other.max.z &&
+			this->max.z > other.min.z;
+	}
+
 	// https://gist.github.com/DomNomNom/46bb1ce47f68d255fd5d
 	bool Intersects(Ray other)
 	{
@@ -163,6 +204,35 @@ struct AABB
 		return tNear < tFar;
 	}
 
+	// Slab test that also reports the distances along the ray where it
+	// enters and leaves the box. Only counts the box in front of the
+	// origin, and tNear is 0 when the origin is inside the box.
+	bool Intersects(Ray other, float& tNear, float& tFar)
+	{
+		float invX = 1.0f / other.direction.x;
+		float invY = 1.0f / other.direction.y;
+		float invZ = 1.0f / other.direction.z;
+
+		float t1 = (min.x - other.origin.x) * invX;
+		float t2 = (max.x - other.origin.x) * invX;
+		tNear = t1 < t2 ? t1 : t2;
+		tFar = t1 > t2 ? t1 : t2;
+
+		t1 = (min.y - other.origin.y) * invY;
+		t2 = (max.y - other.origin.y) * invY;
+		tNear = tNear > (t1 < t2 ? t1 : t2) ? tNear : (t1 < t2 ? t1 : t2);
+		tFar = tFar < (t1 > t2 ? t1 : t2) ? tFar : (t1 > t2 ? t1 : t2);
+
+		t1 = (min.z - other.origin.z) * invZ;
+		t2 = (max.z - other.origin.z) * invZ;
+		tNear = tNear > (t1 < t2 ? t1 : t2) ? tNear : (t1 < t2 ? t1 : t2);
+		tFar = tFar < (t1 > t2 ? t1 : t2) ? tFar : (t1 > t2 ? t1 : t2);
+
+		if (tNear < 0.0f)
+			tNear = 0.0f;
+		return tNear <= tFar;
+	}
+
 	// https://gdbooks.gitbooks.io/3dcollisions/content/Chapter2/static_aabb_plane.html
 	bool IntersectsPlane(DirectX::XMFLOAT4 normal)
 	{
@@ -196,6 +266,29 @@ struct AABB
 		return dist > r;
 	}
 
+	// Same test as IntersectsPlane, but also reports when the
+	// box is entirely on the inside of the plane
+	PlaneSide ClassifyPlane(DirectX::XMFLOAT4 normal)
+	{
+		// Center-extents representation
+		float cx = (max.x + min.x) * 0.5f;
+		float cy = (max.y + min.y) * 0.5f;
+		float cz = (max.z + min.z) * 0.5f;
+		float ex = max.x - cx;
+		float ey = max.y - cy;
+		float ez = max.z - cz;
+
+		// Projection interval radius and distance of the center from the plane
+		float r = ex * std::abs(normal.x) + ey * std::abs(normal.y) + ez * std::abs(normal.z);
+		float dist = normal.x * cx + normal.y * cy + normal.z * cz - normal.w;
+
+		if (dist < -r)
+			return PlaneSide::Outside;
+		if (dist > r)
+			return PlaneSide::Inside;
+		return PlaneSide::Straddling;
+	}
+
 	DirectX::XMFLOAT3 Dimensions()
 	{
 		return DirectX::XMFLOAT3(
@@ -217,6 +310,14 @@ struct AABB
 
 // https://learnopengl.com/Guest-Articles/2021/Scene/Frustum-Culling
 // https://iquilezles.org/articles/frustumcorrect/
+// How precisely Frustum::Intersects tells a box apart from the frustum.
+// Each mode rejects every box the one before it does, and more.
+enum class FrustumTest {
+	Fast = 0,		// Box against each plane, misses boxes outside near the frustum's corners
+	Refined = 1,	// Also the frustum's corners against each face of the box
+	Exact = 2		// Separating axis test, only accepts boxes that really overlap
+};
+
 struct Frustum
 {
 	DirectX::XMFLOAT4 normals[6];
@@ -225,20 +326,81 @@ struct Frustum
 	// https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
 	float DistanceToPoint(DirectX::XMFLOAT4 plane, DirectX::XMFLOAT3 pt)
 	{
+		// Normals face into the frustum and w is the normal dotted with a
+		// point on the plane, the same convention as AABB::IntersectsPlane
 		//  0 ~ point on plane
 		// >0 ~ point in front of plane
 		// <0 ~ point behind plane
 		return 
 			plane.x * pt.x + 
 			plane.y * pt.y + 
-			plane.z * pt.z + 
+			plane.z * pt.z - 
 			plane.w;
 	}
 
-	bool Intersects(AABB other)
+	// Gribb-Hartmann plane extraction, for perspective and orthographic projections alike.
+	// Planes come out normalized, and the corners are the clip space
+	// volume's corners taken back to world space through the inverse.
+	// Reversed depth is detected, so near and far keep their places.
+	static Frustum FromViewProjection(DirectX::XMFLOAT4X4 viewProjection)
 	{
-		DirectX::XMFLOAT3 p = other.min;
+		DirectX::XMMATRIX vp = DirectX::XMLoadFloat4x4(&viewProjection);
+
+		// Rows of the transpose are the matrix's columns, a point is inside
+		// when its clip space x and y are within [-w, w] and z within [0, w]
+		DirectX::XMMATRIX columns = DirectX::XMMatrixTranspose(vp);
+
+		// Reversed depth puts the near plane at z = w and the far plane
+		// at z = 0, which mirrors clip space along z
+		bool reversedDepth = DirectX::XMVectorGetX(DirectX::XMVector3Dot(
+			DirectX::XMVector3Cross(columns.r[0], columns.r[1]), columns.r[2])) < 0.0f;
+		DirectX::XMVECTOR zeroDepth = columns.r[2];
+		DirectX::XMVECTOR fullDepth = DirectX::XMVectorSubtract(columns.r[3], columns.r[2]);
+		DirectX::XMVECTOR planes[6] = {
+			reversedDepth ? fullDepth : zeroDepth,						// Near
+			reversedDepth ? zeroDepth : fullDepth,						// Far
+			DirectX::XMVectorAdd(columns.r[3], columns.r[0]),			// Left
+			DirectX::XMVectorSubtract(columns.r[3], columns.r[0]),		// Right
+			DirectX::XMVectorAdd(columns.r[3], columns.r[1]),			// Bottom
+			DirectX::XMVectorSubtract(columns.r[3], columns.r[1])		// Top
+		};
+
+		// The columns give n.p + d >= 0, normals store n.p - w >= 0
+		Frustum frustum;
+		const DirectX::XMVECTOR flipW = DirectX::XMVectorSet(1.0f, 1.0f, 1.0f, -1.0f);
+		for (int i = 0; i < 6; i++)
+		{
+			DirectX::XMVECTOR plane = DirectX::XMVectorMultiply(planes[i], DirectX::XMVector3ReciprocalLength(planes[i]));
+			DirectX::XMStoreFloat4(&frustum.normals[i], DirectX::XMVectorMultiply(plane, flipW));
+		}
+
+		// Same order as the corners have always been stored in
+		static const DirectX::XMFLOAT3 clipCorners[8] = {
+			DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f),		// Top Right Far
+			DirectX::XMFLOAT3(-1.0f, -1.0f, 1.0f),		// Bottom Left Far
+			DirectX::XMFLOAT3(-1.0f, 1.0f, 1.0f),		// Top Left Far
+			DirectX::XMFLOAT3(1.0f, -1.0f, 1.0f),		// Bottom Right Far
+			DirectX::XMFLOAT3(1.0f, 1.0f, 0.0f),		// Top Right Near
+			DirectX::XMFLOAT3(-1.0f, -1.0f, 0.0f),		// Bottom Left Near
+			DirectX::XMFLOAT3(-1.0f, 1.0f, 0.0f),		// Top Left Near
+			DirectX::XMFLOAT3(1.0f, -1.0f, 0.0f)		// Bottom Right Near
+		};
+		DirectX::XMMATRIX inverse = DirectX::XMMatrixInverse(nullptr, vp);
+		for (int i = 0; i < 8; i++)
+		{
+			DirectX::XMFLOAT3 corner = clipCorners[i];
+			if (reversedDepth)
+				corner.z = 1.0f - corner.z;
+			DirectX::XMStoreFloat3(&frustum.points[i],
+				DirectX::XMVector3TransformCoord(DirectX::XMLoadFloat3(&corner), inverse));
+		}
+		return frustum;
+	}
 
+	// Whether the box might be visible, see FrustumTest for what each mode rejects
+	bool Intersects(AABB other, FrustumTest test = FrustumTest::Fast)
+	{
+		// Planes, using the corner furthest along each normal
 		for (int i = 0; i < 6; i++)
 		{
 			DirectX::XMFLOAT3 p = other.min;
@@ -249,42 +411,129 @@ struct Frustum
 			if (normals[i].z >= 0)
 				p.z = other.max.z;
 
-			float r = std::abs((other.max.x - other.min.x) * 0.5f * normals[i].x)
-				+ std::abs((other.max.y - other.min.y) * 0.5f * normals[i].y)
-				+ std::abs((other.max.z - other.min.z) * 0.5f * normals[i].z);
+			if (DistanceToPoint(normals[i], p) < 0.0f)
+				return false;
+		}
+		if (test == FrustumTest::Fast)
+			return true;
 
-			float dist = DistanceToPoint(normals[i], p);
+		// Frustum corners, all past the same face of the box
+		// https://iquilezles.org/articles/frustumcorrect/
+		int out;
+		out = 0; for (int i = 0; i < 8; i++) out += ((points[i].x > other.max.x) ? 1 : 0); if (out == 8) return false;
+		out = 0; for (int i = 0; i < 8; i++) out += ((points[i].x < other.min.x) ? 1 : 0); if (out == 8) return false;
+		out = 0; for (int i = 0; i < 8; i++) out += ((points[i].y > other.max.y) ? 1 : 0); if (out == 8) return false;
+		out = 0; for (int i = 0; i < 8; i++) out += ((points[i].y < other.min.y) ? 1 : 0); if (out == 8) return false;
+		out = 0; for (int i = 0; i < 8; i++) out += ((points[i].z > other.max.z) ? 1 : 0); if (out == 8) return false;
+		out = 0; for (int i = 0; i < 8; i++) out += ((points[i].z < other.min.z) ? 1 : 0); if (out == 8) return false;
+		if (test == FrustumTest::Refined)
+			return true;
 
-			if (dist >= -r)
+		// The planes and box faces have been tried in one direction,
+		// the rest of the separating axes are the frustum's faces from
+		// the other side and each box edge crossed with each frustum edge
+		// (the near rectangle's two directions and the four side edges)
+		DirectX::XMFLOAT3 frustumEdges[6] = {
+			Subtract(points[4], points[6]),		// Right along the near face
+			Subtract(points[4], points[7]),		// Up along the near face
+			Subtract(points[0], points[4]),		// Top right side
+			Subtract(points[1], points[5]),		// Bottom left side
+			Subtract(points[2], points[6]),		// Top left side
+			Subtract(points[3], points[7])		// Bottom right side
+		};
+		for (int i = 0; i < 6; i++)
+		{
+			if (Separates(DirectX::XMFLOAT3(normals[i].x, normals[i].y, normals[i].z), other))
 				return false;
 		}
+		for (int e = 0; e < 6; e++)
+		{
+			const DirectX::XMFLOAT3& d = frustumEdges[e];
+			DirectX::XMFLOAT3 axes[3] = {
+				DirectX::XMFLOAT3(0.0f, -d.z, d.y),	// X edge cross d
+				DirectX::XMFLOAT3(d.z, 0.0f, -d.x),	// Y edge cross d
+				DirectX::XMFLOAT3(-d.y, d.x, 0.0f)	// Z edge cross d
+			};
+			for (int a = 0; a < 3; a++)
+			{
+				if (Separates(axes[a], other))
+					return false;
+			}
+		}
 		return true;
+	}
 
+private:
+	static DirectX::XMFLOAT3 Subtract(DirectX::XMFLOAT3 a, DirectX::XMFLOAT3 b)
+	{
+		return DirectX::XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
 
-		// check box outside/inside of frustum
-		for (int i = 0; i < 6; i++)
+	// Whether the box and frustum project onto the axis without overlapping
+	bool Separates(DirectX::XMFLOAT3 axis, AABB& box)
+	{
+		// Parallel edges give a zero axis, which separates nothing
+		if (axis.x == 0.0f && axis.y == 0.0f && axis.z == 0.0f)
+			return false;
+
+		float center =
+			axis.x * (box.max.x + box.min.x) * 0.5f +
+			axis.y * (box.max.y + box.min.y) * 0.5f +
+			axis.z * (box.max.z + box.min.z) * 0.5f;
+		float radius =
+			std::abs(axis.x) * (box.max.x - box.min.x) * 0.5f +
+			std::abs(axis.y) * (box.max.y - box.min.y) * 0.5f +
+			std::abs(axis.z) * (box.max.z - box.min.z) * 0.5f;
+
+		float frustumMin = FLT_MAX;
+		float frustumMax = -FLT_MAX;
+		for (int i = 0; i < 8; i++)
 		{
-			int out = 0;
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.min.x, other.min.y, other.min.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.max.x, other.min.y, other.min.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.min.x, other.max.y, other.min.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.max.x, other.max.y, other.min.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.min.x, other.min.y, other.max.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.max.x, other.min.y, other.max.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.min.x, other.max.y, other.max.z)) < 0.0) ? 1 : 0);
-			out += ((DistanceToPoint(normals[i], DirectX::XMFLOAT3(other.max.x, other.max.y, other.max.z)) < 0.0) ? 1 : 0);
-			if (out == 8) return false; // All corners are out
+			float d = axis.x * points[i].x + axis.y * points[i].y + axis.z * points[i].z;
+			frustumMin = d < frustumMin ? d : frustumMin;
+			frustumMax = d > frustumMax ? d : frustumMax;
 		}
+		return center + radius < frustumMin || center - radius > frustumMax;
+	}
+};
 
-		// check frustum outside/inside box
-		//int out;
-		//out = 0; for (int i = 0; i < 8; i++) out += ((points[i].x > other.max.x) ? 1 : 0); if (out == 8) return false;
-		//out = 0; for (int i = 0; i < 8; i++) out += ((points[i].x < other.min.x) ? 1 : 0); if (out == 8) return false;
-		//out = 0; for (int i = 0; i < 8; i++) out += ((points[i].y > other.max.y) ? 1 : 0); if (out == 8) return false;
-		//out = 0; for (int i = 0; i < 8; i++) out += ((points[i].y < other.min.y) ? 1 : 0); if (out == 8) return false;
-		//out = 0; for (int i = 0; i < 8; i++) out += ((points[i].z > other.max.z) ? 1 : 0); if (out == 8) return false;
-		//out = 0; for (int i = 0; i < 8; i++) out += ((points[i].z < other.min.z) ? 1 : 0); if (out == 8) return false;
+// Estimates how many pixels tall a box appears on screen from the sphere
+// around it, for perspective and orthographic projections alike, so
+// entities too small to matter can be skipped
+struct ScreenProjection
+{
+	DirectX::XMFLOAT4 depth;	// View-projection column giving a point's clip w
+	float depthScale;			// How fast clip w changes with distance, zero when orthographic
+	float pixelScale;			// Pixels per world unit at a clip w of one
 
-		return true;
+	static ScreenProjection FromMatrices(DirectX::XMFLOAT4X4 viewProjection,
+		DirectX::XMFLOAT4X4 projection, float screenHeight)
+	{
+		ScreenProjection screen;
+		screen.depth = DirectX::XMFLOAT4(
+			viewProjection._14, viewProjection._24, viewProjection._34, viewProjection._44);
+		screen.depthScale = std::sqrt(
+			screen.depth.x * screen.depth.x +
+			screen.depth.y * screen.depth.y +
+			screen.depth.z * screen.depth.z);
+		// _22 takes view space y to clip space, which spans two NDC units
+		screen.pixelScale = projection._22 * screenHeight * 0.5f;
+		return screen;
+	}
+
+	// Projected diameter in pixels, overestimated by measuring at the
+	// sphere's nearest point, and unbounded when the sphere holds the eye
+	float GetSize(AABB box)
+	{
+		DirectX::XMFLOAT3 center = box.Center();
+		float ex = (box.max.x - box.min.x) * 0.5f;
+		float ey = (box.max.y - box.min.y) * 0.5f;
+		float ez = (box.max.z - box.min.z) * 0.5f;
+		float radius = std::sqrt(ex * ex + ey * ey + ez * ez);
+
+		float w = CalcD(depth, center) + depth.w - radius * depthScale;
+		if (w <= 0.0f)
+			return FLT_MAX;
+		return 2.0f * radius * pixelScale / w;
 	}
 };
@@ -0,0 +1,118 @@
+#include "CullingCache.h"
+#include "Octree.h"
+
+#include <cstring>
+
+CullingCache::CullingCache()
+    : lastFrustum(), hasFrustum(false), sameView(false),
+    lookups(0), reuses(0), rejects(0), firstPlaneRejects(0) {}
+
+///////////////////////////////////////////////////////////////////////////////
+// Getters
+///////////////////////////////////////////////////////////////////////////////
+
+unsigned long long CullingCache::GetLookupCount() { return lookups; }
+unsigned long long CullingCache::GetReuseCount() { return reuses; }
+unsigned long long CullingCache::GetRejectCount() { return rejects; }
+unsigned long long CullingCache::GetFirstPlaneRejectCount() { return firstPlaneRejects; }
+float CullingCache::GetReuseRate() { return lookups == 0 ? 0.0f : (float)reuses / lookups; }
+float CullingCache::GetFirstPlaneHitRate() { return rejects == 0 ? 0.0f : (float)firstPlaneRejects / rejects; }
+
+///////////////////////////////////////////////////////////////////////////////
+// Functions
+///////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Starts a cull of this view, results from the last one can
+/// only be reused when the frustum hasn't changed since
+/// </summary>
+void CullingCache::Begin(Frustum& frustum)
+{
+    sameView = hasFrustum && memcmp(&frustum, &lastFrustum, sizeof(Frustum)) == 0;
+    lastFrustum = frustum;
+    hasFrustum = true;
+}
+
+/// <summary>
+/// Whether the entity's bounds are in front of every plane in the mask,
+/// reusing or reordering the test based on the last cull
+/// </summary>
+/// <param name="planeMask">Bit i set if plane i needs testing</param>
+bool CullingCache::IsVisible(Entity* entity, Frustum& frustum, unsigned char planeMask)
+{
+    lookups++;
+    unsigned int index = entity->sceneIndex;
+    if (index >= entries.size())
+        entries.resize(index + 1, { nullptr, 0, 0, false });
+    Entry& entry = entries[index];
+
+    // Another entity may have been swapped into this index since
+    unsigned int version = entity->GetBoundsVersion();
+    bool known = entry.entity == entity;
+    if (known && sameView && entry.boundsVersion == version)
+    {
+        reuses++;
+        return entry.visible;
+    }
+    if (!known)
+    {
+        entry.entity = entity;
+        entry.lastPlane = 0;
+    }
+    entry.boundsVersion = version;
+
+    // The plane that rejected it last time first, then the rest in order
+    AABB box = entity->GetAABB();
+    entry.visible = true;
+    if (planeMask & (1 << entry.lastPlane))
+    {
+        entry.visible = box.IntersectsPlane(frustum.normals[entry.lastPlane]);
+        if (!entry.visible)
+            firstPlaneRejects++;
+    }
+    for (unsigned char i = 0; i < 6 && entry.visible; i++)
+    {
+        if (i == entry.lastPlane || !(planeMask & (1 << i)))
+            continue;
+        if (!box.IntersectsPlane(frustum.normals[i]))
+        {
+            entry.visible = false;
+            entry.lastPlane = i;
+        }
+    }
+
+    if (!entry.visible)
+        rejects++;
+    return entry.visible;
+}
+
+/// <summary>
+/// Tests every candidate against all six planes
+/// </summary>
+/// <param name="out">Visible candidates are appended here</param>
+void CullingCache::Cull(Frustum& frustum, std::vector<Entity*>& candidates, std::vector<Entity*>& out)
+{
+    Begin(frustum);
+    for (Entity* entity : candidates)
+    {
+        if (IsVisible(entity, frustum, ALL_PLANES))
+            out.push_back(entity);
+    }
+}
+
+/// <summary>
+/// Forgets every result, for when the view switches scenes
+/// </summary>
+void CullingCache::Clear()
+{
+    entries.clear();
+    hasFrustum = false;
+}
+
+void CullingCache::ResetCounters()
+{
+    lookups = 0;
+    reuses = 0;
+    rejects = 0;
+    firstPlaneRejects = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "Collision.h"
+
+class Entity;
+
+/// <summary>
+/// Remembers each entity's last frustum plane test for one view, keyed by
+/// its scene index. An entity is retested starting with the plane that
+/// rejected it last time, which usually rejects it again while the view
+/// only moves a little. When neither the frustum nor the entity's bounds
+/// changed since the last test, its result is reused without testing.
+/// Results only depend on the entity and frustum, so callers that skip
+/// planes an entity is known to be inside share the same entries.
+/// </summary>
+class CullingCache
+{
+public:
+	CullingCache();
+
+	// Getters
+	unsigned long long GetLookupCount();
+	unsigned long long GetReuseCount();
+	unsigned long long GetRejectCount();
+	unsigned long long GetFirstPlaneRejectCount();
+	float GetReuseRate();			// Lookups answered without a test
+	float GetFirstPlaneHitRate();	// Rejections made by the remembered plane
+
+	// Functions
+	void Begin(Frustum& frustum);
+	bool IsVisible(Entity* entity, Frustum& frustum, unsigned char planeMask);
+	void Cull(Frustum& frustum, std::vector<Entity*>& candidates, std::vector<Entity*>& out);
+	void Clear();
+	void ResetCounters();
+
+private:
+	struct Entry
+	{
+		Entity* entity;				// Whoever held this scene index when tested
+		unsigned int boundsVersion;	// The entity's bounds version when tested
+		unsigned char lastPlane;	// Plane that last rejected the entity
+		bool visible;
+	};
+
+	std::vector<Entry> entries;
+	Frustum lastFrustum;
+	bool hasFrustum;
+	bool sameView;	// The frustum since Begin matches the previous one
+
+	// Counters, kept until reset
+	unsigned long long lookups;
+	unsigned long long reuses;
+	unsigned long long rejects;
+	unsigned long long firstPlaneRejects;
+};
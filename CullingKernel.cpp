@@ -0,0 +1,269 @@
+#include "CullingKernel.h"
+
+#ifdef CULLING_SSE
+#include <xmmintrin.h>
+#endif
+#ifdef CULLING_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    /// <summary>
+    /// The planes a kernel still has to test, with the absolute
+    /// normals the projected radius needs worked out once per call
+    /// </summary>
+    struct ActivePlanes
+    {
+        int count;
+        float nx[6], ny[6], nz[6], w[6];
+        float ax[6], ay[6], az[6];
+    };
+
+    ActivePlanes GatherPlanes(Frustum& frustum, unsigned char planeMask)
+    {
+        ActivePlanes planes;
+        planes.count = 0;
+        for (int i = 0; i < 6; i++)
+        {
+            if (!(planeMask & (1 << i)))
+                continue;
+
+            DirectX::XMFLOAT4& n = frustum.normals[i];
+            int p = planes.count++;
+            planes.nx[p] = n.x;
+            planes.ny[p] = n.y;
+            planes.nz[p] = n.z;
+            planes.w[p] = n.w;
+            planes.ax[p] = std::abs(n.x);
+            planes.ay[p] = std::abs(n.y);
+            planes.az[p] = std::abs(n.z);
+        }
+        return planes;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BoundsSoA
+///////////////////////////////////////////////////////////////////////////////
+
+void Culling::BoundsSoA::Clear()
+{
+    Resize(0);
+}
+
+void Culling::BoundsSoA::Resize(size_t count)
+{
+    centerX.resize(count);
+    centerY.resize(count);
+    centerZ.resize(count);
+    extentX.resize(count);
+    extentY.resize(count);
+    extentZ.resize(count);
+}
+
+/// <summary>
+/// Stores a box as center and half extents, worked out the same
+/// way as AABB::IntersectsPlane so both tests agree exactly
+/// </summary>
+void Culling::BoundsSoA::Set(size_t index, const AABB& box)
+{
+    float cx = (box.max.x + box.min.x) * 0.5f;
+    float cy = (box.max.y + box.min.y) * 0.5f;
+    float cz = (box.max.z + box.min.z) * 0.5f;
+    centerX[index] = cx;
+    centerY[index] = cy;
+    centerZ[index] = cz;
+    extentX[index] = box.max.x - cx;
+    extentY[index] = box.max.y - cy;
+    extentZ[index] = box.max.z - cz;
+}
+
+void Culling::BoundsSoA::Add(const AABB& box)
+{
+    Resize(Size() + 1);
+    Set(Size() - 1, box);
+}
+
+size_t Culling::BoundsSoA::Size() const { return centerX.size(); }
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels
+///////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Culls a run of boxes with the widest kernel available
+/// </summary>
+/// <param name="first">Index of the first box to test</param>
+/// <param name="count">Number of boxes to test</param>
+/// <param name="planeMask">Bit i set if plane i needs testing</param>
+/// <param name="out">Receives the indices of visible boxes, needs room for count</param>
+/// <returns>Number of visible boxes written to out</returns>
+unsigned int Culling::Cull(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+    unsigned char planeMask, unsigned int* out)
+{
+#if defined(CULLING_AVX2)
+    return CullAVX2(frustum, bounds, first, count, planeMask, out);
+#elif defined(CULLING_SSE)
+    return CullSSE(frustum, bounds, first, count, planeMask, out);
+#else
+    return CullScalar(frustum, bounds, first, count, planeMask, out);
+#endif
+}
+
+const char* Culling::GetKernelName()
+{
+#if defined(CULLING_AVX2)
+    return "AVX2";
+#elif defined(CULLING_SSE)
+    return "SSE";
+#else
+    return "Scalar";
+#endif
+}
+
+/// <summary>
+/// One box at a time, stopping at the first plane the box is behind.
+/// Also finishes the boxes left over after the wide kernels.
+/// </summary>
+unsigned int Culling::CullScalar(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+    unsigned char planeMask, unsigned int* out)
+{
+    ActivePlanes planes = GatherPlanes(frustum, planeMask);
+    unsigned int visibleCount = 0;
+    for (unsigned int i = first; i < first + count; i++)
+    {
+        float cx = bounds.centerX[i], cy = bounds.centerY[i], cz = bounds.centerZ[i];
+        float ex = bounds.extentX[i], ey = bounds.extentY[i], ez = bounds.extentZ[i];
+
+        bool visible = true;
+        for (int p = 0; p < planes.count && visible; p++)
+        {
+            float dist = planes.nx[p] * cx + planes.ny[p] * cy + planes.nz[p] * cz - planes.w[p];
+            float r = planes.ax[p] * ex + planes.ay[p] * ey + planes.az[p] * ez;
+            visible = !(dist < -r);
+        }
+
+        // Always write, only advance for visible boxes
+        out[visibleCount] = i;
+        visibleCount += visible ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+#ifdef CULLING_SSE
+/// <summary>
+/// Four boxes per iteration. Each plane's culled lanes are or'ed
+/// together, and the loop moves on once all four are culled.
+/// </summary>
+unsigned int Culling::CullSSE(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+    unsigned char planeMask, unsigned int* out)
+{
+    ActivePlanes planes = GatherPlanes(frustum, planeMask);
+    __m128 nx[6], ny[6], nz[6], w[6], ax[6], ay[6], az[6];
+    for (int p = 0; p < planes.count; p++)
+    {
+        nx[p] = _mm_set1_ps(planes.nx[p]);
+        ny[p] = _mm_set1_ps(planes.ny[p]);
+        nz[p] = _mm_set1_ps(planes.nz[p]);
+        w[p] = _mm_set1_ps(planes.w[p]);
+        ax[p] = _mm_set1_ps(planes.ax[p]);
+        ay[p] = _mm_set1_ps(planes.ay[p]);
+        az[p] = _mm_set1_ps(planes.az[p]);
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    unsigned int visibleCount = 0;
+    unsigned int i = first;
+    unsigned int wideEnd = first + (count & ~3u);
+    for (; i < wideEnd; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+
+        __m128 culled = zero;
+        for (int p = 0; p < planes.count; p++)
+        {
+            __m128 dist = _mm_sub_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)), _mm_mul_ps(nz[p], cz)), w[p]);
+            __m128 r = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(dist, _mm_sub_ps(zero, r)));
+            if (_mm_movemask_ps(culled) == 0xF)
+                break;
+        }
+
+        int visible = ~_mm_movemask_ps(culled);
+        for (unsigned int lane = 0; lane < 4; lane++)
+        {
+            out[visibleCount] = i + lane;
+            visibleCount += (visible >> lane) & 1;
+        }
+    }
+
+    return visibleCount + CullScalar(frustum, bounds, i, first + count - i, planeMask, out + visibleCount);
+}
+#endif
+
+#ifdef CULLING_AVX2
+/// <summary>
+/// Eight boxes per iteration, otherwise the same as the SSE kernel
+/// </summary>
+unsigned int Culling::CullAVX2(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+    unsigned char planeMask, unsigned int* out)
+{
+    ActivePlanes planes = GatherPlanes(frustum, planeMask);
+    __m256 nx[6], ny[6], nz[6], w[6], ax[6], ay[6], az[6];
+    for (int p = 0; p < planes.count; p++)
+    {
+        nx[p] = _mm256_set1_ps(planes.nx[p]);
+        ny[p] = _mm256_set1_ps(planes.ny[p]);
+        nz[p] = _mm256_set1_ps(planes.nz[p]);
+        w[p] = _mm256_set1_ps(planes.w[p]);
+        ax[p] = _mm256_set1_ps(planes.ax[p]);
+        ay[p] = _mm256_set1_ps(planes.ay[p]);
+        az[p] = _mm256_set1_ps(planes.az[p]);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    unsigned int visibleCount = 0;
+    unsigned int i = first;
+    unsigned int wideEnd = first + (count & ~7u);
+    for (; i < wideEnd; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(&bounds.centerX[i]);
+        __m256 cy = _mm256_loadu_ps(&bounds.centerY[i]);
+        __m256 cz = _mm256_loadu_ps(&bounds.centerZ[i]);
+        __m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+        __m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+        __m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+
+        // Separate multiplies and adds rather than fused ones,
+        // so the results match the scalar kernel bit for bit
+        __m256 culled = zero;
+        for (int p = 0; p < planes.count; p++)
+        {
+            __m256 dist = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_mul_ps(nz[p], cz)), w[p]);
+            __m256 r = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(ax[p], ex), _mm256_mul_ps(ay[p], ey)), _mm256_mul_ps(az[p], ez));
+            culled = _mm256_or_ps(culled, _mm256_cmp_ps(dist, _mm256_sub_ps(zero, r), _CMP_LT_OQ));
+            if (_mm256_movemask_ps(culled) == 0xFF)
+                break;
+        }
+
+        int visible = ~_mm256_movemask_ps(culled);
+        for (unsigned int lane = 0; lane < 8; lane++)
+        {
+            out[visibleCount] = i + lane;
+            visibleCount += (visible >> lane) & 1;
+        }
+    }
+
+    return visibleCount + CullSSE(frustum, bounds, i, first + count - i, planeMask, out + visibleCount);
+}
+#endif
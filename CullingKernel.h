@@ -0,0 +1,55 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define CULLING_SSE		// 4 boxes per instruction
+#endif
+#if defined(__AVX2__)
+#define CULLING_AVX2	// 8 boxes per instruction, needs /arch:AVX2
+#endif
+#define CULLING_BATCH_SIZE 64	// Boxes per call when culling a long run into a stack buffer
+
+#include <vector>
+#include "Collision.h"
+
+/// <summary>
+/// Frustum culling over boxes stored as structure of arrays, so one
+/// instruction tests the same plane against 4 (SSE) or 8 (AVX2) boxes.
+/// Visible boxes are written out by compaction as indices, instead of
+/// erasing the culled ones from a list.
+/// The test matches AABB::IntersectsPlane, a box is visible unless it is
+/// entirely behind one of the planes.
+/// </summary>
+namespace Culling
+{
+	/// <summary>
+	/// Box centers and half extents, one array per component
+	/// </summary>
+	struct BoundsSoA
+	{
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+
+		void Clear();
+		void Resize(size_t count);
+		void Set(size_t index, const AABB& box);
+		void Add(const AABB& box);
+		size_t Size() const;
+	};
+
+	// The widest kernel this build was compiled with
+	unsigned int Cull(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+		unsigned char planeMask, unsigned int* out);
+	const char* GetKernelName();
+
+	// Individual kernels, for comparing them
+	unsigned int CullScalar(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+		unsigned char planeMask, unsigned int* out);
+#ifdef CULLING_SSE
+	unsigned int CullSSE(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+		unsigned char planeMask, unsigned int* out);
+#endif
+#ifdef CULLING_AVX2
+	unsigned int CullAVX2(Frustum& frustum, const BoundsSoA& bounds, unsigned int first, unsigned int count,
+		unsigned char planeMask, unsigned int* out);
+#endif
+}
@@ -1,4 +1,6 @@
 #include "Entity.h"
+#include "Octree.h"
+#include "SpatialHashGrid.h"
 #include <functional>
 
 // Constructors
@@ -19,6 +21,8 @@ Entity::Entity(std::shared_ptr<Mesh> _mesh,
     visibility = _material->GetVisibility();
     materials[0]->SetDirtyFunction(dirtyVisFuncPtr);
     visibilityDirty = false;
+    dynamic = false;
+    boundsVersion = 0;
 
     modelAABB = meshes[0]->GetAABB();
     aabb = modelAABB;
@@ -45,6 +49,8 @@ Entity::Entity(std::vector<std::shared_ptr<Mesh>> _meshes,
         materialPtr->SetDirtyFunction(dirtyVisFuncPtr);
     }
     visibilityDirty = false;
+    dynamic = false;
+    boundsVersion = 0;
 
     modelAABB = meshes[0]->GetAABB();
     aabb = modelAABB;
@@ -53,71 +59,43 @@ Entity::Entity(std::vector<std::shared_ptr<Mesh>> _meshes,
 
 
 // Getters
+std::string Entity::GetName() { return name; }
 std::shared_ptr<Transform> Entity::GetTransform() { return transform; }
 std::vector<std::shared_ptr<Mesh>> Entity::GetMeshes() { return meshes; }
 std::vector<std::shared_ptr<Material>> Entity::GetMaterials() { return materials; }
+/// <summary>
+/// Gets the world space bounds, recalculating them if the transform changed.
+/// The model bounds' center is transformed like a point, and each world axis
+/// extent is the model extents weighted by the absolute values of the
+/// matrix's column on that axis (Arvo's method), so no corners are needed.
+/// </summary>
 AABB Entity::GetAABB()
 {
     if (transformDirty)
     {
-        // Rotation means axis are no longer aligned
         DirectX::XMFLOAT4X4 worldFloat = transform->GetWorldMatrix();
         DirectX::XMMATRIX wm = DirectX::XMLoadFloat4x4(&worldFloat);
-        //DirectX::XMFLOAT3 transFloat = transform->GetPosition();
-        //DirectX::XMFLOAT3 scaleFloat = transform->GetScale();
-        //DirectX::XMMATRIX transmat = DirectX::XMMatrixTranslationFromVector(XMLoadFloat3(&transFloat));
-        //DirectX::XMMATRIX scalemat = DirectX::XMMatrixScalingFromVector(XMLoadFloat3(&scaleFloat));
-        //DirectX::XMMATRIX wm = DirectX::XMMatrixMultiply(scalemat, transmat);
-        //Transform* parent = transform->GetParent();
-        //if (parent)
-        //{
-        //    DirectX::XMFLOAT3 ptransFloat = parent->GetPosition();
-        //    DirectX::XMFLOAT3 pscaleFloat = parent->GetScale();
-        //    DirectX::XMMATRIX ptransmat = DirectX::XMMatrixTranslationFromVector(XMLoadFloat3(&ptransFloat));
-        //    DirectX::XMMATRIX pscalemat = DirectX::XMMatrixScalingFromVector(XMLoadFloat3(&pscaleFloat));
-        //    DirectX::XMMATRIX pwm = DirectX::XMMatrixMultiply(pscalemat, ptransmat);
-        //    wm *= pwm;
-        //}
-
-        // Have to transform corners then calculate AABB
-        // Could simply transform max and min, but rotation makes things messy
-        DirectX::XMFLOAT3 corners[8] = {
-                {modelAABB.min.x, modelAABB.min.y, modelAABB.min.z}, // x y z
-                {modelAABB.max.x, modelAABB.min.y, modelAABB.min.z}, // X y z
-                {modelAABB.min.x, modelAABB.max.y, modelAABB.min.z}, // x Y z
-                {modelAABB.max.x, modelAABB.max.y, modelAABB.min.z}, // X Y z
-
-                {modelAABB.min.x, modelAABB.min.y, modelAABB.max.z}, // x y Z
-                {modelAABB.max.x, modelAABB.min.y, modelAABB.max.z}, // X y Z
-                {modelAABB.min.x, modelAABB.max.y, modelAABB.max.z}, // x Y Z
-                {modelAABB.max.x, modelAABB.max.y, modelAABB.max.z}, // X Y Z
-            };
-        // Transform corners
-        for (int c = 0; c < 8; c++)
-        {
-            DirectX::XMStoreFloat3(&corners[c],
-                DirectX::XMVector3Transform(
-                    DirectX::XMLoadFloat3(&corners[c])
-                    , wm));
-        }
-
-        // Calculate AABB
-        aabb.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-        aabb.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
-        for (int c = 0; c < 8; c++)
-        {
-            aabb.max.x = aabb.max.x > corners[c].x ? aabb.max.x : corners[c].x;
-            aabb.max.y = aabb.max.y > corners[c].y ? aabb.max.y : corners[c].y;
-            aabb.max.z = aabb.max.z > corners[c].z ? aabb.max.z : corners[c].z;
-            aabb.min.x = aabb.min.x < corners[c].x ? aabb.min.x : corners[c].x;
-            aabb.min.y = aabb.min.y < corners[c].y ? aabb.min.y : corners[c].y;
-            aabb.min.z = aabb.min.z < corners[c].z ? aabb.min.z : corners[c].z;
-        }
 
+        DirectX::XMVECTOR center = DirectX::XMVectorSet(
+            (modelAABB.min.x + modelAABB.max.x) * 0.5f,
+            (modelAABB.min.y + modelAABB.max.y) * 0.5f,
+            (modelAABB.min.z + modelAABB.max.z) * 0.5f, 1.0f);
+        center = DirectX::XMVector3Transform(center, wm);
+        DirectX::XMVECTOR extents =
+            DirectX::XMVectorAbs(wm.r[0]) * ((modelAABB.max.x - modelAABB.min.x) * 0.5f) +
+            DirectX::XMVectorAbs(wm.r[1]) * ((modelAABB.max.y - modelAABB.min.y) * 0.5f) +
+            DirectX::XMVectorAbs(wm.r[2]) * ((modelAABB.max.z - modelAABB.min.z) * 0.5f);
+
+        DirectX::XMStoreFloat3(&aabb.min, center - extents);
+        DirectX::XMStoreFloat3(&aabb.max, center + extents);
         transformDirty = false;
     }
     return aabb;
 }
+bool Entity::IsAABBDirty() { return transformDirty; }
+
+bool Entity::IsDynamic() { return dynamic; }
+unsigned int Entity::GetBoundsVersion() { return boundsVersion; }
 
 Visibility Entity::GetVisibility()
 {
@@ -167,8 +145,17 @@ void Entity::SetMaterials(std::vector<std::shared_ptr<Material>> _materials)
 void Entity::SetAABB(AABB _aabb) { aabb = _aabb; SetTransformDirty(); }
 void Entity::SetTransformDirty() 
 { 
+    // Only the first move each frame needs relocating
+    if (!hasMoved)
+    {
+        if (octreeNode != nullptr)
+            octreeNode->MarkMoved(this);
+        else if (grid != nullptr)
+            grid->MarkMoved(this);
+    }
     hasMoved = true;
     transformDirty = true; 
+    boundsVersion++;
 }
 
 void Entity::SetColorTint(DirectX::XMFLOAT4 _colorTint)
@@ -178,3 +165,78 @@ void Entity::SetColorTint(DirectX::XMFLOAT4 _colorTint)
         matPtr->SetColorTint(_colorTint);
     }
 }
+
+void Entity::SetDynamic(bool _dynamic) { dynamic = _dynamic; }
+
+/// <summary>
+/// Recalculates the bounds of every entity in the list the same way as
+/// GetAABB, four entities at a time with each lane of a vector holding a
+/// different entity's value. Entities whose bounds are already up to date
+/// are simply recalculated too, so callers should only pass dirty ones.
+/// </summary>
+void Entity::UpdateAABBs(std::vector<Entity*>& entities)
+{
+    using namespace DirectX;
+
+    size_t count = entities.size();
+    for (size_t e = 0; e < count; e += 4)
+    {
+        // A short group repeats its last entity
+        Entity* group[4];
+        for (size_t k = 0; k < 4; k++)
+            group[k] = entities[e + k < count ? e + k : count - 1];
+
+        XMMATRIX worlds[4];
+        XMMATRIX centers, extents;
+        for (int k = 0; k < 4; k++)
+        {
+            XMFLOAT4X4 world = group[k]->transform->GetWorldMatrix();
+            worlds[k] = XMLoadFloat4x4(&world);
+            AABB& model = group[k]->modelAABB;
+            centers.r[k] = XMVectorSet(
+                (model.min.x + model.max.x) * 0.5f,
+                (model.min.y + model.max.y) * 0.5f,
+                (model.min.z + model.max.z) * 0.5f, 0.0f);
+            extents.r[k] = XMVectorSet(
+                (model.max.x - model.min.x) * 0.5f,
+                (model.max.y - model.min.y) * 0.5f,
+                (model.max.z - model.min.z) * 0.5f, 0.0f);
+        }
+
+        // Transposing turns each entity's vector into one vector per axis,
+        // and each matrix row into one vector per element of that row
+        centers = XMMatrixTranspose(centers);
+        extents = XMMatrixTranspose(extents);
+        XMMATRIX rows[4];
+        for (int row = 0; row < 4; row++)
+            rows[row] = XMMatrixTranspose(
+                XMMATRIX(worlds[0].r[row], worlds[1].r[row], worlds[2].r[row], worlds[3].r[row]));
+
+        XMMATRIX mins, maxs;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            XMVECTOR center = rows[3].r[axis] +
+                centers.r[0] * rows[0].r[axis] +
+                centers.r[1] * rows[1].r[axis] +
+                centers.r[2] * rows[2].r[axis];
+            XMVECTOR extent =
+                extents.r[0] * XMVectorAbs(rows[0].r[axis]) +
+                extents.r[1] * XMVectorAbs(rows[1].r[axis]) +
+                extents.r[2] * XMVectorAbs(rows[2].r[axis]);
+            mins.r[axis] = center - extent;
+            maxs.r[axis] = center + extent;
+        }
+        mins.r[3] = XMVectorZero();
+        maxs.r[3] = XMVectorZero();
+
+        // And back to one vector per entity
+        mins = XMMatrixTranspose(mins);
+        maxs = XMMatrixTranspose(maxs);
+        for (size_t k = 0; k < 4 && e + k < count; k++)
+        {
+            XMStoreFloat3(&group[k]->aabb.min, mins.r[k]);
+            XMStoreFloat3(&group[k]->aabb.max, maxs.r[k]);
+            group[k]->transformDirty = false;
+        }
+    }
+}
@@ -5,6 +5,9 @@
 #include "Material.h"
 #include <string>
 
+namespace Octree { class Node; }
+class SpatialHashGrid;
+
 class Entity
 {
 public:
@@ -16,11 +19,15 @@ public:
 		std::string _name = "NoName");
 
 	// Getters
+	std::string GetName();
 	std::shared_ptr<Transform> GetTransform();
 	std::vector<std::shared_ptr<Mesh>> GetMeshes();
 	std::vector<std::shared_ptr<Material>> GetMaterials();
 	AABB GetAABB();
+	bool IsAABBDirty();
 	Visibility GetVisibility();
+	bool IsDynamic();
+	unsigned int GetBoundsVersion();
 
 	// Setters
 	void SetTransform(std::shared_ptr<Transform> _transform);
@@ -29,8 +36,24 @@ public:
 	void SetAABB(AABB aabb);
 	void SetTransformDirty();
 	void SetColorTint(DirectX::XMFLOAT4 _colorTint);
+	void SetDynamic(bool _dynamic);
+
+	// Brings the bounds of many moved entities up to date at once
+	static void UpdateAABBs(std::vector<Entity*>& entities);
 
 	bool hasMoved = false;
+	// The octree node holding this entity and its index there, set by the octree
+	Octree::Node* octreeNode = nullptr;
+	unsigned int octreeIndex = 0;
+	// Index in the moved list of whichever structure it has been reported to
+	unsigned int movedIndex = 0;
+	// Index in the scene's entity list, set by the scene
+	unsigned int sceneIndex = 0;
+	// The grid cell holding this entity and its index there, set by the grid
+	static constexpr unsigned int NoGridCell = 0xFFFFFFFF;
+	unsigned int gridCell = NoGridCell;
+	unsigned int gridIndex = 0;
+	SpatialHashGrid* grid = nullptr;
 
 private:
 	std::string name;
@@ -42,6 +65,8 @@ private:
 	bool transformDirty;
 	Visibility visibility;
 	bool visibilityDirty;
+	bool dynamic; // Moves often, so the scene keeps it out of the octree
+	unsigned int boundsVersion; // Bumped whenever the bounds may have changed
 
 	// Delegates and Callbacks
 	std::function<void()> dirtyTransFuncPtr;
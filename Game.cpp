@@ -5,6 +5,7 @@
 #include "PathHelpers.h"
 #include "Window.h"
 #include "Assets.h"
+#include "Benchmark.h"
 #include "psapi.h"
 
 #include "D3D12Helper.h"
@@ -237,6 +238,15 @@ void Game::Update(float deltaTime, float totalTime)
 		printf("Camera Forward: %f, %f, %f \n", camFrd.x, camFrd.y, camFrd.z);
 	}
 
+	// Picking
+	if (Input::MouseRightPress())
+	{
+		Ray ray = { currentCamera->GetTransform()->GetPosition(), MouseDirection() };
+		Octree::RayHit hit;
+		if (scene->Raycast(ray, FLT_MAX, hit))
+			printf("Picked %s at distance %f \n", hit.entity->GetName().c_str(), hit.t);
+	}
+
 	// Lights
 	scene->GetLights()[0].Position = currentCamera->GetTransform()->GetPosition();
 	scene->GetLights()[0].Direction = MouseDirection();
@@ -310,6 +320,11 @@ static float endColor[4][4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 static float camPos[3];
 static float camRot[3];
 
+static std::string benchmarkReport;
+static bool recordCameraPath = false;
+static std::vector<XMFLOAT4X4> recordedCameraPath;
+static const size_t maxCameraPathFrames = 3600; // A minute at 60 fps
+
 void Game::BuildUI()
 {
 	D3D12Helper& d3d12Helper = D3D12Helper::GetInstance();
@@ -363,6 +378,44 @@ void Game::BuildUI()
 
 		if (ImGui::TreeNode("Frustum"))
 		{
+			const char* tests[] = { "Fast", "Refined", "Exact" };
+			int cameraTest = (int)Graphics::cameraFrustumTest;
+			if (ImGui::Combo("Camera Culling", &cameraTest, tests, IM_ARRAYSIZE(tests)))
+				Graphics::cameraFrustumTest = (FrustumTest)cameraTest;
+			int shadowTest = (int)Graphics::shadowFrustumTest;
+			if (ImGui::Combo("Shadow Culling", &shadowTest, tests, IM_ARRAYSIZE(tests)))
+				Graphics::shadowFrustumTest = (FrustumTest)shadowTest;
+
+			ImGui::DragFloat("Camera Min Size (px)", &Graphics::cameraMinScreenSize, 0.1f, 0.0f, 64.0f);
+			ImGui::DragFloat("Shadow Min Size (px)", &Graphics::shadowMinScreenSize, 0.1f, 0.0f, 64.0f);
+			ImGui::Text("Too Small: %u camera, %u shadow",
+				Graphics::cameraSizeCulled,
+				Graphics::shadowSizeCulled);
+
+			ImGui::Checkbox("Temporal Culling", &Graphics::temporalCulling);
+			CullingCache* cache = cam->GetCullingCache();
+			ImGui::Text("Reused: %.1f%%, First Plane Hits: %.1f%%",
+				cache->GetReuseRate() * 100.0f,
+				cache->GetFirstPlaneHitRate() * 100.0f);
+			if (ImGui::Button("Reset Counters"))
+				cache->ResetCounters();
+			// Each recording starts a new path, and stops once it's full
+			if (ImGui::Checkbox("Record Camera Path", &recordCameraPath) && recordCameraPath)
+				recordedCameraPath.clear();
+			ImGui::SameLine();
+			ImGui::Text("%zu / %zu frames", recordedCameraPath.size(), maxCameraPathFrames);
+			if (recordCameraPath && recordedCameraPath.size() >= maxCameraPathFrames)
+				recordCameraPath = false;
+			if (recordCameraPath)
+			{
+				XMFLOAT4X4 viewProjection;
+				XMFLOAT4X4 view = cam->GetView();
+				XMFLOAT4X4 proj = cam->GetProjection();
+				XMStoreFloat4x4(&viewProjection,
+					XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj)));
+				recordedCameraPath.push_back(viewProjection);
+			}
+
 			Frustum fru = cam->GetFrustum();
 			ImGui::Text("Near: %f, %f, %f, %f", 
 				fru.normals[0].x, 
@@ -419,6 +472,19 @@ void Game::BuildUI()
 			CreateLights();
 		}
 
+		if (ImGui::TreeNode("Octree"))
+		{
+			std::shared_ptr<Octree::Node> octree = scene->GetOctree();
+			std::vector<unsigned int> nodesPerDepth;
+			std::vector<unsigned int> entitiesPerDepth;
+			octree->GetDepthStatistics(nodesPerDepth, entitiesPerDepth);
+
+			ImGui::Text("Looseness: %.2f", octree->GetLooseness());
+			for (unsigned int i = 0; i < nodesPerDepth.size(); i++)
+				ImGui::Text("Depth %u: %u nodes, %u entities", i, nodesPerDepth[i], entitiesPerDepth[i]);
+			ImGui::TreePop();
+		}
+
 		if (ImGui::TreeNode("Shadow Maps"))
 		{
 			for (std::shared_ptr<ShadowLight> light : scene->GetShadowLights())
@@ -429,6 +495,69 @@ void Game::BuildUI()
 
 		ImGui::TreePop();
 	}
+	if (ImGui::TreeNode("Benchmarks"))
+	{
+		Frustum frustum = scene->GetCurrentCamera()->GetFrustum();
+		if (ImGui::Button("Octree Storage"))
+			benchmarkReport = Benchmark::OctreeStorage(frustum);
+		if (ImGui::Button("Octree Query"))
+			benchmarkReport = Benchmark::OctreeQuery(frustum);
+		if (ImGui::Button("Octree Update"))
+			benchmarkReport = Benchmark::OctreeUpdate();
+		if (ImGui::Button("Spawn and Despawn"))
+			benchmarkReport = Benchmark::SpawnDespawn();
+		if (ImGui::Button("Root Growth"))
+			benchmarkReport = Benchmark::RootGrowth(frustum);
+		if (ImGui::Button("Raycast"))
+			benchmarkReport = Benchmark::Raycast();
+		if (ImGui::Button("Range Queries"))
+			benchmarkReport = Benchmark::RangeQueries();
+		if (ImGui::Button("Broadphase"))
+			benchmarkReport = Benchmark::Broadphase();
+		if (ImGui::Button("Broadphase Comparison"))
+			benchmarkReport = Benchmark::BroadphaseComparison();
+		if (ImGui::Button("Spatial Index Culling"))
+			benchmarkReport = Benchmark::SpatialIndexCulling(frustum);
+		if (ImGui::Button("Dynamic Entities"))
+			benchmarkReport = Benchmark::DynamicEntities(frustum);
+		if (ImGui::Button("Grid Queries"))
+			benchmarkReport = Benchmark::GridQueries();
+		if (ImGui::Button("Frustum Culling"))
+			benchmarkReport = Benchmark::FrustumCulling(frustum,
+				scene->GetCurrentCamera()->GetView(),
+				scene->GetCurrentCamera()->GetProjection());
+		if (ImGui::Button("Frustum Extraction"))
+			benchmarkReport = Benchmark::FrustumExtraction();
+		if (ImGui::Button("Frustum Tests"))
+			benchmarkReport = Benchmark::FrustumTests(frustum);
+		if (ImGui::Button("Culling Kernels"))
+			benchmarkReport = Benchmark::CullingKernels(frustum,
+				scene->GetCurrentCamera()->GetView(),
+				scene->GetCurrentCamera()->GetProjection());
+		if (ImGui::Button("Temporal Culling"))
+			benchmarkReport = Benchmark::TemporalCulling(recordedCameraPath);
+		if (ImGui::Button("Contribution Culling"))
+			benchmarkReport = Benchmark::ContributionCulling();
+		if (ImGui::Button("Parallel Build"))
+			benchmarkReport = Benchmark::ParallelBuild();
+		if (ImGui::Button("Morton Build"))
+			benchmarkReport = Benchmark::MortonBuild();
+		if (ImGui::Button("Transform Update"))
+			benchmarkReport = Benchmark::TransformUpdate();
+		if (ImGui::Button("Transform Hierarchy"))
+			benchmarkReport = Benchmark::TransformHierarchy();
+		if (ImGui::Button("Transform Operations"))
+			benchmarkReport = Benchmark::TransformOperations();
+		if (ImGui::Button("Normal Matrices"))
+			benchmarkReport = Benchmark::NormalMatrices();
+		if (ImGui::Button("Entity Bounds"))
+			benchmarkReport = Benchmark::EntityBounds();
+
+		if (!benchmarkReport.empty())
+			ImGui::TextUnformatted(benchmarkReport.c_str());
+
+		ImGui::TreePop();
+	}
 	if (scene->GetName() == "basicScene")
 	if (ImGui::TreeNode("Particle"))
 	{
@@ -594,193 +594,126 @@ namespace
 		}
 	}
 
-	std::vector<std::shared_ptr<Entity>> GetVisibleEntities(
-		std::vector<std::shared_ptr<Entity>> _entities,
-		std::shared_ptr<Octree::Node> octree,
-		Frustum frustum,
+	// Entity lists reused every frame so culling and sorting don't allocate
+	// (they only grow until they fit the largest visible set)
+	std::vector<Entity*> visibleEntities;
+	std::vector<Entity*> opaqueEntities;
+	std::vector<Entity*> transparentEntities;
+	std::vector<Entity*> shadowEntities;
+
+	void GetVisibleEntities(
+		Scene* scene,
+		Frustum& frustum,
+		std::vector<Entity*>& out,
+		FrustumTest test,
+		CullingCache* cache);
+	void GetVisibleEntities(std::shared_ptr<Scene> scene, std::vector<Entity*>& out);
+	unsigned int CullSmallEntities(
+		std::vector<Entity*>& entities,
 		DirectX::XMFLOAT4X4 view,
 		DirectX::XMFLOAT4X4 projection,
-		bool frustCull = true);
-	std::vector<std::shared_ptr<Entity>> GetVisibleEntities(std::shared_ptr<Scene> scene);
-	std::vector<std::shared_ptr<Entity>> GetVisibleEntities(std::shared_ptr<Scene> scene) 
+		float screenHeight,
+		float minSize);
+	void GetVisibleEntities(std::shared_ptr<Scene> scene, std::vector<Entity*>& out)
 	{ 
-		return GetVisibleEntities(
-			scene->GetEntities(),
-			scene->GetOctree(),
-			scene->GetCurrentCamera()->GetFrustum(),
-			scene->GetCurrentCamera()->GetView(),
-			scene->GetCurrentCamera()->GetProjection()
+		std::shared_ptr<Camera> camera = scene->GetCurrentCamera();
+		Frustum frustum = camera->GetFrustum();
+		GetVisibleEntities(
+			scene.get(),
+			frustum,
+			out,
+			cameraFrustumTest,
+			camera->GetCullingCache()
+			);
+		cameraSizeCulled = CullSmallEntities(
+			out,
+			camera->GetView(),
+			camera->GetProjection(),
+			(float)Window::Height(),
+			cameraMinScreenSize
 			);
 	}
-	std::vector<std::shared_ptr<Entity>> GetVisibleEntities(
-		std::vector<std::shared_ptr<Entity>> _entities,
-		std::shared_ptr<Octree::Node> octree,
-		Frustum frustum,
-		DirectX::XMFLOAT4X4 view,
-		DirectX::XMFLOAT4X4 proj,
-		bool frustCull)
+	void GetVisibleEntities(
+		Scene* scene,
+		Frustum& frustum,
+		std::vector<Entity*>& out,
+		FrustumTest test,
+		CullingCache* cache)
 	{
-		// Get Frustum (points) to check octree with
-		//Frustum frustum = scene->GetCurrentCamera()->GetFrustum();
-		DirectX::XMFLOAT3* pointsPtr = frustum.points;
-		std::vector<DirectX::XMFLOAT3> points;
-		points.assign(pointsPtr, pointsPtr + 8);
-
-		// Use Octree to get entities to check collision with
-		Octree::Node* octant = octree->GetContainingOctant(points);
-		if (!octant)
-			octant = octree.get();
-
-		//size_t initialNumEntities = scene->GetEntities().size();
-
-		std::vector<std::shared_ptr<Entity>> entities =
-			octant == nullptr ? _entities
-			: octant->GetRelevantEntities(frustum);
-
-		if (!frustCull)
-			return entities;
-		//size_t octreeEntities = entities.size();
-
-		// Example of frustum culling by creating a frustum out of planes and normals
-		// then checking if objects are within those faces
-		// https://learnopengl.com/Guest-Articles/2021/Scene/Frustum-Culling
-		/*
-		{
-			for (int i = entities.size() - 1; i >= 0; i--)
-			{
-				bool visible = true;
-				for (int j = 0; j < 6; j++)
-				{
-					if (!visible)
-						break;
-					if (!entities[i]->GetAABB().IntersectsPlane(frustum.normals[j]))
-						visible = false;
-				}
-				if(!visible)
-					entities.erase(entities.begin() + i);
-			}
-
-			return entities;
-		}
-		*/
-		
-		
-		// View Space Culling
-		// Example of frustum culling by using the camera's view and projection matrices
-		// instead of creating a Frustum object
-		// https://bruop.github.io/frustum_culling/
-		{
-			/*
-			// Get points to pass into octree traversal
-			{
-				// Get data to calculate a rough estimation of the frustum
-				DirectX::XMFLOAT3 pos = scene->GetCurrentCamera()->GetTransform()->GetPosition();
-				DirectX::XMFLOAT3 fwd = scene->GetCurrentCamera()->GetTransform()->GetForward();
-				DirectX::XMFLOAT3 right = scene->GetCurrentCamera()->GetTransform()->GetRight();
-				DirectX::XMFLOAT3 up = scene->GetCurrentCamera()->GetTransform()->GetUp();
-				float farClip = scene->GetCurrentCamera()->GetFarClip();
-				float fov = scene->GetCurrentCamera()->GetFieldOfView();
-				float aspectRatio = scene->GetCurrentCamera()->GetAspectRatio();
-				float farHeight = 2 * std::tan(fov / 2) * farClip;
-				float farWidth = farHeight * aspectRatio;
-
-				// Calculate Frustum (points)
-				// https://stackoverflow.com/questions/13665932/calculating-the-viewing-frustum-in-a-3d-space
-				std::vector<DirectX::XMFLOAT3> points;
-				points.push_back(pos); // Cam Position
-				DirectX::XMVECTOR posVec = DirectX::XMLoadFloat3(&pos); 
-
-				DirectX::XMVECTOR fwdVec = DirectX::XMLoadFloat3(&fwd);
-				fwdVec = DirectX::XMVectorScale(fwdVec, farClip);
-				DirectX::XMVECTOR farCenter = DirectX::XMVectorAdd(fwdVec, posVec); // Center of far clip plane
-
-				DirectX::XMVECTOR rightVec = DirectX::XMLoadFloat3(&right);
-				rightVec = DirectX::XMVectorScale(rightVec, farWidth / 2);
-
-				DirectX::XMVECTOR upVec = DirectX::XMLoadFloat3(&up);
-				upVec = DirectX::XMVectorScale(upVec, farHeight / 2);
-
-				DirectX::XMVECTOR farBottomLeft = DirectX::XMVectorSubtract( // Bottom left of far clip plane
-					DirectX::XMVectorSubtract(farCenter, upVec), rightVec );
-				points.push_back({});
-				DirectX::XMStoreFloat3(&points[1], farBottomLeft);
-
-				DirectX::XMVECTOR farTopRight = DirectX::XMVectorAdd( // Top Right of far clip plane
-					DirectX::XMVectorAdd(farCenter, upVec), rightVec);
-				points.push_back({});
-				DirectX::XMStoreFloat3(&points[2], farTopRight);
-
-				// Use Octree to get entities to check collision with
-				Octree::Node* octant = scene->GetOctree()->GetContainingOctant(points);
-				std::vector<std::shared_ptr<Entity>> entities = 
-					octant == nullptr ? scene->GetEntities() 
-					: octant->GetAllEntities();
-			}
-				*/
+		out.clear();
 
-			// Frustum culling
-			DirectX::XMMATRIX projMat = DirectX::XMLoadFloat4x4(&proj);
-			DirectX::XMMATRIX viewMat = DirectX::XMLoadFloat4x4(&view);
-			DirectX::XMMATRIX VP = DirectX::XMMatrixMultiply(viewMat, projMat);
+		// Whole nodes inside the frustum are taken without testing their entities,
+		// the rest have already had the fast plane test
+		scene->GetVisibleEntities(frustum, out, temporalCulling ? cache : nullptr);
+		if (test == FrustumTest::Fast)
+			return;
 
-			for (int index = (int)entities.size() - 1; index >= 0; index--)
-			{
-				// Use out min max to define four adjacent corners
-				AABB aabb = entities[index]->GetAABB();
-				const int Num_Corners = 9;
-				DirectX::XMFLOAT4 corners[Num_Corners] = {
-				{aabb.min.x, aabb.min.y, aabb.min.z, 1.0f}, // x y z //
-				{aabb.max.x, aabb.min.y, aabb.min.z, 1.0f}, // X y z //
-				{aabb.min.x, aabb.max.y, aabb.min.z, 1.0f}, // x Y z //
-				{aabb.max.x, aabb.max.y, aabb.min.z, 1.0f}, // X Y z
-														
-				{aabb.min.x, aabb.min.y, aabb.max.z, 1.0f}, // x y Z //
-				{aabb.max.x, aabb.min.y, aabb.max.z, 1.0f}, // X y Z
-				{aabb.min.x, aabb.max.y, aabb.max.z, 1.0f}, // x Y Z
-				{aabb.max.x, aabb.max.y, aabb.max.z, 1.0f}, // X Y Z
-
-				{(aabb.min.x + aabb.max.x) / 2, (aabb.min.y + aabb.max.y) / 2, (aabb.min.z + aabb.max.z) / 2, 1.0f}
-				};
-
-				bool inside = false;
-
-				// Transform corners
-				for (int c = 0; c < Num_Corners; c++)
-				{
-					if (inside)
-						break;
-
-					DirectX::XMVECTOR cornerVec = DirectX::XMLoadFloat4(&corners[c]);
-					cornerVec = DirectX::XMVector4Transform(cornerVec, VP);
-					DirectX::XMStoreFloat4(&corners[c], cornerVec);
-
-					// Check vertex against clip space bounds
-					inside = inside ||
-						within(-corners[c].w, corners[c].x, corners[c].w) &&
-						within(-corners[c].w, corners[c].y, corners[c].w) &&
-						within(0.0f, corners[c].z, corners[c].w);
-				}
-				if (inside)
-					continue;
-				else
-					entities.erase(entities.begin() + index);
+		// Drop the entities outside near the frustum's edges and corners
+		size_t kept = 0;
+		for (size_t e = 0; e < out.size(); e++)
+		{
+			if (frustum.Intersects(out[e]->GetAABB(), test))
+				out[kept++] = out[e];
+		}
+		out.resize(kept);
+	}
 
-			}
+	/// <summary>
+	/// Removes entities whose bounds project smaller than the threshold
+	/// </summary>
+	/// <param name="screenHeight">Height of the render target in pixels</param>
+	/// <param name="minSize">Smallest projected height in pixels to keep,
+	/// zero keeps everything</param>
+	/// <returns>How many entities were removed</returns>
+	unsigned int CullSmallEntities(
+		std::vector<Entity*>& entities,
+		DirectX::XMFLOAT4X4 view,
+		DirectX::XMFLOAT4X4 projection,
+		float screenHeight,
+		float minSize)
+	{
+		if (minSize <= 0.0f)
+			return 0;
 
-			//size_t frustumCullEntities = entities.size();
+		DirectX::XMFLOAT4X4 viewProjection;
+		DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(
+			DirectX::XMLoadFloat4x4(&view), DirectX::XMLoadFloat4x4(&projection)));
+		ScreenProjection screen = ScreenProjection::FromMatrices(viewProjection, projection, screenHeight);
 
-			return entities;
+		size_t kept = 0;
+		for (size_t e = 0; e < entities.size(); e++)
+		{
+			if (screen.GetSize(entities[e]->GetAABB()) >= minSize)
+				entities[kept++] = entities[e];
 		}
-		
+		unsigned int removed = (unsigned int)(entities.size() - kept);
+		entities.resize(kept);
+		return removed;
+	}
+
+	VSPerObjectData GetPerObjectData(Entity* entity);
+	/// <summary>
+	/// Fills the per object vertex shader data for an entity, with
+	/// WORLD_MATRIX_3X4 the shader makes the normal matrix itself
+	/// </summary>
+	VSPerObjectData GetPerObjectData(Entity* entity)
+	{
+		VSPerObjectData data = {};
+#ifdef WORLD_MATRIX_3X4
+		DirectX::XMFLOAT4X4 world = entity->GetTransform()->GetWorldMatrix();
+		DirectX::XMStoreFloat3x4(&data.world, DirectX::XMLoadFloat4x4(&world));
+#else
+		data.world = entity->GetTransform()->GetWorldMatrix();
+		data.worldInvTranspose = entity->GetTransform()->GetWorldInverseTransposeMatrix();
+#endif
+		return data;
 	}
 
-	void RenderShadowMaps(std::vector<std::shared_ptr<ShadowLight>>  shadowLights,
-		std::vector<std::shared_ptr<Entity>> entities,
-		std::shared_ptr<Octree::Node> octree,
+	void RenderShadowMaps(std::vector<std::shared_ptr<ShadowLight>>& shadowLights,
+		Scene* scene,
 		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> cmdList);
-	void RenderShadowMaps(std::vector<std::shared_ptr<ShadowLight>>  shadowLights,
-		std::vector<std::shared_ptr<Entity>> entities,
-		std::shared_ptr<Octree::Node> octree,
+	void RenderShadowMaps(std::vector<std::shared_ptr<ShadowLight>>& shadowLights,
+		Scene* scene,
 		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> cmdList)
 	{
 		if (shadowLights.size() == 0)
@@ -804,6 +737,7 @@ namespace
 		cmdList->SetGraphicsRootSignature(Assets::GetInstance().GetRootSig(L"RootSigs/ShadowMap").Get());
 		cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY::D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
+		shadowSizeCulled = 0;
 		for (std::shared_ptr<ShadowLight> light : shadowLights)
 		{
 			// Clearing the render target / depth buffer
@@ -848,17 +782,24 @@ namespace
 			cmdList->SetGraphicsRootDescriptorTable(0, vsPerFramehandle);
 
 			// Get Relevant entities
-			std::vector<std::shared_ptr<Entity>> toDraw = GetVisibleEntities(
-				entities,
-				octree,
-				light->GetFrustum(),
+			Frustum frustum = light->GetFrustum();
+			GetVisibleEntities(
+				scene,
+				frustum,
+				shadowEntities,
+				shadowFrustumTest,
+				light->GetCullingCache()
+			);
+			shadowSizeCulled += CullSmallEntities(
+				shadowEntities,
 				light->GetView(),
 				light->GetProjection(),
-				false
+				(float)light->GetResolution(),
+				shadowMinScreenSize
 			);
 
 			// Sort Entities by mesh
-			std::sort(toDraw.begin(), toDraw.end(), [](const auto& e1, const auto& e2)
+			std::sort(shadowEntities.begin(), shadowEntities.end(), [](const auto& e1, const auto& e2)
 				{
 					// Compare pointers to first mesh
 					return e1->GetMeshes()[0]->GetVertexBuffer() < e2->GetMeshes()[0]->GetVertexBuffer();
@@ -867,7 +808,7 @@ namespace
 			// Render Entities
 			std::shared_ptr<Mesh> currentMesh = 0;
 			std::shared_ptr<Material> currentMaterial = 0;
-			for (std::shared_ptr<Entity> entityPtr : toDraw)
+			for (Entity* entityPtr : shadowEntities)
 			{
 				for (int i = 0; i < entityPtr->GetMeshes().size(); i++)
 				{
@@ -894,9 +835,7 @@ namespace
 					}
 					// Per Object Data (Only Vertex right now)
 					{
-						VSPerObjectData vsData = {};
-						vsData.world = entityPtr->GetTransform()->GetWorldMatrix();
-						vsData.worldInvTranspose = entityPtr->GetTransform()->GetWorldInverseTransposeMatrix();
+						VSPerObjectData vsData = GetPerObjectData(entityPtr);
 						D3D12_GPU_DESCRIPTOR_HANDLE handle =
 							d3d12Helper.FillNextConstantBufferAndGetGPUDescriptorHandle((void*)(&vsData), sizeof(VSPerObjectData));
 						cmdList->SetGraphicsRootDescriptorTable(1, handle);
@@ -938,12 +877,14 @@ namespace
 	}
 
 
-	void SortOpaqueAndTransparent(std::vector<std::shared_ptr<Entity>> in, 
-		std::vector<std::shared_ptr<Entity>>& outOpaque, std::vector<std::shared_ptr<Entity>>& outTransparent);
-	void SortOpaqueAndTransparent(std::vector<std::shared_ptr<Entity>> in,
-		std::vector<std::shared_ptr<Entity>>& outOpaque, std::vector<std::shared_ptr<Entity>>& outTransparent)
+	void SortOpaqueAndTransparent(std::vector<Entity*>& in, 
+		std::vector<Entity*>& outOpaque, std::vector<Entity*>& outTransparent);
+	void SortOpaqueAndTransparent(std::vector<Entity*>& in,
+		std::vector<Entity*>& outOpaque, std::vector<Entity*>& outTransparent)
 	{
-		for (std::shared_ptr<Entity> ptr : in)
+		outOpaque.clear();
+		outTransparent.clear();
+		for (Entity* ptr : in)
 		{
 			switch (ptr->GetVisibility())
 			{
@@ -959,13 +900,13 @@ namespace
 		}
 	}
 
-	void DrawEntities(std::vector<std::shared_ptr<Entity>> entities,
+	void DrawEntities(std::vector<Entity*>& entities,
 		D3D12_GPU_DESCRIPTOR_HANDLE vsPerFramehandle,
 		D3D12_GPU_DESCRIPTOR_HANDLE psPerFrameHandle,
 		D3D12_GPU_DESCRIPTOR_HANDLE shadowHandle,
 		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> cmdList,
 		Visibility desiredVisibility = Visibility::Opaque);
-	void DrawEntities(std::vector<std::shared_ptr<Entity>> entities,
+	void DrawEntities(std::vector<Entity*>& entities,
 		D3D12_GPU_DESCRIPTOR_HANDLE vsPerFramehandle,
 		D3D12_GPU_DESCRIPTOR_HANDLE psPerFrameHandle,
 		D3D12_GPU_DESCRIPTOR_HANDLE shadowHandle,
@@ -983,7 +924,7 @@ namespace
 		std::shared_ptr<Material> currentMaterial = 0;
 		std::shared_ptr<Mesh> currentMesh = 0;
 
-		for (std::shared_ptr<Entity> entityPtr : entities)
+		for (Entity* entityPtr : entities)
 		{
 			assert(entityPtr->GetMeshes().size() == entityPtr->GetMaterials().size());
 
@@ -1056,9 +997,7 @@ namespace
 
 				// Per Object Data (Only Vertex right now)
 				{
-					VSPerObjectData vsData = {};
-					vsData.world = entityPtr->GetTransform()->GetWorldMatrix();
-					vsData.worldInvTranspose = entityPtr->GetTransform()->GetWorldInverseTransposeMatrix();
+					VSPerObjectData vsData = GetPerObjectData(entityPtr);
 					D3D12_GPU_DESCRIPTOR_HANDLE handle =
 						d3d12Helper.FillNextConstantBufferAndGetGPUDescriptorHandle((void*)(&vsData), sizeof(VSPerObjectData));
 					cmdList->SetGraphicsRootDescriptorTable(1, handle);
@@ -1117,9 +1056,7 @@ void Graphics::RenderSimple(std::shared_ptr<Scene> scene,
 				Graphics::commandList->SetGraphicsRootDescriptorTable(0, vsPerFramehandle);
 
 				// Fill out a VertexShaderExternalData struct with the entitys world matrix and the cameras matrices.
-				VSPerObjectData vsobjData = {};
-				vsobjData.world = entityPtr->GetTransform()->GetWorldMatrix();
-				vsobjData.worldInvTranspose = entityPtr->GetTransform()->GetWorldInverseTransposeMatrix();
+				VSPerObjectData vsobjData = GetPerObjectData(entityPtr.get());
 				// Use FillNextConstantBufferAndGetGPUDescriptorHandle() 
 				// to copy the above struct to the GPU and get back the corresponding handle to the constant buffer view.
 				D3D12_GPU_DESCRIPTOR_HANDLE vsPerObjhandle =
@@ -1245,10 +1182,8 @@ void Graphics::RenderOptimized(std::shared_ptr<Scene> scene, unsigned int active
 	D3D12Helper& d3d12Helper = D3D12Helper::GetInstance();
 
 	// Get the sorted renderable list
-	std::vector<std::shared_ptr<Entity>> toDraw = GetVisibleEntities(scene);
-	std::vector<std::shared_ptr<Entity>> opaqueEntities;
-	std::vector<std::shared_ptr<Entity>> transparentEntities;
-	SortOpaqueAndTransparent(toDraw, opaqueEntities, transparentEntities);
+	GetVisibleEntities(scene, visibleEntities);
+	SortOpaqueAndTransparent(visibleEntities, opaqueEntities, transparentEntities);
 
 	// Collect all per-frame data and copy to GPU
 	// -- VS
@@ -1292,8 +1227,7 @@ void Graphics::RenderOptimized(std::shared_ptr<Scene> scene, unsigned int active
 	if (scene->GetShadowLights().size() != 0)
 	{
 		RenderShadowMaps(scene->GetShadowLights(),
-			scene->GetEntities(),
-			scene->GetOctree(),
+			scene.get(),
 			commandList[0]);
 
 		shadowMapHandle = scene->GetShadowLights()[0]->GetGPUSRVHandle();
@@ -32,6 +32,20 @@ namespace Graphics
 	inline D3D12_VIEWPORT viewport;
 	inline D3D12_RECT scissorRect;
 
+	// How precisely entities are culled against the camera and shadow
+	// frusta, trading wasted draws against CPU time
+	inline FrustumTest cameraFrustumTest = FrustumTest::Fast;
+	inline FrustumTest shadowFrustumTest = FrustumTest::Fast;
+	// Whether each view reuses its last cull for entities that didn't move
+	inline bool temporalCulling = false;
+	// Entities fewer pixels tall than these on screen or in a shadow map
+	// aren't drawn there, zero draws everything that's in the frustum
+	inline float cameraMinScreenSize = 0.0f;
+	inline float shadowMinScreenSize = 0.0f;
+	// How many entities the size thresholds dropped last frame
+	inline unsigned int cameraSizeCulled = 0;
+	inline unsigned int shadowSizeCulled = 0;
+
 	// --- FUNCTIONS ---
 
 	// Getters
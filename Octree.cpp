@@ -1,10 +1,107 @@
 #include "Octree.h"
+#include "CullingCache.h"
+#include <algorithm>
+#include <future>
+
+namespace
+{
+    // Morton digit (x << 2 | y << 1 | z) to the child index used by CalculateOctantBounds
+    const int DigitToChild[NUM_CHILDREN] = { 0, 1, 4, 5, 3, 2, 7, 6 };
+    const int ChildToDigit[NUM_CHILDREN] = { 0, 1, 5, 4, 2, 3, 7, 6 };
+
+    // Spreads the low 21 bits of v so there are two zero bits between each
+    unsigned long long SpreadBits(unsigned long long v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffff;
+        v = (v | v << 16) & 0x1f0000ff0000ff;
+        v = (v | v << 8) & 0x100f00f00f00f00f;
+        v = (v | v << 4) & 0x10c30c30c30c30c3;
+        v = (v | v << 2) & 0x1249249249249249;
+        return v;
+    }
+
+    // Cell index of p along one axis of a grid with the given number of cells.
+    // Cells include their upper edge when quantizing the max corner of a box,
+    // matching the inclusive AABB::Contains.
+    unsigned int Quantize(float p, float min, float size, unsigned int cells, bool upper)
+    {
+        float t = (p - min) / size * cells;
+        if (upper)
+            t = std::ceil(t) - 1.0f;
+        if (t <= 0.0f)
+            return 0;
+        if (t >= (float)cells)
+            return cells - 1;
+        return (unsigned int)t;
+    }
+
+    // Doubles bounds by extending each axis by its size on the side aabb sticks out of looseBounds
+    AABB DoubleToward(AABB bounds, AABB looseBounds, AABB aabb)
+    {
+        DirectX::XMFLOAT3 dim = bounds.Dimensions();
+        if (aabb.min.x < looseBounds.min.x) bounds.min.x -= dim.x; else bounds.max.x += dim.x;
+        if (aabb.min.y < looseBounds.min.y) bounds.min.y -= dim.y; else bounds.max.y += dim.y;
+        if (aabb.min.z < looseBounds.min.z) bounds.min.z -= dim.z; else bounds.max.z += dim.z;
+        return bounds;
+    }
+
+    /// <summary>
+    /// Tests an entity against a ray, keeping the k nearest hits sorted.
+    /// Once there are k hits, maxDistance shrinks to the furthest of them.
+    /// </summary>
+    void RaycastEntity(Entity* entity, Ray& ray, unsigned int k, float& maxDistance,
+        std::vector<Octree::RayHit>& hits)
+    {
+        float tNear, tFar;
+        if (!entity->GetAABB().Intersects(ray, tNear, tFar) || tNear >= maxDistance)
+            return;
+
+        if (hits.size() == k)
+            hits.pop_back();
+        Octree::RayHit hit = { entity, tNear };
+        hits.insert(std::upper_bound(hits.begin(), hits.end(), hit,
+            [](const Octree::RayHit& a, const Octree::RayHit& b) { return a.t < b.t; }), hit);
+        if (hits.size() == k)
+            maxDistance = hits.back().t;
+    }
+
+    /// <summary>
+    /// Offers an entity to a k nearest search. out is a max heap on
+    /// distance, so its front is the furthest of the current k.
+    /// </summary>
+    void OfferNeighbor(Entity* entity, DirectX::XMFLOAT3& point, unsigned int k, float maxSqDistance,
+        std::vector<Octree::Neighbor>& out)
+    {
+        float sqDistance = entity->GetAABB().SqDistPointAABB(point);
+        if (sqDistance > maxSqDistance || (out.size() == k && sqDistance >= out.front().sqDistance))
+            return;
+
+        auto further = [](const Octree::Neighbor& a, const Octree::Neighbor& b) { return a.sqDistance < b.sqDistance; };
+        if (out.size() == k)
+        {
+            std::pop_heap(out.begin(), out.end(), further);
+            out.pop_back();
+        }
+        out.push_back({ entity, sqDistance });
+        std::push_heap(out.begin(), out.end(), further);
+    }
+
+    unsigned long long MortonCode(DirectX::XMFLOAT3 p, AABB& bounds, DirectX::XMFLOAT3 size,
+        unsigned int cells, bool upper)
+    {
+        return SpreadBits(Quantize(p.x, bounds.min.x, size.x, cells, upper)) << 2 |
+            SpreadBits(Quantize(p.y, bounds.min.y, size.y, cells, upper)) << 1 |
+            SpreadBits(Quantize(p.z, bounds.min.z, size.z, cells, upper));
+    }
+}
 
 
 //
 //  Constructors
 //
 Octree::Node::Node():
+    looseness(1.0f),
     parent(nullptr),
     children(),
     activeOctants(0x00),
@@ -14,31 +111,39 @@ Octree::Node::Node():
     bounds = AABB();
     bounds.min = DirectX::XMFLOAT3();
     bounds.max = DirectX::XMFLOAT3();
+    looseBounds = bounds;
 
     entities = std::vector<std::shared_ptr<Entity>>();
 }
 
 Octree::Node::Node(AABB _bounds) :
+    bounds(_bounds),
+    looseBounds(_bounds),
+    looseness(1.0f),
     parent(nullptr),
     children(),
     activeOctants(0x00),
     treeReady(false),
-    treeBuilt(false),
-    bounds(_bounds) 
+    treeBuilt(false)
 {
+    baseWidth = bounds.Dimensions().x;
     entities = std::vector<std::shared_ptr<Entity>>();
 }
 
 Octree::Node::Node(AABB _bounds, 
     std::vector<std::shared_ptr<Entity>> _entities,
-    Node* _parent) :
+    Node* _parent,
+    float _looseness) :
+    bounds(_bounds),
+    looseness(std::clamp(_looseness, 1.0f, MAX_LOOSENESS)),
     parent(_parent),
     children(),
     activeOctants(0x00),
     treeReady(false),
-    treeBuilt(false),
-    bounds(_bounds)
+    treeBuilt(false)
 {
+    looseBounds = CalculateLooseBounds(bounds, looseness);
+    baseWidth = bounds.Dimensions().x;
     entities = std::vector<std::shared_ptr<Entity>>();
     entities.insert(entities.end(), _entities.begin(), _entities.end());
 }
@@ -71,15 +176,28 @@ void Octree::Node::Clear()
     }
 
     // Clear this object
+    for (std::shared_ptr<Entity>& entity : entities)
+    {
+        if (entity->octreeNode == this)
+            entity->octreeNode = nullptr;
+    }
     entities.clear();
-    std::queue<std::shared_ptr<Entity>> empty;
-    std::swap(queue, empty);
+    cullBoundsDirty = true;
+    pending.clear();
+    movedEntities.clear();
+    pruneCandidates.clear();
+    if (overflow != nullptr)
+    {
+        delete overflow;
+        overflow = nullptr;
+    }
 
     treeBuilt = false;
     treeReady = false;
 
     bounds.min = DirectX::XMFLOAT3();
     bounds.max = DirectX::XMFLOAT3();
+    looseBounds = bounds;
 }
 
 //
@@ -87,29 +205,96 @@ void Octree::Node::Clear()
 //
 void Octree::Node::AddToPending(std::shared_ptr<Entity> _entity)
 {
-    queue.push(_entity);
+    // Not held by a node yet, so the index points into pending instead
+    _entity->octreeNode = nullptr;
+    _entity->octreeIndex = (unsigned int)pending.size();
+    pending.push_back(_entity);
 }
 void Octree::Node::ProcessPending()
 {
     if (!treeBuilt)
     {
         // Add objects to be sorted during Build
-        while (!queue.empty())
-        {
-            entities.push_back(queue.front());
-            queue.pop();
-        }
+        entities.insert(entities.end(), pending.begin(), pending.end());
+        pending.clear();
         Build();
     }
     else {
-        // Insert the objects
-        for (int i = 0, n = (int)queue.size(); i < n; i++)
+        // Insert the objects, keeping the ones that didn't fit to check again later
+        size_t kept = 0;
+        for (size_t i = 0, n = pending.size(); i < n; i++)
+        {
+            if (Insert(pending[i]))
+                continue;
+            pending[i]->octreeIndex = (unsigned int)kept;
+            if (kept != i)
+                pending[kept] = std::move(pending[i]);
+            kept++;
+        }
+        pending.resize(kept);
+    }
+}
+/// <summary>
+/// Queues an entity to be relocated by the next Update.
+/// Called by the entity the first time it moves each frame.
+/// </summary>
+/// <param name="_entity">An entity held by this node</param>
+void Octree::Node::MarkMoved(Entity* _entity)
+{
+    cullBoundsDirty = true;
+    std::vector<Entity*>& moved = GetRoot()->movedEntities;
+    _entity->movedIndex = (unsigned int)moved.size();
+    moved.push_back(_entity);
+}
+/// <summary>
+/// Removes an entity from the tree in constant time, using the
+/// entity's node and index instead of searching for it.
+/// Pending and moved entities are found through their indices too.
+/// </summary>
+/// <param name="_entity">The entity to remove</param>
+/// <returns>Whether the entity was in the tree or waiting to be added</returns>
+bool Octree::Node::Remove(Entity* _entity)
+{
+    Node* root = GetRoot();
+    Node* node = _entity->octreeNode;
+    if (node == nullptr)
+    {
+        // May still be waiting to be inserted
+        std::vector<std::shared_ptr<Entity>>& pending = root->pending;
+        unsigned int index = _entity->octreeIndex;
+        if (index >= pending.size() || pending[index].get() != _entity)
+            return false;
+        if (index + 1 < pending.size())
+        {
+            pending[index] = std::move(pending.back());
+            pending[index]->octreeIndex = index;
+        }
+        pending.pop_back();
+        return true;
+    }
+
+    node->Detach(_entity);
+
+    // A removed entity mustn't be relocated later
+    if (_entity->hasMoved)
+    {
+        std::vector<Entity*>& moved = root->movedEntities;
+        unsigned int index = _entity->movedIndex;
+        if (index < moved.size() && moved[index] == _entity)
         {
-            if (!Insert(queue.front())) // Didn't fit in the octree
-                queue.push(queue.front()); // Put back into queue to check again later
-            queue.pop();
+            if (index + 1 < moved.size())
+            {
+                moved[index] = moved.back();
+                moved[index]->movedIndex = index;
+            }
+            moved.pop_back();
         }
+        _entity->hasMoved = false;
     }
+
+    if (node->entities.size() == 0 && !node->HasChildren())
+        root->AddPruneCandidate(node);
+    return true;
 }
 
 //
@@ -117,6 +302,8 @@ void Octree::Node::ProcessPending()
 //
 bool Octree::Node::HasChildren() { return activeOctants != 0x00; }
 AABB Octree::Node::GetBounds() { return bounds; }
+AABB Octree::Node::GetLooseBounds() { return looseBounds; }
+float Octree::Node::GetLooseness() { return looseness; }
 std::vector<std::shared_ptr<Entity>> Octree::Node::GetEntities() { return entities; }
 std::vector<std::shared_ptr<Entity>> Octree::Node::GetAllEntities()
 {
@@ -140,6 +327,8 @@ std::vector<std::shared_ptr<Entity>> Octree::Node::GetAllEntities()
             }
         }
     }
+    if (overflow != nullptr)
+        final.insert(final.end(), overflow->entities.begin(), overflow->entities.end());
 
     return final;
 }
@@ -150,7 +339,7 @@ std::vector<std::shared_ptr<Entity>> Octree::Node::GetRelevantEntities(Frustum&
     bool within = true;
     for (int i = 0; i<6; i++)
     {
-        if (!this->bounds.IntersectsPlane(frustum.normals[i]))
+        if (!this->looseBounds.IntersectsPlane(frustum.normals[i]))
         {
             within = false;
             break;
@@ -178,10 +367,114 @@ std::vector<std::shared_ptr<Entity>> Octree::Node::GetRelevantEntities(Frustum&
         }
     }
 
+    // Overflowing entities have no node bounds to test
+    if (overflow != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+        {
+            bool visible = true;
+            AABB aabb = entityPtr->GetAABB();
+            for (int i = 0; i < 6 && visible; i++)
+                visible = aabb.IntersectsPlane(frustum.normals[i]);
+            if (visible)
+                final.push_back(entityPtr);
+        }
+    }
+
     return final;
 }
+/// <summary>
+/// Appends the entities of every node that intersects the frustum to out.
+/// Does not allocate unless out has to grow, and takes no references.
+/// </summary>
+/// <param name="frustum">The frustum to check against</param>
+/// <param name="out">Caller owned buffer, results are appended</param>
+void Octree::Node::GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    CullEntities(frustum, out, ALL_PLANES, false);
+    CullOverflow(frustum, out);
+}
+/// <summary>
+/// Appends the entities whose bounds intersect the frustum to out.
+/// Entities are only tested individually in nodes that straddle a plane.
+/// </summary>
+/// <param name="frustum">The frustum to check against</param>
+/// <param name="out">Caller owned buffer, results are appended</param>
+/// <param name="cache">This view's results from earlier frames, or null to test every entity afresh</param>
+void Octree::Node::GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out, CullingCache* cache)
+{
+    if (cache != nullptr)
+        cache->Begin(frustum);
+    CullEntities(frustum, out, ALL_PLANES, true, cache);
+    CullOverflow(frustum, out, cache);
+}
 Octree::Node** Octree::Node::GetChildren() { return children; }
 unsigned char Octree::Node::GetActiveOctants() { return activeOctants; }
+unsigned int Octree::Node::GetNodeCount()
+{
+    unsigned int count = 1;
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            count += children[i]->GetNodeCount();
+    }
+    return count;
+}
+size_t Octree::Node::GetOverflowCount() { return overflow == nullptr ? 0 : overflow->entities.size(); }
+/// <summary>
+/// Entities flagged as moved since the last Update, held by the root
+/// </summary>
+std::vector<Entity*>& Octree::Node::GetMovedEntities() { return GetRoot()->movedEntities; }
+/// <summary>
+/// Counts nodes and entities at each depth of the tree
+/// </summary>
+/// <param name="nodesPerDepth">Node count for each depth, grown as needed</param>
+/// <param name="entitiesPerDepth">Entity count for each depth, grown as needed</param>
+/// <param name="depth">Depth of this node</param>
+void Octree::Node::GetDepthStatistics(std::vector<unsigned int>& nodesPerDepth,
+    std::vector<unsigned int>& entitiesPerDepth,
+    unsigned int depth)
+{
+    if (nodesPerDepth.size() <= depth)
+        nodesPerDepth.resize(depth + 1, 0);
+    if (entitiesPerDepth.size() <= depth)
+        entitiesPerDepth.resize(depth + 1, 0);
+
+    nodesPerDepth[depth]++;
+    entitiesPerDepth[depth] += (unsigned int)entities.size();
+
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            children[i]->GetDepthStatistics(nodesPerDepth, entitiesPerDepth, depth + 1);
+    }
+}
+/// <summary>
+/// Approximate heap footprint of this node and its children (excluding the entities themselves)
+/// </summary>
+size_t Octree::Node::GetMemoryUsage()
+{
+    size_t bytes = sizeof(Node) +
+        entities.capacity() * sizeof(std::shared_ptr<Entity>) +
+        pending.capacity() * sizeof(std::shared_ptr<Entity>) +
+        movedEntities.capacity() * sizeof(Entity*) +
+        cullBounds.centerX.capacity() * 6 * sizeof(float) +
+        pruneCandidates.capacity() * sizeof(Node*);
+    if (overflow != nullptr)
+        bytes += overflow->GetMemoryUsage();
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            bytes += children[i]->GetMemoryUsage();
+    }
+    return bytes;
+}
 
 //
 //  Utility
@@ -195,7 +488,7 @@ unsigned char Octree::Node::GetActiveOctants() { return activeOctants; }
 Octree::Node* Octree::Node::GetContainingOctant(AABB aabb)
 {
     // Return null if this octant doesn't contain the box
-    if (!bounds.Contains(aabb))
+    if (!looseBounds.Contains(aabb))
         return nullptr;
 
     // Check Children
@@ -208,7 +501,7 @@ Octree::Node* Octree::Node::GetContainingOctant(AABB aabb)
             if (flags & (1 << 0) && children[i] != nullptr) // Child exists
             {
                 // If box is in child, search within that child
-                if (children[i]->bounds.Contains(aabb))
+                if (children[i]->looseBounds.Contains(aabb))
                     return children[i]->GetContainingOctant(aabb);
             }
         }
@@ -224,10 +517,21 @@ Octree::Node* Octree::Node::GetContainingOctant(AABB aabb)
 /// <param name="points">The points to check</param>
 /// <returns>The smallest octant that contains all the points</returns>
 Octree::Node* Octree::Node::GetContainingOctant(std::vector<DirectX::XMFLOAT3> points)
+{
+    return GetContainingOctant(points.data(), (unsigned int)points.size());
+}
+/// <summary>
+/// A recursive method that returns the smallest
+/// octant that contains the specified points
+/// </summary>
+/// <param name="points">The points to check</param>
+/// <param name="count">Number of points</param>
+/// <returns>The smallest octant that contains all the points</returns>
+Octree::Node* Octree::Node::GetContainingOctant(const DirectX::XMFLOAT3* points, unsigned int count)
 {
     // Return null if this octant doesn't contain all points
-    for(DirectX::XMFLOAT3 point : points)
-        if (!bounds.Contains(point))
+    for (unsigned int p = 0; p < count; p++)
+        if (!looseBounds.Contains(points[p]))
             return nullptr;
 
     // Check Children
@@ -241,14 +545,14 @@ Octree::Node* Octree::Node::GetContainingOctant(std::vector<DirectX::XMFLOAT3> p
             {
                 bool contained = true;
                 // If points in child, search within that child
-                for (DirectX::XMFLOAT3 point : points)
-                    if (contained && !children[i]->bounds.Contains(point))
+                for (unsigned int p = 0; p < count; p++)
+                    if (contained && !children[i]->looseBounds.Contains(points[p]))
                     {
                         contained = false;
                         break;
                     }
                 if(contained)
-                    return children[i]->GetContainingOctant(points);
+                    return children[i]->GetContainingOctant(points, count);
             }
         }
     }
@@ -260,15 +564,28 @@ Octree::Node* Octree::Node::GetContainingOctant(std::vector<DirectX::XMFLOAT3> p
 //
 //  Init
 //
-void Octree::Node::Build()
+/// <summary>
+/// Sorts this node's entities into child octants, recursively.
+/// With more than one thread, children of nodes holding at least
+/// parallelThreshold entities are built as separate tasks. The resulting
+/// tree is the same as a single threaded build.
+/// </summary>
+/// <param name="threadCount">Most threads the build may use</param>
+/// <param name="parallelThreshold">Fewest entities in a node before its children are forked</param>
+void Octree::Node::Build(unsigned int threadCount, size_t parallelThreshold)
 {
     // Already built
     if (treeBuilt || treeReady)
         return;
 
+    if (parent == nullptr)
+        GrowToFit();
+
     // Too few entities
-    if (entities.size() <= 1)
+    size_t entityCount = entities.size();
+    if (entityCount <= 1)
     {
+        HoldEntities();
         treeBuilt = true;
         treeReady = true;
         return;
@@ -278,6 +595,7 @@ void Octree::Node::Build()
     DirectX::XMFLOAT3 dim = bounds.Dimensions();
     if (dim.x < MIN_BOUNDS || dim.y < MIN_BOUNDS || dim.z < MIN_BOUNDS)
     {
+        HoldEntities();
         treeBuilt = true;
         treeReady = true;
         return;
@@ -294,14 +612,11 @@ void Octree::Node::Build()
     for (int i=0, length=(int)entities.size(); i<length; i++)
     {
         std::shared_ptr<Entity> entityPtr = entities[i];
-        for (int j = 0; j < NUM_CHILDREN; j++)
+        int octant = FindChildOctant(entityPtr->GetAABB(), octantBounds);
+        if (octant != -1)
         {
-            if (octantBounds[j].Contains(entityPtr->GetAABB()))
-            {
-                octEntities[j].push_back(entityPtr);
-                delStack.push(i);
-                break;
-            }
+            octEntities[octant].push_back(entityPtr);
+            delStack.push(i);
         }
     }
 
@@ -311,16 +626,47 @@ void Octree::Node::Build()
         entities.erase(entities.begin() + delStack.top());
         delStack.pop();
     }
+    HoldEntities();
 
     // Populate Octants
+    Node* toBuild[NUM_CHILDREN];
+    unsigned int childCount = 0;
     for (int i = 0; i < NUM_CHILDREN; i++)
     {
         if (octEntities[i].size() != 0) // Have entities to add
         {
-            children[i] = new Node(octantBounds[i], octEntities[i], this);
+            children[i] = new Node(octantBounds[i], octEntities[i], this, looseness);
             activeOctants ^= (1 << i);
-            children[i]->Build();
+            toBuild[childCount++] = children[i];
+        }
+    }
+
+    if (threadCount <= 1 || childCount <= 1 || entityCount < parallelThreshold)
+    {
+        for (unsigned int i = 0; i < childCount; i++)
+            toBuild[i]->Build();
+    }
+    else
+    {
+        // Split the children between at most threadCount tasks, and split
+        // the thread budget between those tasks. Every entity's AABB was
+        // computed above, so the tasks only read shared entity data.
+        unsigned int taskCount = threadCount < childCount ? threadCount : childCount;
+        unsigned int taskThreads = threadCount / taskCount;
+        std::vector<std::future<void>> tasks;
+        for (unsigned int t = 1; t < taskCount; t++)
+        {
+            tasks.push_back(std::async(std::launch::async,
+                [=]() {
+                    for (unsigned int i = t; i < childCount; i += taskCount)
+                        toBuild[i]->Build(taskThreads, parallelThreshold);
+                }));
         }
+        // This thread takes the first share
+        for (unsigned int i = 0; i < childCount; i += taskCount)
+            toBuild[i]->Build(taskThreads, parallelThreshold);
+        for (std::future<void>& task : tasks)
+            task.get();
     }
 
     // Set variables
@@ -328,120 +674,394 @@ void Octree::Node::Build()
     treeReady = true;
 }
 
-//
-// Update
-//
-void Octree::Node::Update()
+/// <summary>
+/// Bulk builds the tree from this node's entities using Morton codes.
+/// Each entity is given the deepest cell that contains it (its level) and
+/// that cell's Morton code, the entities are radix sorted by (code, level),
+/// and every node then owns one contiguous run of the sorted entities.
+/// The tree matches Build's node for node, only the order of entities
+/// within a node may differ.
+/// Loose trees fall back to Build, since their placement depends on size,
+/// and so do roots Build would subdivide deeper than MORTON_MAX_LEVEL.
+/// </summary>
+void Octree::Node::BuildMorton()
 {
-    // Add pending entities
-    if (queue.size() > 0)
-        ProcessPending();
-    if (treeBuilt && treeReady)
+    // Already built
+    if (treeBuilt || treeReady)
+        return;
+    if (parent == nullptr)
+        GrowToFit();
+    if (looseness > 1.0f)
+    {
+        Build();
+        return;
+    }
+
+    // Deepest level a node can be subdivided to, codes only have room for MORTON_MAX_LEVEL
+    unsigned int maxLevel = 0;
+    DirectX::XMFLOAT3 size = bounds.Dimensions();
+    DirectX::XMFLOAT3 dim = size;
+    while (dim.x >= MIN_BOUNDS && dim.y >= MIN_BOUNDS && dim.z >= MIN_BOUNDS)
     {
-        // Check if this node/octant should be deleted
-        if (entities.size() == 0)
+        if (maxLevel == MORTON_MAX_LEVEL)
         {
-            if (!HasChildren())
-            {
-                if (currentLifespan == -1) // initial check
-                    currentLifespan = MaxLifespan;
-                else if (currentLifespan > 0)
-                    currentLifespan--;
-            }
+            Build();
+            return;
         }
-        else {
-            if (currentLifespan != -1)
-            {
-                if (MaxLifespan <= 64)
-                    MaxLifespan <<= 2; // Extend lifespan if has objects
-                currentLifespan = -1;
-            }
+        dim.x *= 0.5f;
+        dim.y *= 0.5f;
+        dim.z *= 0.5f;
+        maxLevel++;
+    }
+    unsigned int cells = 1 << maxLevel;
+    unsigned int codeBits = 3 * maxLevel;
+
+    // Code and level of every entity
+    size_t count = entities.size();
+    std::vector<unsigned long long> codes(count);
+    std::vector<unsigned char> levels(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        AABB aabb = entities[i]->GetAABB();
+        if (maxLevel == 0 || !bounds.Contains(aabb))
+        {
+            // Stays in the root
+            codes[i] = 0;
+            levels[i] = 0;
+            continue;
         }
 
-        // Prune child nodes that should be deleted
-        if (HasChildren())
+        // A box with no size along an axis, lying on a cell boundary, fits
+        // the cells on both sides. Build gives it to the first child that
+        // contains it, which its corner codes can't tell, so walk down the
+        // same way Build does.
+        if (aabb.min.x == aabb.max.x || aabb.min.y == aabb.max.y || aabb.min.z == aabb.max.z)
         {
-            for (unsigned char flags = activeOctants, i = 0;
-                flags > 0;
-                flags >>= 1, i++)
+            AABB cell = bounds;
+            unsigned long long code = 0;
+            unsigned int level = 0;
+            while (level < maxLevel)
             {
-                if (flags & (1 << 0) && children[i] != nullptr && children[i]->currentLifespan == 0) // Marked for deletion
+                int child = -1;
+                for (int c = 0; c < NUM_CHILDREN && child == -1; c++)
                 {
-                    if (children[i]->entities.size() > 0) // Revive if has objects
-                        children[i]->currentLifespan = -1;
-                    else
-                    {
-                        children[i]->Clear();
-                        delete children[i];
-                        activeOctants ^= (1 << i);
-                    }
+                    if (CalculateOctantBounds(cell, Octant(1 << c)).Contains(aabb))
+                        child = c;
                 }
+                if (child == -1)
+                    break;
+                cell = CalculateOctantBounds(cell, Octant(1 << child));
+                level++;
+                code |= (unsigned long long)ChildToDigit[child] << (codeBits - 3 * level);
             }
+            codes[i] = code;
+            levels[i] = (unsigned char)level;
+            continue;
         }
 
-        // Remove Entities that don't exist anymore
-        //for (int i = 0, vectorSize = (int)entities.size(); i < vectorSize; i++)
-        //{
-        //    // TODO 
-        //    //if entity dead
-        //    {
-        //        entities.erase(entities.begin() + i);
-        //        i--;
-        //        vectorSize--;
-        //    }
-        //}
-
+        // Corners share a cell for as many levels as their codes share digits
+        unsigned long long minCode = MortonCode(aabb.min, bounds, size, cells, false);
+        unsigned long long maxCode = MortonCode(aabb.max, bounds, size, cells, true);
+        unsigned long long diff = minCode ^ maxCode;
+        unsigned int level = maxLevel;
+        if (diff != 0)
+        {
+            unsigned int highestBit = 63;
+            while (!(diff & (1ull << highestBit)))
+                highestBit--;
+            level = (codeBits - 1 - highestBit) / 3;
+        }
 
-        // Get Moved Object that were in this node previously
-        std::stack< int > movedEntities;
-        for (int i = 0, vectorSize = (int)entities.size(); i < vectorSize; i++)
+        // Guard against rounding, the cell must hold the box the same way Build checks it.
+        // Down to the entity's level its center has the same code as its min corner.
+        unsigned long long code = minCode;
+        while (level > 0)
         {
-            if (entities[i]->hasMoved)
+            AABB cell = bounds;
+            for (unsigned int l = 1; l <= level; l++)
             {
-                movedEntities.push(i);
+                unsigned int digit = (code >> (codeBits - 3 * l)) & 7;
+                cell = CalculateOctantBounds(cell, Octant(1 << DigitToChild[digit]));
             }
+            if (cell.Contains(aabb))
+                break;
+            level--;
         }
 
-        // Update Child Nodes
-        if (HasChildren())
+        // Only the digits down to the entity's cell matter
+        unsigned int unused = codeBits - 3 * level;
+        codes[i] = (code >> unused) << unused;
+        levels[i] = (unsigned char)level;
+    }
+
+    // Counting sort by level, then LSD radix sort by code (both stable)
+    std::vector<unsigned int> order(count);
+    std::vector<unsigned int> temp(count);
+    {
+        unsigned int offsets[MORTON_MAX_LEVEL + 2] = {};
+        for (size_t i = 0; i < count; i++)
+            offsets[levels[i] + 1]++;
+        for (int l = 1; l < MORTON_MAX_LEVEL + 2; l++)
+            offsets[l] += offsets[l - 1];
+        for (size_t i = 0; i < count; i++)
+            order[offsets[levels[i]]++] = (unsigned int)i;
+    }
+    for (unsigned int shift = 0; shift < codeBits; shift += 8)
+    {
+        unsigned int offsets[257] = {};
+        for (size_t i = 0; i < count; i++)
+            offsets[((codes[order[i]] >> shift) & 0xFF) + 1]++;
+        for (int b = 1; b < 257; b++)
+            offsets[b] += offsets[b - 1];
+        for (size_t i = 0; i < count; i++)
+            temp[offsets[(codes[order[i]] >> shift) & 0xFF]++] = order[i];
+        order.swap(temp);
+    }
+
+    // Put everything in sorted order
+    std::vector<std::shared_ptr<Entity>> sorted(count);
+    std::vector<unsigned long long> sortedCodes(count);
+    std::vector<unsigned char> sortedLevels(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        sorted[i] = std::move(entities[order[i]]);
+        sortedCodes[i] = codes[order[i]];
+        sortedLevels[i] = levels[order[i]];
+    }
+    entities.clear();
+
+    EmitMorton(sorted, sortedCodes, sortedLevels, 0, count, 0, maxLevel);
+}
+
+/// <summary>
+/// Finds the nearest entity whose bounds the ray hits
+/// </summary>
+/// <param name="ray">Ray to cast, t is measured in lengths of its direction</param>
+/// <param name="maxDistance">Furthest t to consider</param>
+/// <param name="hit">The nearest hit, if any</param>
+/// <returns>Whether anything was hit</returns>
+bool Octree::Node::Raycast(Ray ray, float maxDistance, RayHit& hit)
+{
+    std::vector<RayHit> hits;
+    hits.reserve(1);
+    Raycast(ray, maxDistance, 1, hits);
+    if (hits.size() == 0)
+        return false;
+    hit = hits[0];
+    return true;
+}
+/// <summary>
+/// Finds the k nearest entities whose bounds the ray hits. Children are
+/// visited front to back by where the ray enters them, and the search
+/// stops descending once a child starts beyond the k-th nearest hit.
+/// </summary>
+/// <param name="ray">Ray to cast, t is measured in lengths of its direction</param>
+/// <param name="maxDistance">Furthest t to consider</param>
+/// <param name="k">Most hits to return</param>
+/// <param name="hits">Cleared, then filled with the hits nearest first</param>
+void Octree::Node::Raycast(Ray ray, float maxDistance, unsigned int k, std::vector<RayHit>& hits)
+{
+    hits.clear();
+    if (k == 0)
+        return;
+
+    float tNear, tFar;
+    if (looseBounds.Intersects(ray, tNear, tFar) && tNear < maxDistance)
+        RaycastNode(ray, k, maxDistance, hits);
+
+    // Overflowing entities have no node bounds to test
+    if (overflow != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+            RaycastEntity(entityPtr.get(), ray, k, maxDistance, hits);
+    }
+}
+
+/// <summary>
+/// Appends every entity whose bounds touch the sphere to out
+/// </summary>
+/// <param name="center">Center of the sphere</param>
+/// <param name="radius">Radius of the sphere</param>
+/// <param name="out">Caller owned buffer, results are appended</param>
+void Octree::Node::QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<Entity*>& out)
+{
+    QuerySphereNode(center, radius, out);
+
+    // Overflowing entities have no node bounds to test
+    if (overflow != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+            if (entityPtr->GetAABB().Intersects(center, radius))
+                out.push_back(entityPtr.get());
+    }
+}
+/// <summary>
+/// Appends every entity whose bounds touch the box to out
+/// </summary>
+/// <param name="box">The box to search</param>
+/// <param name="out">Caller owned buffer, results are appended</param>
+void Octree::Node::QueryAABB(AABB box, std::vector<Entity*>& out)
+{
+    QueryAABBNode(box, out);
+
+    if (overflow != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+            if (entityPtr->GetAABB().Intersects(box))
+                out.push_back(entityPtr.get());
+    }
+}
+/// <summary>
+/// Finds the k entities with bounds nearest to a point. Nodes are searched
+/// best first from a queue ordered by their distance from the point, and
+/// the search ends once the nearest unsearched node is further than the
+/// k-th nearest entity found so far.
+/// </summary>
+/// <param name="point">The point to search from</param>
+/// <param name="k">Most entities to return</param>
+/// <param name="out">Cleared, then filled with the entities nearest first</param>
+/// <param name="maxDistance">Furthest an entity can be from the point</param>
+void Octree::Node::QueryKNearest(DirectX::XMFLOAT3 point, unsigned int k, std::vector<Neighbor>& out,
+    float maxDistance)
+{
+    out.clear();
+    if (k == 0)
+        return;
+    float maxSqDistance = maxDistance < FLT_MAX ? maxDistance * maxDistance : FLT_MAX;
+
+    if (overflow != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+            OfferNeighbor(entityPtr.get(), point, k, maxSqDistance, out);
+    }
+
+    // Min heap of nodes on their squared distance from the point
+    typedef std::pair<float, Node*> QueuedNode;
+    std::vector<QueuedNode> nodes;
+    nodes.reserve(64);
+    nodes.push_back({ looseBounds.SqDistPointAABB(point), this });
+    auto nearer = [](const QueuedNode& a, const QueuedNode& b) { return a.first > b.first; };
+
+    while (nodes.size() > 0)
+    {
+        std::pop_heap(nodes.begin(), nodes.end(), nearer);
+        QueuedNode nearest = nodes.back();
+        nodes.pop_back();
+
+        // Every remaining node is further than the current k
+        if (nearest.first > maxSqDistance ||
+            (out.size() == k && nearest.first >= out.front().sqDistance))
+            break;
+
+        Node* node = nearest.second;
+        for (const std::shared_ptr<Entity>& entityPtr : node->entities)
+            OfferNeighbor(entityPtr.get(), point, k, maxSqDistance, out);
+
+        for (unsigned char flags = node->activeOctants, i = 0;
+            flags > 0;
+            flags >>= 1, i++)
         {
-            for (unsigned char flags = activeOctants, i = 0;
-                flags > 0;
-                flags >>= 1, i++)
+            if (flags & (1 << 0) && node->children[i] != nullptr) // Child exists
             {
-                if (flags & (1 << 0) && children[i] != nullptr) // Active Child
+                float sqDistance = node->children[i]->looseBounds.SqDistPointAABB(point);
+                if (sqDistance <= maxSqDistance &&
+                    (out.size() < k || sqDistance < out.front().sqDistance))
                 {
-                    children[i]->Update();
+                    nodes.push_back({ sqDistance, node->children[i] });
+                    std::push_heap(nodes.begin(), nodes.end(), nearer);
                 }
             }
         }
+    }
 
-        // Move Moved Objects into new nodes
-        std::shared_ptr<Entity> movedEntity;
-        while(movedEntities.size() != 0)
-        {
-            movedEntity = entities[movedEntities.top()];
-            Node* current = this;
+    // Nearest first
+    std::sort_heap(out.begin(), out.end(),
+        [](const Neighbor& a, const Neighbor& b) { return a.sqDistance < b.sqDistance; });
+}
 
-            // Find region that contains this entity
-            while (!current->bounds.Contains(movedEntity->GetAABB()))
-            {
-                if (current->parent != nullptr)
-                    current = current->parent;
-                else
-                    break; // Root Node
-            }
+//
+// Update
+//
+/// <summary>
+/// Relocates only the entities that moved since the last Update, then
+/// advances the pruning of empty leaves. Called on the root.
+/// </summary>
+void Octree::Node::Update()
+{
+    if (!RelocateMoved())
+        return;
+    movedEntities.clear();
+
+    PruneCandidates();
+}
+/// <summary>
+/// Same as Update, and also finds every overlapping pair that involves
+/// an entity that moved. Each moved entity is searched for in the tree
+/// after relocating, so the cost scales with the number that moved.
+/// </summary>
+/// <param name="movedPairs">Cleared, then filled with the pairs</param>
+void Octree::Node::Update(std::vector<EntityPair>& movedPairs)
+{
+    movedPairs.clear();
+    if (!RelocateMoved())
+        return;
+
+    // Relocating cleared hasMoved, mark them again so pairs of
+    // two moved entities are only reported by one of them
+    for (Entity* entity : movedEntities)
+        entity->hasMoved = true;
+    for (Entity* entity : movedEntities)
+    {
+        AABB box = entity->GetAABB();
+        PairNode(entity, box, PairFilter::LaterIfMoved, movedPairs);
+        PairOverflow(entity, box, PairFilter::LaterIfMoved, movedPairs);
+    }
+    for (Entity* entity : movedEntities)
+        entity->hasMoved = false;
+    movedEntities.clear();
 
-            // Remove Object
-            entities.erase(entities.begin() + movedEntities.top());
-            movedEntities.pop();
+    PruneCandidates();
+}
+
+/// <summary>
+/// Finds every pair of entities whose bounds overlap, each pair once.
+/// Tight trees are walked once, testing each node's entities against
+/// each other and against the entities of its ancestors that overlap it.
+/// Loose trees search the tree for each entity instead, since entities
+/// in neighbouring loose nodes can overlap.
+/// </summary>
+/// <param name="out">Cleared, then filled with the pairs</param>
+void Octree::Node::GetCollisionPairs(std::vector<EntityPair>& out)
+{
+    out.clear();
+    if (!treeBuilt || !treeReady)
+        return;
 
-            // Insert into new node
-            movedEntity->hasMoved = false;
-            current->Insert(movedEntity);
+    if (looseness <= 1.0f)
+    {
+        std::vector<std::pair<Entity*, AABB>> stack;
+        stack.reserve(256);
+        CollectPairs(stack, 0, out);
+    }
+    else
+    {
+        std::vector<Entity*> all;
+        AppendAllEntities(all);
+        for (Entity* entity : all)
+        {
+            AABB box = entity->GetAABB();
+            PairNode(entity, box, PairFilter::Later, out);
+        }
+    }
 
-            // TODO
-            // Collision detection
+    // Overflowing entities aren't in any node's ancestors
+    if (overflow != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+        {
+            AABB box = entityPtr->GetAABB();
+            PairNode(entityPtr.get(), box, PairFilter::All, out);
+            PairOverflow(entityPtr.get(), box, PairFilter::Later, out);
         }
     }
 }
@@ -449,11 +1069,39 @@ void Octree::Node::Update()
 //
 //  Helper Functions
 //
+/// <summary>
+/// Adds pending entities and relocates the moved ones
+/// </summary>
+/// <returns>Whether the tree is built</returns>
+bool Octree::Node::RelocateMoved()
+{
+    // Add pending entities
+    if (pending.size() > 0)
+        ProcessPending();
+    if (!treeBuilt || !treeReady)
+        return false;
+
+    // Move moved objects into new nodes
+    for (Entity* entity : movedEntities)
+        Relocate(entity);
+    return true;
+}
+
 bool Octree::Node::Insert(std::shared_ptr<Entity> _entity)
 {
     // If object doesn't fit
-    if (!bounds.Contains(_entity->GetAABB()))
-        return parent == nullptr ? false : parent->Insert(_entity);
+    if (!looseBounds.Contains(_entity->GetAABB()))
+    {
+        if (parent != nullptr)
+            return parent->Insert(_entity);
+
+        // Expand the root toward it, or keep it aside if the root is too big
+        if (!Grow(_entity->GetAABB()))
+        {
+            AddToOverflow(_entity);
+            return true;
+        }
+    }
 
     // No Other Entities or Bounds Too Small
     // Insert into this Node
@@ -463,7 +1111,11 @@ bool Octree::Node::Insert(std::shared_ptr<Entity> _entity)
         dim.y < MIN_BOUNDS ||
         dim.z < MIN_BOUNDS)
     {
+        _entity->octreeNode = this;
+        _entity->octreeIndex = (unsigned int)entities.size();
+        _entity->hasMoved = false;
         entities.push_back(_entity);
+        cullBoundsDirty = true;
         return true;
     }
 
@@ -478,26 +1130,714 @@ bool Octree::Node::Insert(std::shared_ptr<Entity> _entity)
     }
 
     // Find Octant that fits entity entirely
-    for (int i = 0; i < NUM_CHILDREN; i++)
+    int i = FindChildOctant(_entity->GetAABB(), octantBounds);
+    if (i != -1)
     {
-        if (octantBounds[i].Contains(_entity->GetAABB()))
-            if (children[i] != nullptr)
-                return children[i]->Insert(_entity);
-            else {
-                // Create new Node
-                children[i] = new Node(octantBounds[i], { _entity }, this);
-                children[i]->Build();
-                activeOctants ^= (1 << i);
-                return true;
-            }
+        if (children[i] != nullptr)
+            return children[i]->Insert(_entity);
+
+        // Create new Node
+        children[i] = new Node(octantBounds[i], { _entity }, this, looseness);
+        children[i]->Build();
+        activeOctants ^= (1 << i);
+        return true;
     }
 
     // Can't fit in any child octant
+    _entity->octreeNode = this;
+    _entity->octreeIndex = (unsigned int)entities.size();
+    _entity->hasMoved = false;
     entities.push_back(_entity);
+    cullBoundsDirty = true;
     return true;
 }
 
+/// <summary>
+/// Points this node's entities back at it. Their placement used their
+/// current bounds, so any earlier moves are already accounted for.
+/// </summary>
+void Octree::Node::HoldEntities()
+{
+    for (unsigned int i = 0, n = (unsigned int)entities.size(); i < n; i++)
+    {
+        entities[i]->octreeNode = this;
+        entities[i]->octreeIndex = i;
+        entities[i]->hasMoved = false;
+    }
+    cullBoundsDirty = true;
+}
+
+/// <summary>
+/// Takes an entity out of this node by swapping the last entity into its place
+/// </summary>
+/// <param name="_entity">An entity held by this node</param>
+/// <returns>The node's reference to the entity</returns>
+std::shared_ptr<Entity> Octree::Node::Detach(Entity* _entity)
+{
+    unsigned int index = _entity->octreeIndex;
+    std::shared_ptr<Entity> entityPtr = std::move(entities[index]);
+    if (index + 1 < entities.size())
+    {
+        entities[index] = std::move(entities.back());
+        entities[index]->octreeIndex = index;
+    }
+    entities.pop_back();
+    cullBoundsDirty = true;
+    _entity->octreeNode = nullptr;
+    return entityPtr;
+}
+
+Octree::Node* Octree::Node::GetRoot()
+{
+    Node* root = this;
+    while (root->parent != nullptr)
+        root = root->parent;
+    return root;
+}
+
+/// <summary>
+/// Doubles the root toward a box until it contains it. Once built, the
+/// old root's contents become one octant of the new root, so nothing is
+/// reinserted and the root itself stays at the same address.
+/// </summary>
+/// <param name="aabb">The box to contain</param>
+/// <returns>False, leaving the root unchanged, if the box would need
+/// more than the MAX_ROOT_GROWTH doublings the root has left</returns>
+bool Octree::Node::Grow(AABB aabb)
+{
+    if (looseBounds.Contains(aabb))
+        return true;
+
+    // Doublings already used, measured from how far the root has grown
+    unsigned int used = 0;
+    for (float width = bounds.Dimensions().x;
+        width > baseWidth * 1.5f && used < MAX_ROOT_GROWTH;
+        width *= 0.5f)
+        used++;
+
+    // Count the doublings needed on copies, so a box that can't fit changes nothing
+    unsigned int needed = 0;
+    AABB planned = bounds;
+    AABB plannedLoose = looseBounds;
+    while (!plannedLoose.Contains(aabb))
+    {
+        if (used + needed >= MAX_ROOT_GROWTH)
+            return false;
+        planned = DoubleToward(planned, plannedLoose, aabb);
+        plannedLoose = CalculateLooseBounds(planned, looseness);
+        needed++;
+    }
+
+    for (unsigned int step = 0; step < needed; step++)
+    {
+        AABB grown = DoubleToward(bounds, looseBounds, aabb);
+
+        if (treeBuilt)
+        {
+            // Move this node's contents into a child with the old bounds
+            Node* old = new Node(bounds, {}, this, looseness);
+            old->entities.swap(entities);
+            cullBoundsDirty = true;
+            for (std::shared_ptr<Entity>& entity : old->entities)
+                entity->octreeNode = old;
+            for (int i = 0; i < NUM_CHILDREN; i++)
+            {
+                old->children[i] = children[i];
+                if (children[i] != nullptr)
+                    children[i]->parent = old;
+                children[i] = nullptr;
+            }
+            old->activeOctants = activeOctants;
+            old->treeBuilt = true;
+            old->treeReady = true;
+
+            bounds = grown;
+            looseBounds = CalculateLooseBounds(bounds, looseness);
+
+            DirectX::XMFLOAT3 oldCenter = old->bounds.Center();
+            for (int i = 0; i < NUM_CHILDREN; i++)
+            {
+                if (CalculateChildBounds(Octant(1 << i)).Contains(oldCenter))
+                {
+                    children[i] = old;
+                    activeOctants = (unsigned char)(1 << i);
+                    break;
+                }
+            }
+        }
+        else
+        {
+            bounds = grown;
+            looseBounds = CalculateLooseBounds(bounds, looseness);
+        }
+    }
+    return true;
+}
+
+/// <summary>
+/// Grows the root to contain every entity before building,
+/// moving any that are too far away to the overflow node
+/// </summary>
+void Octree::Node::GrowToFit()
+{
+    if (entities.size() == 0)
+        return;
+
+    // Grow once toward the bounds of all the entities
+    AABB all = entities[0]->GetAABB();
+    for (std::shared_ptr<Entity>& entity : entities)
+    {
+        AABB aabb = entity->GetAABB();
+        all.min = DirectX::XMFLOAT3(aabb.min.x < all.min.x ? aabb.min.x : all.min.x,
+            aabb.min.y < all.min.y ? aabb.min.y : all.min.y,
+            aabb.min.z < all.min.z ? aabb.min.z : all.min.z);
+        all.max = DirectX::XMFLOAT3(aabb.max.x > all.max.x ? aabb.max.x : all.max.x,
+            aabb.max.y > all.max.y ? aabb.max.y : all.max.y,
+            aabb.max.z > all.max.z ? aabb.max.z : all.max.z);
+    }
+    if (Grow(all))
+        return;
+
+    // Too far apart to contain them all, grow toward each one that still fits the budget
+    size_t kept = 0;
+    for (size_t i = 0, n = entities.size(); i < n; i++)
+    {
+        if (Grow(entities[i]->GetAABB()))
+            entities[kept++] = std::move(entities[i]);
+        else
+            AddToOverflow(std::move(entities[i]));
+    }
+    entities.resize(kept);
+    cullBoundsDirty = true;
+}
+
+/// <summary>
+/// Holds an entity outside the root's bounds. The overflow node isn't one
+/// of the root's children and its bounds contain nothing, so the entity
+/// is relocated through the root the next time it moves.
+/// </summary>
+void Octree::Node::AddToOverflow(std::shared_ptr<Entity> _entity)
+{
+    if (overflow == nullptr)
+    {
+        AABB empty;
+        empty.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+        empty.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        overflow = new Node(empty, {}, this, 1.0f);
+        overflow->looseBounds = empty;
+        overflow->treeBuilt = true;
+        overflow->treeReady = true;
+    }
+    _entity->octreeNode = overflow;
+    _entity->octreeIndex = (unsigned int)overflow->entities.size();
+    _entity->hasMoved = false;
+    overflow->entities.push_back(_entity);
+    overflow->cullBoundsDirty = true;
+}
+
+/// <summary>
+/// Appends the overflowing entities that intersect the frustum to out
+/// </summary>
+void Octree::Node::CullOverflow(Frustum& frustum, std::vector<Entity*>& out, CullingCache* cache)
+{
+    if (overflow == nullptr)
+        return;
+    if (cache == nullptr)
+    {
+        overflow->CullEntityBounds(frustum, ALL_PLANES, out);
+        return;
+    }
+    for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+    {
+        if (cache->IsVisible(entityPtr.get(), frustum, ALL_PLANES))
+            out.push_back(entityPtr.get());
+    }
+}
+
+/// <summary>
+/// Appends this node's entities that intersect the planes in planeMask,
+/// testing them in batches with the culling kernel. The bounds are
+/// refilled first if entities were added, removed or moved.
+/// </summary>
+void Octree::Node::CullEntityBounds(Frustum& frustum, unsigned char planeMask, std::vector<Entity*>& out)
+{
+    if (cullBoundsDirty)
+    {
+        // Moved entities can move again before Update without telling
+        // this node, so keep refilling until they've been relocated
+        bool anyMoved = false;
+        cullBounds.Resize(entities.size());
+        for (size_t i = 0; i < entities.size(); i++)
+        {
+            cullBounds.Set(i, entities[i]->GetAABB());
+            anyMoved = anyMoved || entities[i]->hasMoved;
+        }
+        cullBoundsDirty = anyMoved;
+    }
+
+    unsigned int visible[CULLING_BATCH_SIZE];
+    for (unsigned int first = 0, n = (unsigned int)entities.size(); first < n; first += CULLING_BATCH_SIZE)
+    {
+        unsigned int count = n - first < CULLING_BATCH_SIZE ? n - first : CULLING_BATCH_SIZE;
+        unsigned int visibleCount = Culling::Cull(frustum, cullBounds, first, count, planeMask, visible);
+        for (unsigned int v = 0; v < visibleCount; v++)
+            out.push_back(entities[visible[v]].get());
+    }
+}
+
+/// <summary>
+/// Moves an entity from its node to the smallest node that now contains it
+/// </summary>
+/// <param name="_entity">An entity that moved since the last Update</param>
+void Octree::Node::Relocate(Entity* _entity)
+{
+    Node* node = _entity->octreeNode;
+    if (node == nullptr) // No longer in the tree
+        return;
+
+    // Still fits and has nowhere deeper to go
+    AABB aabb = _entity->GetAABB();
+    if (node->looseBounds.Contains(aabb) && !node->HasChildren() && node->entities.size() == 1)
+    {
+        _entity->hasMoved = false;
+        return;
+    }
+
+    // Remove from the old node
+    std::shared_ptr<Entity> entityPtr = node->Detach(_entity);
+
+    // Find region that contains this entity
+    Node* current = node;
+    while (!current->looseBounds.Contains(aabb) && current->parent != nullptr)
+        current = current->parent;
+
+    // Insert into new node
+    current->Insert(entityPtr);
+
+    if (node->entities.size() == 0 && !node->HasChildren())
+        AddPruneCandidate(node);
+}
+
+/// <summary>
+/// Starts an empty leaf's countdown to deletion
+/// </summary>
+void Octree::Node::AddPruneCandidate(Node* node)
+{
+    if (node->parent == nullptr || node == overflow || node->currentLifespan != -1)
+        return;
+    node->currentLifespan = node->MaxLifespan;
+    pruneCandidates.push_back(node);
+}
+
+/// <summary>
+/// Counts down every empty leaf, deleting those that stayed empty for their
+/// lifespan and reviving those that gained entities or children. Leaves that
+/// are revived get a longer lifespan, so busy regions aren't repeatedly rebuilt.
+/// </summary>
+void Octree::Node::PruneCandidates()
+{
+    for (size_t i = 0; i < pruneCandidates.size();)
+    {
+        Node* node = pruneCandidates[i];
+        if (node->entities.size() > 0 || node->HasChildren())
+        {
+            // Revive
+            if (node->MaxLifespan <= 64)
+                node->MaxLifespan <<= 2; // Extend lifespan if has objects
+            node->currentLifespan = -1;
+        }
+        else if (--node->currentLifespan > 0)
+        {
+            i++;
+            continue;
+        }
+        else
+        {
+            // Delete, which may leave the parent as an empty leaf
+            Node* parent = node->parent;
+            for (int c = 0; c < NUM_CHILDREN; c++)
+            {
+                if (parent->children[c] == node)
+                {
+                    parent->children[c] = nullptr;
+                    parent->activeOctants ^= (1 << c);
+                }
+            }
+            delete node;
+            if (parent->entities.size() == 0 && !parent->HasChildren())
+                AddPruneCandidate(parent);
+        }
+
+        // Remove from the candidates
+        pruneCandidates[i] = pruneCandidates.back();
+        pruneCandidates.pop_back();
+    }
+}
+
+
 AABB Octree::Node::CalculateChildBounds(Octant octant)
+{
+    return CalculateOctantBounds(bounds, octant);
+}
+
+/// <summary>
+/// Frustum traversal that remembers which planes this node is fully inside of,
+/// so children only test the planes their parent straddled
+/// </summary>
+/// <param name="frustum">The frustum to check against</param>
+/// <param name="out">Caller owned buffer, results are appended</param>
+/// <param name="planeMask">Bit i set if plane i still needs testing</param>
+/// <param name="testEntities">Whether to test entities in straddling nodes</param>
+/// <param name="cache">Reuses or reorders entity tests, when not null</param>
+void Octree::Node::CullEntities(Frustum& frustum, std::vector<Entity*>& out,
+    unsigned char planeMask, bool testEntities, CullingCache* cache)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (!(planeMask & (1 << i)))
+            continue;
+
+        PlaneSide side = looseBounds.ClassifyPlane(frustum.normals[i]);
+        if (side == PlaneSide::Outside)
+            return;
+        if (side == PlaneSide::Inside)
+            planeMask &= ~(1 << i);
+    }
+
+    // Get current node entities
+    if (planeMask == 0 || !testEntities)
+    {
+        // Fully inside, nothing left to test
+        for (const std::shared_ptr<Entity>& entityPtr : entities)
+            out.push_back(entityPtr.get());
+    }
+    else if (cache != nullptr)
+    {
+        for (const std::shared_ptr<Entity>& entityPtr : entities)
+        {
+            if (cache->IsVisible(entityPtr.get(), frustum, planeMask))
+                out.push_back(entityPtr.get());
+        }
+    }
+    else
+    {
+        // Test entities against the planes this node straddles
+        CullEntityBounds(frustum, planeMask, out);
+    }
+
+    // Get child node entities
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            children[i]->CullEntities(frustum, out, planeMask, testEntities, cache);
+    }
+}
+
+/// <summary>
+/// Creates this node and its children from a sorted run of entities
+/// </summary>
+/// <param name="sorted">Entities sorted by (code, level)</param>
+/// <param name="codes">Each entity's Morton code, cut off below its level</param>
+/// <param name="levels">Depth of the deepest cell containing each entity</param>
+/// <param name="first">Start of this node's run</param>
+/// <param name="last">End of this node's run</param>
+/// <param name="depth">Depth of this node</param>
+/// <param name="maxLevel">Deepest level a node can be subdivided to</param>
+void Octree::Node::EmitMorton(std::vector<std::shared_ptr<Entity>>& sorted,
+    std::vector<unsigned long long>& codes,
+    std::vector<unsigned char>& levels,
+    size_t first, size_t last,
+    unsigned int depth, unsigned int maxLevel)
+{
+    treeBuilt = true;
+    treeReady = true;
+
+    // Too few entities or too small, same as Build
+    DirectX::XMFLOAT3 dim = bounds.Dimensions();
+    if (last - first <= 1 ||
+        depth >= maxLevel ||
+        dim.x < MIN_BOUNDS ||
+        dim.y < MIN_BOUNDS ||
+        dim.z < MIN_BOUNDS)
+    {
+        entities.assign(sorted.begin() + first, sorted.begin() + last);
+        HoldEntities();
+        return;
+    }
+
+    // Entities whose cell is this node sort first
+    size_t own = first;
+    while (own < last && levels[own] == depth)
+        own++;
+    entities.assign(sorted.begin() + first, sorted.begin() + own);
+    HoldEntities();
+
+    // The rest are grouped by their digit at the next level
+    unsigned int shift = 3 * (maxLevel - depth - 1);
+    size_t start = own;
+    while (start < last)
+    {
+        unsigned long long digit = (codes[start] >> shift) & 7;
+        size_t end = std::partition_point(codes.begin() + start, codes.begin() + last,
+            [=](unsigned long long code) { return ((code >> shift) & 7) == digit; }) - codes.begin();
+
+        int i = DigitToChild[digit];
+        children[i] = new Node(CalculateChildBounds(Octant(1 << i)), {}, this, looseness);
+        activeOctants ^= (1 << i);
+        children[i]->EmitMorton(sorted, codes, levels, start, end, depth + 1, maxLevel);
+        start = end;
+    }
+}
+
+void Octree::Node::RaycastNode(Ray& ray, unsigned int k, float& maxDistance, std::vector<RayHit>& hits)
+{
+    // Entities here straddle the children, so they're always tested
+    for (const std::shared_ptr<Entity>& entityPtr : entities)
+        RaycastEntity(entityPtr.get(), ray, k, maxDistance, hits);
+
+    // Sort the children the ray hits by where it enters them
+    Node* order[NUM_CHILDREN];
+    float entry[NUM_CHILDREN];
+    int count = 0;
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        float tNear, tFar;
+        if (flags & (1 << 0) && children[i] != nullptr && // Child exists
+            children[i]->looseBounds.Intersects(ray, tNear, tFar) && tNear < maxDistance)
+        {
+            int j = count++;
+            for (; j > 0 && entry[j - 1] > tNear; j--)
+            {
+                order[j] = order[j - 1];
+                entry[j] = entry[j - 1];
+            }
+            order[j] = children[i];
+            entry[j] = tNear;
+        }
+    }
+
+    // Nearest first, later children can't beat a closer hit
+    for (int i = 0; i < count && entry[i] < maxDistance; i++)
+        order[i]->RaycastNode(ray, k, maxDistance, hits);
+}
+
+void Octree::Node::QuerySphereNode(DirectX::XMFLOAT3& center, float radius, std::vector<Entity*>& out)
+{
+    if (!looseBounds.Intersects(center, radius))
+        return;
+
+    // Fully inside the sphere, nothing left to test
+    if (looseBounds.SqMaxDistPointAABB(center) <= radius * radius)
+    {
+        AppendAllEntities(out);
+        return;
+    }
+
+    for (const std::shared_ptr<Entity>& entityPtr : entities)
+        if (entityPtr->GetAABB().Intersects(center, radius))
+            out.push_back(entityPtr.get());
+
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            children[i]->QuerySphereNode(center, radius, out);
+    }
+}
+
+void Octree::Node::QueryAABBNode(AABB& box, std::vector<Entity*>& out)
+{
+    if (!looseBounds.Intersects(box))
+        return;
+
+    // Fully inside the box, nothing left to test
+    if (box.Contains(looseBounds))
+    {
+        AppendAllEntities(out);
+        return;
+    }
+
+    for (const std::shared_ptr<Entity>& entityPtr : entities)
+        if (entityPtr->GetAABB().Intersects(box))
+            out.push_back(entityPtr.get());
+
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            children[i]->QueryAABBNode(box, out);
+    }
+}
+
+/// <summary>
+/// Pairs this node's entities with each other and with the ancestor
+/// entities in stack[first, end), then recurses with the entities
+/// overlapping each child copied to the end of the stack
+/// </summary>
+void Octree::Node::CollectPairs(std::vector<std::pair<Entity*, AABB>>& stack, size_t first,
+    std::vector<EntityPair>& out)
+{
+    for (const std::shared_ptr<Entity>& entityPtr : entities)
+    {
+        AABB box = entityPtr->GetAABB();
+        for (size_t i = first; i < stack.size(); i++)
+        {
+            if (box.Overlaps(stack[i].second))
+                out.push_back({ stack[i].first, entityPtr.get() });
+        }
+        stack.push_back({ entityPtr.get(), box });
+    }
+    size_t end = stack.size();
+
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+        {
+            // Only entities reaching into the child can overlap its entities
+            AABB childBounds = children[i]->looseBounds;
+            for (size_t s = first; s < end; s++)
+            {
+                if (childBounds.Intersects(stack[s].second))
+                {
+                    std::pair<Entity*, AABB> reaching = stack[s];
+                    stack.push_back(reaching);
+                }
+            }
+            children[i]->CollectPairs(stack, end, out);
+            stack.resize(end);
+        }
+    }
+}
+
+/// <summary>
+/// Appends a pair for each entity in this subtree that overlaps box
+/// </summary>
+void Octree::Node::PairNode(Entity* entity, AABB& box, PairFilter filter, std::vector<EntityPair>& out)
+{
+    if (!looseBounds.Intersects(box))
+        return;
+
+    for (const std::shared_ptr<Entity>& entityPtr : entities)
+    {
+        Entity* partner = entityPtr.get();
+        if (partner == entity ||
+            (filter == PairFilter::Later && partner < entity) ||
+            (filter == PairFilter::LaterIfMoved && partner->hasMoved && partner < entity))
+            continue;
+        if (box.Overlaps(partner->GetAABB()))
+            out.push_back({ entity, partner });
+    }
+
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            children[i]->PairNode(entity, box, filter, out);
+    }
+}
+
+/// <summary>
+/// Appends a pair for each overflowing entity that overlaps box
+/// </summary>
+void Octree::Node::PairOverflow(Entity* entity, AABB& box, PairFilter filter, std::vector<EntityPair>& out)
+{
+    if (overflow == nullptr)
+        return;
+
+    for (const std::shared_ptr<Entity>& entityPtr : overflow->entities)
+    {
+        Entity* partner = entityPtr.get();
+        if (partner == entity ||
+            (filter == PairFilter::Later && partner < entity) ||
+            (filter == PairFilter::LaterIfMoved && partner->hasMoved && partner < entity))
+            continue;
+        if (box.Overlaps(partner->GetAABB()))
+            out.push_back({ entity, partner });
+    }
+}
+
+void Octree::Node::AppendAllEntities(std::vector<Entity*>& out)
+{
+    for (const std::shared_ptr<Entity>& entityPtr : entities)
+        out.push_back(entityPtr.get());
+
+    for (unsigned char flags = activeOctants, i = 0;
+        flags > 0;
+        flags >>= 1, i++)
+    {
+        if (flags & (1 << 0) && children[i] != nullptr) // Child exists
+            children[i]->AppendAllEntities(out);
+    }
+}
+
+/// <summary>
+/// Finds the child octant an entity belongs in
+/// </summary>
+/// <param name="aabb">The entity's bounds</param>
+/// <param name="octantBounds">The (tight) bounds of each child octant</param>
+/// <returns>Index of the octant, or -1 if it must stay in this node</returns>
+int Octree::Node::FindChildOctant(AABB aabb, AABB octantBounds[NUM_CHILDREN])
+{
+    // Tight, the first octant that fully contains the box
+    if (looseness <= 1.0f)
+    {
+        for (int i = 0; i < NUM_CHILDREN; i++)
+            if (octantBounds[i].Contains(aabb))
+                return i;
+        return -1;
+    }
+
+    // Loose, only the octant holding the center is a candidate
+    DirectX::XMFLOAT3 center = aabb.Center();
+    for (int i = 0; i < NUM_CHILDREN; i++)
+    {
+        if (octantBounds[i].Contains(center))
+            return CalculateLooseBounds(octantBounds[i], looseness).Contains(aabb) ? i : -1;
+    }
+    return -1;
+}
+
+/// <summary>
+/// Scales a box about its center
+/// </summary>
+/// <param name="bounds">The box to scale</param>
+/// <param name="looseness">Scale factor, 1 returns the same box</param>
+/// <returns>The scaled box</returns>
+AABB Octree::CalculateLooseBounds(AABB bounds, float looseness)
+{
+    // Rebuilding the box from its center can round it smaller, so
+    // a tight node wouldn't hold a box its parent thinks fits it
+    if (looseness <= 1.0f)
+        return bounds;
+
+    DirectX::XMFLOAT3 center = bounds.Center();
+    DirectX::XMFLOAT3 half = bounds.Dimensions();
+    half.x *= 0.5f * looseness;
+    half.y *= 0.5f * looseness;
+    half.z *= 0.5f * looseness;
+
+    AABB out;
+    out.min = DirectX::XMFLOAT3(center.x - half.x, center.y - half.y, center.z - half.z);
+    out.max = DirectX::XMFLOAT3(center.x + half.x, center.y + half.y, center.z + half.z);
+    return out;
+}
+
+/// <summary>
+/// Calculates the bounds of one octant of a box
+/// </summary>
+/// <param name="bounds">The box being divided</param>
+/// <param name="octant">Which eighth of the box to return</param>
+/// <returns>The bounds of the octant</returns>
+AABB Octree::CalculateOctantBounds(AABB bounds, Octant octant)
 {
     DirectX::XMFLOAT3 center = bounds.Center();
 
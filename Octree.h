@@ -2,11 +2,20 @@
 
 #define NUM_CHILDREN 8
 #define MIN_BOUNDS 0.5
-
+#define MAX_LOOSENESS 4.0f
+#define ALL_PLANES 0x3F
+#define PARALLEL_BUILD_THRESHOLD 4096
+#define MORTON_MAX_LEVEL 21 // 3 bits per level in a 63-bit code
+#define MORTON_BUILD_THRESHOLD 10000
+#define MAX_ROOT_GROWTH 8 // Doublings of the root before entities overflow
+
+#include <cfloat>
 #include <vector>
-#include <queue>
 #include <stack>
 #include "Entity.h"
+#include "CullingKernel.h"
+
+class CullingCache;
 
 // https://www.youtube.com/watch?v=L6aYpPAvalI&list=PLysLvOneEETPlOI_PI4mJnocqIpr2cSHS&index=26
 // https://github.dev/Cascioli-IGM/106-personal-repo-bpe4955
@@ -23,9 +32,42 @@ namespace Octree
 		O8 = 0x80,	// 0b10000000
 	};
 
+	// An entity hit by a ray, and the distance along the ray to its bounds
+	struct RayHit
+	{
+		Entity* entity;
+		float t;
+	};
+
+	// An entity found by a nearest neighbour search, and its squared
+	// distance from the search point (0 if the point is inside its bounds)
+	struct Neighbor
+	{
+		Entity* entity;
+		float sqDistance;
+	};
+
+	// Two entities whose bounds overlap
+	struct EntityPair
+	{
+		Entity* a;
+		Entity* b;
+	};
+
+	// Bounds of one eighth of a box
+	AABB CalculateOctantBounds(AABB bounds, Octant octant);
+	// A box scaled about its center
+	AABB CalculateLooseBounds(AABB bounds, float looseness);
+
 	/// <summary>
 	/// A node that can have eight child nodes that divide its 3D space. 
 	/// It can hold data or give data to its children to hold.
+	/// With a looseness above 1 each node accepts entities within its bounds
+	/// scaled by that factor, and entities are placed by their center so
+	/// they sink to a depth set by their size instead of sticking to the
+	/// first node they straddle.
+	/// The root doubles toward entities that leave it, up to MAX_ROOT_GROWTH
+	/// times, and holds any beyond that in an overflow node that is still culled.
 	/// </summary>
 	class Node {
 	public:
@@ -34,7 +76,8 @@ namespace Octree
 		Node(AABB _bounds);
 		Node(AABB _bounds, 
 			std::vector<std::shared_ptr<Entity>> _entities,
-			Node* _parent = nullptr);
+			Node* _parent = nullptr,
+			float _looseness = 1.0f);
 
 		// Destructors
 		~Node();
@@ -43,23 +86,47 @@ namespace Octree
 		// Modifiers
 		void AddToPending(std::shared_ptr<Entity> _entity);
 		void ProcessPending();
+		void MarkMoved(Entity* _entity);
+		bool Remove(Entity* _entity);
 
 		// Getters
 		bool HasChildren();
 		AABB GetBounds();
+		AABB GetLooseBounds();
+		float GetLooseness();
 		std::vector<std::shared_ptr<Entity>> GetEntities();
 		std::vector<std::shared_ptr<Entity>> GetAllEntities();
 		std::vector<std::shared_ptr<Entity>> GetRelevantEntities(Frustum& frustum);
+		void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out);
+		void GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out, CullingCache* cache = nullptr);
 		Octree::Node** GetChildren();
 		unsigned char GetActiveOctants();
+		unsigned int GetNodeCount();
+		size_t GetOverflowCount();
+		std::vector<Entity*>& GetMovedEntities();
+		size_t GetMemoryUsage();
+		void GetDepthStatistics(std::vector<unsigned int>& nodesPerDepth,
+			std::vector<unsigned int>& entitiesPerDepth,
+			unsigned int depth = 0);
 
 		// Utility
 		Octree::Node* GetContainingOctant(AABB aabb);
 		Octree::Node* GetContainingOctant(std::vector<DirectX::XMFLOAT3> points);
+		Octree::Node* GetContainingOctant(const DirectX::XMFLOAT3* points, unsigned int count);
+		bool Raycast(Ray ray, float maxDistance, RayHit& hit);
+		void Raycast(Ray ray, float maxDistance, unsigned int k, std::vector<RayHit>& hits);
+		void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<Entity*>& out);
+		void QueryAABB(AABB box, std::vector<Entity*>& out);
+		void QueryKNearest(DirectX::XMFLOAT3 point, unsigned int k, std::vector<Neighbor>& out,
+			float maxDistance = FLT_MAX);
+		void GetCollisionPairs(std::vector<EntityPair>& out);
 
 		// Functions
-		void Build();
+		void Build(unsigned int threadCount = 1,
+			size_t parallelThreshold = PARALLEL_BUILD_THRESHOLD);
+		void BuildMorton();
 		void Update();
+		void Update(std::vector<EntityPair>& movedPairs);
 	private:
 		// The maximum number of entities in an oct
 		// before a subdivision occurs
@@ -71,6 +138,11 @@ namespace Octree
 		// This Oct's 3D bounds
 		AABB bounds;
 
+		// The bounds entities in this Oct must fit in
+		// (equal to bounds unless the tree is loose)
+		AABB looseBounds;
+		float looseness;
+
 		// This oct's parent
 		Octree::Node* parent;
 
@@ -78,17 +150,62 @@ namespace Octree
 		Octree::Node* children[NUM_CHILDREN];
 		unsigned char activeOctants;
 
+		// The entities' bounds for the culling kernel, refilled when entities
+		// are added, removed or moved
+		Culling::BoundsSoA cullBounds;
+		bool cullBoundsDirty = true;
+
 		// Building the tree
-		std::queue<std::shared_ptr<Entity>> queue;
+		std::vector<std::shared_ptr<Entity>> pending; // Waiting to be inserted, indexed by octreeIndex
 		bool treeReady;
 		bool treeBuilt;
 
 		// Maintaining the tree
 		short MaxLifespan = 8;
 		short currentLifespan = -1;
+		// Only used by the root
+		std::vector<Entity*> movedEntities; // Entities moved since the last Update
+		std::vector<Node*> pruneCandidates; // Empty leaves counting down their lifespan
+		Node* overflow = nullptr; // Entities the root couldn't grow to contain
+		float baseWidth = 0.0f; // Width the root was made with, to measure its growth against
 
 		// Helpers
 		AABB CalculateChildBounds(Octant octant);
+		void CullEntities(Frustum& frustum, std::vector<Entity*>& out,
+			unsigned char planeMask, bool testEntities, CullingCache* cache = nullptr);
+		int FindChildOctant(AABB aabb, AABB octantBounds[NUM_CHILDREN]);
+		void RaycastNode(Ray& ray, unsigned int k, float& maxDistance, std::vector<RayHit>& hits);
+		void QuerySphereNode(DirectX::XMFLOAT3& center, float radius, std::vector<Entity*>& out);
+		void QueryAABBNode(AABB& box, std::vector<Entity*>& out);
+		void AppendAllEntities(std::vector<Entity*>& out);
+
+		// Which overlapping partners PairNode reports
+		enum class PairFilter {
+			All,			// Every partner
+			Later,			// Partners after the entity, when every entity is searched
+			LaterIfMoved	// Unmoved partners, and moved ones after the entity
+		};
+		void CollectPairs(std::vector<std::pair<Entity*, AABB>>& stack, size_t first,
+			std::vector<EntityPair>& out);
+		void PairNode(Entity* entity, AABB& box, PairFilter filter, std::vector<EntityPair>& out);
+		void PairOverflow(Entity* entity, AABB& box, PairFilter filter, std::vector<EntityPair>& out);
+		bool RelocateMoved();
+		void EmitMorton(std::vector<std::shared_ptr<Entity>>& sorted,
+			std::vector<unsigned long long>& codes,
+			std::vector<unsigned char>& levels,
+			size_t first, size_t last,
+			unsigned int depth, unsigned int maxLevel);
 		bool Insert(std::shared_ptr<Entity> _entity);
+		void HoldEntities();
+		std::shared_ptr<Entity> Detach(Entity* _entity);
+		Node* GetRoot();
+		bool Grow(AABB aabb);
+		void GrowToFit();
+		void AddToOverflow(std::shared_ptr<Entity> _entity);
+		void CullOverflow(Frustum& frustum, std::vector<Entity*>& out, CullingCache* cache = nullptr);
+		void CullEntityBounds(Frustum& frustum, unsigned char planeMask, std::vector<Entity*>& out);
+		void Relocate(Entity* _entity);
+		void AddPruneCandidate(Node* node);
+		void PruneCandidates();
 	};
 }
\ No newline at end of file
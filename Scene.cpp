@@ -1,16 +1,24 @@
 #include "Scene.h"
 #include "Assets.h"
+#include "Bvh.h"
+#include "TransformStore.h"
 
 using json = nlohmann::json;
 
 #include "PathHelpers.h"
 #include "Window.h"
+#include <thread>
 
 using namespace DirectX;
 
 // Constructor / Destructor
 Scene::Scene(std::string _name, AABB _bounds) 
-	: name(_name), bounds(_bounds),
+	: name(_name), bounds(_bounds), octreeLooseness(1.0f),
+	octreeBuildThreads(0), octreeParallelThreshold(PARALLEL_BUILD_THRESHOLD),
+	octreeMortonThreshold(MORTON_BUILD_THRESHOLD),
+	spatialIndexType(SpatialIndexType::Octree),
+	gridCellSize(GRID_CELL_SIZE),
+	broadphaseType(BroadphaseType::Octree),
 	opaqueEntitiesOrganized(false) {}
 Scene::~Scene() {}
 
@@ -25,6 +33,10 @@ std::shared_ptr<Camera> Scene::GetCurrentCamera() { return currentCamera; }
 std::shared_ptr<Sky> Scene::GetSky() { return sky; }
 std::vector<std::shared_ptr<Emitter>>& Scene::GetEmitters() { return emitters; }
 std::shared_ptr<Octree::Node> Scene::GetOctree() { return octree; }
+std::shared_ptr<SpatialIndex> Scene::GetSpatialIndex() { return spatialIndex; }
+std::shared_ptr<SpatialHashGrid> Scene::GetGrid() { return grid; }
+std::shared_ptr<Broadphase> Scene::GetBroadphase() { return broadphase; }
+std::vector<Octree::EntityPair>& Scene::GetCollisionPairs() { return collisionPairs; }
 bool Scene::OpaqueReady() { return opaqueEntitiesOrganized; }
 
 // Setters
@@ -38,14 +50,60 @@ void Scene::SetCurrentCamera(std::shared_ptr<Camera> camera)
 void Scene::SetCurrentCamera(unsigned int cameraIndex)
 { if (cameraIndex < cameras.size()) { currentCamera = cameras[cameraIndex]; } }
 void Scene::SetSky(std::shared_ptr<Sky> _sky) { sky = _sky; }
+void Scene::SetOctreeLooseness(float _looseness) { octreeLooseness = _looseness; }
+void Scene::SetOctreeBuildThreads(unsigned int _threads) { octreeBuildThreads = _threads; }
+void Scene::SetOctreeParallelThreshold(size_t _threshold) { octreeParallelThreshold = _threshold; }
+void Scene::SetOctreeMortonThreshold(size_t _threshold) { octreeMortonThreshold = _threshold; }
+void Scene::SetSpatialIndexType(SpatialIndexType _type) { spatialIndexType = _type; }
+void Scene::SetBroadphaseType(BroadphaseType _type) { broadphaseType = _type; }
+void Scene::SetGridCellSize(float _cellSize) { gridCellSize = _cellSize; }
 
 // Modifiers
 void Scene::AddEntity(std::shared_ptr<Entity> entity) 
 {
 	opaqueEntitiesOrganized = false;
+	entity->sceneIndex = (unsigned int)entities.size();
 	entities.push_back(entity); 
-	if(octree)
-		octree->AddToPending(entity);
+	if (grid && entity->IsDynamic())
+		grid->AddEntity(entity);
+	else
+	{
+		if (octree)
+			octree->AddToPending(entity);
+		if (spatialIndex)
+			spatialIndex->AddEntity(entity);
+	}
+	if (broadphase)
+		broadphase->AddEntity(entity);
+}
+/// <summary>
+/// Removes an entity in constant time. The last entity takes its
+/// place, so the order of the scene's entities isn't kept.
+/// </summary>
+/// <returns>Whether the entity was in this scene</returns>
+bool Scene::RemoveEntity(std::shared_ptr<Entity> entity)
+{
+	unsigned int index = entity->sceneIndex;
+	if (index >= entities.size() || entities[index] != entity)
+		return false;
+
+	opaqueEntitiesOrganized = false;
+	if (grid && entity->IsDynamic())
+		grid->RemoveEntity(entity.get());
+	else
+	{
+		if (octree)
+			octree->Remove(entity.get());
+		if (spatialIndex)
+			spatialIndex->RemoveEntity(entity.get());
+	}
+	if (broadphase)
+		broadphase->RemoveEntity(entity.get());
+
+	entities[index] = entities.back();
+	entities[index]->sceneIndex = index;
+	entities.pop_back();
+	return true;
 }
 void Scene::AddLight(Light light) { lights.push_back(light); }
 void Scene::AddShadowLight(Light light) { shadowLights.push_back( std::make_shared<ShadowLight>(light) ); }
@@ -60,6 +118,10 @@ void Scene::Clear()
 	cameras.clear();
 	entities.clear();
 	octree->Clear();
+	spatialIndex.reset();
+	grid.reset();
+	broadphase.reset();
+	collisionPairs.clear();
 
 	currentCamera.reset();
 	sky.reset();
@@ -67,21 +129,137 @@ void Scene::Clear()
 
 void Scene::Init()
 {
+	// Dynamic entities go in the grid, the rest in the octree
+	grid = std::make_shared<SpatialHashGrid>(gridCellSize);
+	std::vector<std::shared_ptr<Entity>> staticEntities;
+	staticEntities.reserve(entities.size());
+	for (std::shared_ptr<Entity>& entity : entities)
+	{
+		if (entity->IsDynamic())
+			grid->AddEntity(entity);
+		else
+			staticEntities.push_back(entity);
+	}
+
 	// Build Octree
-	octree = std::make_shared<Octree::Node>(bounds, entities);
-	octree->Build();
+	octree = std::make_shared<Octree::Node>(bounds, staticEntities, nullptr, octreeLooseness);
+
+	// Large tight scenes are bulk loaded. The bulk loader only handles
+	// tight trees, so loose ones use the parallel build instead.
+	if (octreeLooseness <= 1.0f && staticEntities.size() >= octreeMortonThreshold)
+		octree->BuildMorton();
+	else
+	{
+		unsigned int threads = octreeBuildThreads;
+		if (threads == 0)
+			threads = std::thread::hardware_concurrency();
+		octree->Build(threads, octreeParallelThreshold);
+	}
+
+	// Culling
+	if (spatialIndexType == SpatialIndexType::BVH)
+		spatialIndex = std::make_shared<Bvh>(staticEntities);
+	else
+		spatialIndex = std::make_shared<OctreeIndex>(octree);
+
+	// Broadphase
+	if (broadphaseType == BroadphaseType::SweepAndPrune)
+		broadphase = std::make_shared<SweepAndPrune>(entities);
+	else
+		broadphase = std::make_shared<OctreeBroadphase>(octree);
 }
 
 
 void Scene::Update(float deltaTime, float totalTime)
 {
+	// Every world matrix moved this frame in one pass, then the bounds of
+	// every entity that moved in another, before the spatial structures
+	// ask for them one at a time. Moved entities already reported
+	// themselves to the octree or the grid, so only those are visited.
+	TransformStore::GetInstance().UpdateWorldMatrices();
+	movedEntities.clear();
+	for (Entity* entity : octree->GetMovedEntities())
+	{
+		if (entity->IsAABBDirty())
+			movedEntities.push_back(entity);
+	}
+	for (Entity* entity : grid->GetMovedEntities())
+	{
+		if (entity->IsAABBDirty())
+			movedEntities.push_back(entity);
+	}
+	Entity::UpdateAABBs(movedEntities);
+
 	// Emitters
 	for (std::shared_ptr<Emitter> emitter : emitters)
 	{
 		emitter->Update(deltaTime, totalTime);
 	}
 
-	// Octree
-	octree->Update();
+	// Culling, the grid and the broadphase first, they read which
+	// entities moved before the octree and grid clear them
+	spatialIndex->Update();
+	grid->Update();
+	if (broadphaseType == BroadphaseType::Octree)
+		movedStaticEntities = octree->GetMovedEntities();
+	broadphase->Update(collisionPairs);
+	// The octree broadphase has already relocated the moved static
+	// entities, but only knows about the octree
+	if (broadphaseType == BroadphaseType::Octree)
+	{
+		grid->AppendMovedPairs(*octree, collisionPairs);
+		grid->AppendStaticPairs(movedStaticEntities, collisionPairs);
+	}
+	else
+		octree->Update();
+	grid->ClearMoved();
+}
+
+/// <summary>
+/// Appends the static and dynamic entities whose bounds intersect the frustum
+/// </summary>
+/// <param name="cache">The view's last cull, or null to test everything</param>
+void Scene::GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out, CullingCache* cache)
+{
+	// Only the octree tests entities one at a time, so only it uses the cache
+	if (cache && spatialIndexType == SpatialIndexType::Octree)
+		octree->GetVisibleEntities(frustum, out, cache);
+	else
+		spatialIndex->GetVisibleEntities(frustum, out);
+	grid->GetVisibleEntities(frustum, out);
+}
+
+/// <summary>
+/// Appends the static and dynamic entities in nodes or cells that
+/// intersect the frustum, without testing each entity
+/// </summary>
+void Scene::GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+	spatialIndex->GetRelevantEntities(frustum, out);
+	grid->GetRelevantEntities(frustum, out);
+}
+
+/// <summary>
+/// Finds the nearest static or dynamic entity whose bounds the ray hits
+/// </summary>
+/// <returns>Whether anything was hit</returns>
+bool Scene::Raycast(Ray ray, float maxDistance, Octree::RayHit& hit)
+{
+	bool found = octree->Raycast(ray, maxDistance, hit);
+	if (found)
+		maxDistance = hit.t;
+	return grid->Raycast(ray, maxDistance, hit) || found;
+}
+
+void Scene::QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<Entity*>& out)
+{
+	octree->QuerySphere(center, radius, out);
+	grid->QuerySphere(center, radius, out);
+}
+
+void Scene::QueryAABB(AABB box, std::vector<Entity*>& out)
+{
+	octree->QueryAABB(box, out);
+	grid->QueryAABB(box, out);
 }
 
@@ -8,6 +8,9 @@
 #include "Sky.h"
 #include "Emitter.h"
 #include "Octree.h"
+#include "Broadphase.h"
+#include "SpatialIndex.h"
+#include "SpatialHashGrid.h"
 
 #include <fstream>
 #include "nlohmann/json.hpp"
@@ -30,6 +33,10 @@ public:
 	std::shared_ptr<Sky> GetSky();
 	std::vector<std::shared_ptr<Emitter>>& GetEmitters();
 	std::shared_ptr<Octree::Node> GetOctree();
+	std::shared_ptr<SpatialIndex> GetSpatialIndex();
+	std::shared_ptr<SpatialHashGrid> GetGrid();
+	std::shared_ptr<Broadphase> GetBroadphase();
+	std::vector<Octree::EntityPair>& GetCollisionPairs();
 	bool OpaqueReady();
 
 	// Setters
@@ -37,9 +44,17 @@ public:
 	void SetCurrentCamera(std::shared_ptr<Camera> camera);
 	void SetCurrentCamera(unsigned int cameraIndex);
 	void SetSky(std::shared_ptr<Sky> _sky);
+	void SetOctreeLooseness(float _looseness);
+	void SetOctreeBuildThreads(unsigned int _threads);
+	void SetOctreeParallelThreshold(size_t _threshold);
+	void SetOctreeMortonThreshold(size_t _threshold);
+	void SetSpatialIndexType(SpatialIndexType _type);
+	void SetBroadphaseType(BroadphaseType _type);
+	void SetGridCellSize(float _cellSize);
 	
 	// Modifiers
 	void AddEntity(std::shared_ptr<Entity> entity);
+	bool RemoveEntity(std::shared_ptr<Entity> entity);
 	void AddLight(Light light);
 	void AddShadowLight(Light light);
 	void AddCamera(std::shared_ptr<Camera> camera);
@@ -50,11 +65,19 @@ public:
 	void Init();
 	void Update(float deltaTime, float totalTime);
 
+	// Queries over both static and dynamic entities
+	void GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out, CullingCache* cache = nullptr);
+	void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out);
+	bool Raycast(Ray ray, float maxDistance, Octree::RayHit& hit);
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<Entity*>& out);
+	void QueryAABB(AABB box, std::vector<Entity*>& out);
+
 private:
 	std::string name;
 
 	// Vectors of various scene elements
 	std::vector<std::shared_ptr<Entity>> entities; // Could also create a map / trie for specific entities
+	std::vector<Entity*> movedEntities; // Reused each update to batch their bounds
 	std::vector<Light> lights;
 	std::vector<std::shared_ptr<ShadowLight>> shadowLights;
 	std::vector<std::shared_ptr<Camera>> cameras;
@@ -67,6 +90,23 @@ private:
 	// For drawing
 	AABB bounds;
 	std::shared_ptr<Octree::Node> octree;
+	float octreeLooseness;
+	unsigned int octreeBuildThreads; // 0 uses every hardware thread
+	size_t octreeParallelThreshold;
+	size_t octreeMortonThreshold;
+	// Culls for the camera and shadows, the octree above is still
+	// kept for picking and the octree broadphase
+	SpatialIndexType spatialIndexType;
+	std::shared_ptr<SpatialIndex> spatialIndex;
+	// Holds the dynamic entities, the octree and index only hold static ones
+	float gridCellSize;
+	std::shared_ptr<SpatialHashGrid> grid;
+
+	// Overlapping entities where at least one moved this frame
+	BroadphaseType broadphaseType;
+	std::shared_ptr<Broadphase> broadphase;
+	std::vector<Octree::EntityPair> collisionPairs;
+	std::vector<Entity*> movedStaticEntities; // Copied before the octree broadphase relocates them
 	bool opaqueEntitiesOrganized;
 	std::vector<std::shared_ptr<Entity>> opaqueEntities;
 };
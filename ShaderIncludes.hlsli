@@ -3,6 +3,9 @@
 
 #define MAX_SHADOWLIGHTS 5
 
+// Must match the WORLD_MATRIX_3X4 definition in BufferStructs.h
+//#define WORLD_MATRIX_3X4
+
 struct VertexShaderInput
 {
     float3 localPosition    : POSITION; // XYZ position
@@ -28,4 +31,17 @@ struct VertexToPixel_Sky
     float3 sampleDir        : DIRECTION;
 };
 
+#ifdef WORLD_MATRIX_3X4
+// Transforms a normal by the cofactors of the world matrix, its inverse
+// transpose without the divide by the determinant. Lighting normalizes
+// anyway, only the determinant's sign matters for mirrored objects
+float3 TransformNormal(float3x4 world, float3 normal)
+{
+    float3x3 m = (float3x3) world;
+    float3x3 cofactors = float3x3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+    float3 n = mul(cofactors, normal);
+    return dot(m[0], cofactors[0]) < 0 ? -n : n;
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -64,6 +64,7 @@ Frustum ShadowLight::GetFrustum()
         UpdateFrustum();
     return frustum;
 }
+CullingCache* ShadowLight::GetCullingCache() { return &cullingCache; }
 Light ShadowLight::GetLight() { return light; }
 int ShadowLight::GetResolution() { return shadowMapResolution; }
 int ShadowLight::GetType() { return light.Type; }
@@ -296,115 +297,14 @@ void ShadowLight::UpdateProjectionMatrix()
 
 void ShadowLight::UpdateFrustum()
 {
-    // Variables
-    float halfFarLength = light.Type == LIGHT_TYPE_SPOT ? 
-        std::tan(fov * 0.5f) * farClip : 
-        lightProjectionSize / 2;
-    float halfNearLength = light.Type == LIGHT_TYPE_SPOT ?
-        std::tan(fov * 0.5f) * nearClip :
-        halfFarLength;
-
-    DirectX::XMVECTOR fwd = DirectX::XMVector3Normalize(DirectX::XMLoadFloat3(&light.Direction));
-    DirectX::XMVECTOR up = DirectX::XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // Up: World up vector (Y axis)
-    DirectX::XMVECTOR right = DirectX::XMVector3Cross(up, fwd);
-
-    DirectX::XMVECTOR frontMultFar = DirectX::XMVectorScale(fwd, farClip);
-    DirectX::XMVECTOR rightMultFarLength = DirectX::XMVectorScale(right, halfFarLength);
-    DirectX::XMVECTOR upMultFarLength = DirectX::XMVectorScale(up, halfFarLength);
-
-    DirectX::XMVECTOR frontMultNear = DirectX::XMVectorScale(fwd, nearClip);
-    DirectX::XMVECTOR rightMultNearLength = DirectX::XMVectorScale(right, halfNearLength);
-    DirectX::XMVECTOR upMultNearLength = DirectX::XMVectorScale(up, halfNearLength);
-
-    DirectX::XMVECTOR pos = light.Type == LIGHT_TYPE_SPOT ?
-        DirectX::XMLoadFloat3(&light.Position) :
-        DirectX::XMVectorScale(fwd, farClip * -0.5f);
-    DirectX::XMVECTOR farCenter = DirectX::XMVectorAdd(frontMultFar, pos);
-    DirectX::XMVECTOR nearCenter = DirectX::XMVectorAdd(frontMultFar, pos);
-
-    // Points
-    {
-        DirectX::XMStoreFloat3(&frustum.points[0],		// Top Right Far
-            DirectX::XMVectorAdd(farCenter,
-                DirectX::XMVectorAdd(upMultFarLength, rightMultFarLength)
-            ));
-        DirectX::XMStoreFloat3(&frustum.points[1],		// Bottom Left Far
-            DirectX::XMVectorSubtract(farCenter,
-                DirectX::XMVectorAdd(upMultFarLength, rightMultFarLength)
-            ));
-        DirectX::XMStoreFloat3(&frustum.points[2],		// Top Left Far
-            DirectX::XMVectorAdd(farCenter,
-                DirectX::XMVectorSubtract(upMultFarLength, rightMultFarLength)
-            ));
-        DirectX::XMStoreFloat3(&frustum.points[3],		// Bottom Right Far
-            DirectX::XMVectorSubtract(farCenter,
-                DirectX::XMVectorSubtract(upMultFarLength, rightMultFarLength)
-            ));
-
-
-        DirectX::XMStoreFloat3(&frustum.points[4],		// Top Right Near
-            DirectX::XMVectorAdd(nearCenter,
-                DirectX::XMVectorAdd(upMultNearLength, rightMultNearLength)
-            ));
-        DirectX::XMStoreFloat3(&frustum.points[5],		// Bottom Left Near
-            DirectX::XMVectorSubtract(nearCenter,
-                DirectX::XMVectorAdd(upMultNearLength, rightMultNearLength)
-            ));
-        DirectX::XMStoreFloat3(&frustum.points[6],		// Top Left Near
-            DirectX::XMVectorAdd(nearCenter,
-                DirectX::XMVectorSubtract(upMultNearLength, rightMultNearLength)
-            ));
-        DirectX::XMStoreFloat3(&frustum.points[7],		// Bottom Right Near
-            DirectX::XMVectorSubtract(nearCenter,
-                DirectX::XMVectorSubtract(upMultNearLength, rightMultNearLength)
-            ));
-    }
-
-    // Calculate Normals
-    // https://learnopengl.com/Guest-Articles/2021/Scene/Frustum-Culling
-    {
-        frustum.normals[0] = DirectX::XMFLOAT4(		// Near Face
-            light.Direction.x,
-            light.Direction.y,
-            light.Direction.z,
-            1.0
-        );
-        frustum.normals[0].w = CalcD(frustum.normals[0], frustum.points[4]);
-
-        frustum.normals[1] = DirectX::XMFLOAT4(		// Far Face
-            -light.Direction.x,
-            -light.Direction.y,
-            -light.Direction.z,
-            1.0
-        );
-        frustum.normals[1].w = CalcD(frustum.normals[1], frustum.points[0]);
-
-        DirectX::XMStoreFloat4(&frustum.normals[2],		// Left Face
-            DirectX::XMVector3Cross(
-                up,
-                DirectX::XMVectorAdd(frontMultFar, rightMultFarLength)
-            ));
-        frustum.normals[2].w = CalcD(frustum.normals[2], frustum.points[1]);
-
-        DirectX::XMStoreFloat4(&frustum.normals[3],		// Right Face
-            DirectX::XMVector3Cross(
-                DirectX::XMVectorSubtract(frontMultFar, rightMultFarLength),
-                up
-            ));
-        frustum.normals[3].w = CalcD(frustum.normals[3], frustum.points[0]);
-
-        DirectX::XMStoreFloat4(&frustum.normals[4],		// Bottom Face
-            DirectX::XMVector3Cross(
-                DirectX::XMVectorAdd(frontMultFar, upMultFarLength),
-                right
-            ));
-        frustum.normals[4].w = CalcD(frustum.normals[4], frustum.points[1]);
-
-        DirectX::XMStoreFloat4(&frustum.normals[5],		// Top Face
-            DirectX::XMVector3Cross(
-                right,
-                DirectX::XMVectorSubtract(frontMultFar, upMultFarLength)
-            ));
-        frustum.normals[5].w = CalcD(frustum.normals[5], frustum.points[0]);
-    }
+    // Built from the same matrices the shadow map is rendered with
+    DirectX::XMFLOAT4X4 view = GetView();
+    DirectX::XMFLOAT4X4 projection = GetProjection();
+    DirectX::XMFLOAT4X4 viewProjection;
+    DirectX::XMStoreFloat4x4(&viewProjection, DirectX::XMMatrixMultiply(
+        DirectX::XMLoadFloat4x4(&view),
+        DirectX::XMLoadFloat4x4(&projection)));
+    frustum = Frustum::FromViewProjection(viewProjection);
+
+    dirtyFrustum = false;
 }
@@ -39,6 +39,7 @@ public:
 	DirectX::XMFLOAT4X4 GetView();
 	DirectX::XMFLOAT4X4 GetProjection();
 	Frustum GetFrustum();
+	CullingCache* GetCullingCache();
 	Microsoft::WRL::ComPtr<ID3D12Resource> GetResource();
 	D3D12_CPU_DESCRIPTOR_HANDLE GetDSVHandle();
 	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> GetDSVHeap();
@@ -72,6 +73,7 @@ private:
 	float fov;
 	Frustum frustum;
 	bool dirtyFrustum;
+	CullingCache cullingCache; // Last cull of this light's frustum
 	float nearClip;
 	float farClip;
 
@@ -8,13 +8,22 @@ cbuffer PerFrame : register(b0)
 }
 cbuffer PerObject : register(b1)
 {
+#ifdef WORLD_MATRIX_3X4
+    row_major float3x4 world;
+#else
     matrix world;
     matrix worldInvTranspose;
+#endif
 }
 
 float4 main( VertexShaderInput input ) : SV_POSITION
 {
+#ifdef WORLD_MATRIX_3X4
+    float4 worldPos = float4(mul(world, float4(input.localPosition, 1.0f)), 1.0f);
+    return mul(proj, mul(view, worldPos));
+#else
     matrix wvp = mul(proj, mul(view, world));
     float4 screenPos = mul(wvp, float4(input.localPosition, 1.0f));
     return screenPos;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,626 @@
+#include "SpatialHashGrid.h"
+
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Bits per axis in a cell key, cells span +-2^20 along each axis
+    const int KeyBits = 21;
+    const long long KeyOffset = 1LL << (KeyBits - 1);
+    const unsigned long long KeyMask = (1ULL << KeyBits) - 1;
+
+    // Key of the cell holding entities outside the keyed range,
+    // PackKey never sets the top bit
+    const unsigned long long OverflowKey = ~0ULL;
+
+    unsigned long long PackKey(long long x, long long y, long long z)
+    {
+        return ((unsigned long long)(x + KeyOffset) & KeyMask) << (KeyBits * 2) |
+            ((unsigned long long)(y + KeyOffset) & KeyMask) << KeyBits |
+            ((unsigned long long)(z + KeyOffset) & KeyMask);
+    }
+
+    float HalfSize(AABB& box)
+    {
+        DirectX::XMFLOAT3 dim = box.Dimensions();
+        float largest = dim.x > dim.y ? dim.x : dim.y;
+        return 0.5f * (largest > dim.z ? largest : dim.z);
+    }
+
+    long long UnpackAxis(unsigned long long key, int shift)
+    {
+        return (long long)((key >> shift) & KeyMask) - KeyOffset;
+    }
+
+    // Cell coordinate along one axis, clamped to one past the keyed
+    // range so far positions neither wrap nor overflow the conversion
+    long long CellCoord(float position, float cellSize)
+    {
+        float cell = floorf(position / cellSize);
+        if (cell < (float)(-KeyOffset - 1))
+            return -KeyOffset - 1;
+        if (cell > (float)KeyOffset)
+            return KeyOffset;
+        return (long long)cell;
+    }
+
+    bool InKeyRange(long long coord)
+    {
+        return coord >= -KeyOffset && coord < KeyOffset;
+    }
+
+    void Grow(AABB& bounds, AABB& box)
+    {
+        bounds.min = DirectX::XMFLOAT3(
+            bounds.min.x < box.min.x ? bounds.min.x : box.min.x,
+            bounds.min.y < box.min.y ? bounds.min.y : box.min.y,
+            bounds.min.z < box.min.z ? bounds.min.z : box.min.z);
+        bounds.max = DirectX::XMFLOAT3(
+            bounds.max.x > box.max.x ? bounds.max.x : box.max.x,
+            bounds.max.y > box.max.y ? bounds.max.y : box.max.y,
+            bounds.max.z > box.max.z ? bounds.max.z : box.max.z);
+    }
+}
+
+SpatialHashGrid::SpatialHashGrid(float _cellSize)
+    : cellSize(_cellSize), maxHalfSize(0.0f), entityCount(0)
+{
+    extent.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+    extent.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+SpatialHashGrid::~SpatialHashGrid()
+{
+    // Entities can outlive the grid, don't let them report moves to it
+    for (Cell& cell : cells)
+    {
+        for (std::shared_ptr<Entity>& entityPtr : cell.entities)
+        {
+            entityPtr->grid = nullptr;
+            entityPtr->gridCell = Entity::NoGridCell;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Modifiers
+///////////////////////////////////////////////////////////////////////////////
+
+void SpatialHashGrid::AddEntity(std::shared_ptr<Entity> entity)
+{
+    AABB box = entity->GetAABB();
+    Insert(entity, box);
+    entity->grid = this;
+    entity->hasMoved = false;
+    entityCount++;
+}
+
+/// <summary>
+/// Removes an entity in constant time, using its cell and index
+/// </summary>
+/// <returns>Whether the entity was in the grid</returns>
+bool SpatialHashGrid::RemoveEntity(Entity* entity)
+{
+    if (entity->gridCell >= cells.size())
+        return false;
+    std::vector<std::shared_ptr<Entity>>& cellEntities = cells[entity->gridCell].entities;
+    if (entity->gridIndex >= cellEntities.size() || cellEntities[entity->gridIndex].get() != entity)
+        return false;
+
+    // Don't leave a dangling pointer for ClearMoved
+    unsigned int moved = entity->movedIndex;
+    if (entity->hasMoved && moved < movedEntities.size() && movedEntities[moved] == entity)
+    {
+        if (moved + 1 < movedEntities.size())
+        {
+            movedEntities[moved] = movedEntities.back();
+            movedEntities[moved]->movedIndex = moved;
+        }
+        movedEntities.pop_back();
+    }
+
+    Detach(entity);
+    entity->gridCell = Entity::NoGridCell;
+    entity->grid = nullptr;
+    entityCount--;
+    return true;
+}
+
+/// <summary>
+/// Queues an entity to be moved to its new cell by the next Update.
+/// Called by the entity the first time it moves each frame.
+/// </summary>
+void SpatialHashGrid::MarkMoved(Entity* entity)
+{
+    cells[entity->gridCell].cullBoundsDirty = true;
+    entity->movedIndex = (unsigned int)movedEntities.size();
+    movedEntities.push_back(entity);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Getters
+///////////////////////////////////////////////////////////////////////////////
+
+float SpatialHashGrid::GetCellSize() { return cellSize; }
+unsigned int SpatialHashGrid::GetEntityCount() { return entityCount; }
+unsigned int SpatialHashGrid::GetCellCount() { return (unsigned int)cellLookup.size(); }
+std::vector<Entity*>& SpatialHashGrid::GetMovedEntities() { return movedEntities; }
+
+void SpatialHashGrid::GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    CullCells(frustum, out, true);
+}
+
+void SpatialHashGrid::GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    CullCells(frustum, out, false);
+}
+
+/// <summary>
+/// Finds the nearest entity whose bounds the ray hits, walking the
+/// cells along the ray in order and stopping past the nearest hit, or
+/// scanning every cell when the walk would mean more lookups
+/// </summary>
+/// <param name="ray">Ray to cast, t is measured in lengths of its direction</param>
+/// <param name="maxDistance">Furthest t to consider</param>
+/// <param name="hit">Set to the nearest hit, if there is one</param>
+/// <returns>Whether anything was hit</returns>
+bool SpatialHashGrid::Raycast(Ray ray, float maxDistance, Octree::RayHit& hit)
+{
+    // Overflow entities aren't in any keyed cell, so test them on their own
+    bool found = false;
+    std::unordered_map<unsigned long long, unsigned int>::iterator overflow = cellLookup.find(OverflowKey);
+    if (overflow != cellLookup.end())
+        found = RaycastCell(cells[overflow->second], ray, maxDistance, hit);
+
+    // Clip the ray to where entities of the keyed cells can reach
+    AABB reach;
+    reach.min = DirectX::XMFLOAT3(extent.min.x - maxHalfSize, extent.min.y - maxHalfSize, extent.min.z - maxHalfSize);
+    reach.max = DirectX::XMFLOAT3(extent.max.x + maxHalfSize, extent.max.y + maxHalfSize, extent.max.z + maxHalfSize);
+    float tStart, tEnd;
+    if (extent.min.x > extent.max.x || !reach.Intersects(ray, tStart, tEnd) || tStart >= maxDistance)
+        return found;
+    if (tEnd > maxDistance)
+        tEnd = maxDistance;
+
+    float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+    float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    long long at[3], step[3];
+    float tNext[3], tDelta[3];
+    double steps = 0.0;
+    for (int a = 0; a < 3; a++)
+    {
+        at[a] = CellCoord(origin[a] + direction[a] * tStart, cellSize);
+        long long last = CellCoord(origin[a] + direction[a] * tEnd, cellSize);
+        steps += (double)(last > at[a] ? last - at[a] : at[a] - last);
+
+        step[a] = direction[a] > 0.0f ? 1 : (direction[a] < 0.0f ? -1 : 0);
+        tDelta[a] = step[a] != 0 ? cellSize / fabsf(direction[a]) : FLT_MAX;
+        tNext[a] = step[a] != 0 ? ((at[a] + (step[a] > 0 ? 1 : 0)) * cellSize - origin[a]) / direction[a] : FLT_MAX;
+    }
+
+    // Entities reach this many cells past the one holding their center
+    long long reachCells = (long long)ceilf(maxHalfSize / cellSize);
+    double side = (double)(reachCells * 2 + 1);
+    if (side * side * (side + steps) > (double)cellLookup.size())
+    {
+        float tNear, tFar;
+        for (Cell& cell : cells)
+        {
+            if (cell.entities.empty() || cell.key == OverflowKey ||
+                !cell.bounds.Intersects(ray, tNear, tFar) || tNear >= maxDistance)
+                continue;
+            found = RaycastCell(cell, ray, maxDistance, hit) || found;
+        }
+        return found;
+    }
+
+    // Every cell reaching the first cell, then only the new face of
+    // that block each step, since the walk never steps back
+    long long low[3], high[3];
+    for (int a = 0; a < 3; a++)
+    {
+        low[a] = at[a] - reachCells;
+        high[a] = at[a] + reachCells;
+    }
+    found = RaycastCells(low, high, ray, maxDistance, hit) || found;
+
+    while (true)
+    {
+        int a = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        if (tNext[a] > tEnd || tNext[a] >= maxDistance)
+            break;
+        at[a] += step[a];
+        tNext[a] += tDelta[a];
+
+        for (int b = 0; b < 3; b++)
+        {
+            low[b] = at[b] - reachCells;
+            high[b] = at[b] + reachCells;
+        }
+        low[a] = high[a] = at[a] + step[a] * reachCells;
+        found = RaycastCells(low, high, ray, maxDistance, hit) || found;
+    }
+    return found;
+}
+
+/// <summary>
+/// Appends every entity whose bounds touch the sphere to out
+/// </summary>
+void SpatialHashGrid::QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<Entity*>& out)
+{
+    AABB box;
+    box.min = DirectX::XMFLOAT3(center.x - radius, center.y - radius, center.z - radius);
+    box.max = DirectX::XMFLOAT3(center.x + radius, center.y + radius, center.z + radius);
+    GatherCells(box);
+    for (unsigned int index : candidateCells)
+        for (const std::shared_ptr<Entity>& entityPtr : cells[index].entities)
+            if (entityPtr->GetAABB().Intersects(center, radius))
+                out.push_back(entityPtr.get());
+}
+
+/// <summary>
+/// Appends every entity whose bounds touch the box to out
+/// </summary>
+void SpatialHashGrid::QueryAABB(AABB box, std::vector<Entity*>& out)
+{
+    QueryCells(box, out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Functions
+///////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Moves each moved entity to the cell holding its new center.
+/// Their hasMoved stays set until ClearMoved, so pairs can still be found.
+/// </summary>
+void SpatialHashGrid::Update()
+{
+    for (Entity* entity : movedEntities)
+    {
+        AABB box = entity->GetAABB();
+        Cell& cell = cells[entity->gridCell];
+        if (GetKey(box.Center()) == cell.key)
+        {
+            // Same cell, unless it grew past the cells' looseness
+            if (HalfSize(box) <= maxHalfSize)
+            {
+                // The overflow cell isn't loose, it just holds its entities
+                if (cell.key == OverflowKey)
+                    Grow(cell.bounds, box);
+                continue;
+            }
+        }
+
+        std::shared_ptr<Entity> entityPtr = cells[entity->gridCell].entities[entity->gridIndex];
+        Detach(entity);
+        Insert(entityPtr, box);
+    }
+}
+
+/// <summary>
+/// Appends the pairs of overlapping entities where a grid entity moved
+/// in the last update, against the octree's entities and the grid's own.
+/// Two moved grid entities are only paired once.
+/// </summary>
+/// <param name="octree">Octree holding the static entities</param>
+void SpatialHashGrid::AppendMovedPairs(Octree::Node& octree, std::vector<Octree::EntityPair>& out)
+{
+    std::vector<Entity*> candidates;
+    for (Entity* entity : movedEntities)
+    {
+        AABB box = entity->GetAABB();
+
+        candidates.clear();
+        octree.QueryAABB(box, candidates);
+        for (Entity* other : candidates)
+            if (box.Overlaps(other->GetAABB()))
+                out.push_back({ entity, other });
+
+        candidates.clear();
+        QueryCells(box, candidates);
+        for (Entity* other : candidates)
+        {
+            if (other == entity || (other->hasMoved && other < entity))
+                continue;
+            if (box.Overlaps(other->GetAABB()))
+                out.push_back({ entity, other });
+        }
+    }
+}
+
+/// <summary>
+/// Appends the pairs of overlapping entities where a static entity moved
+/// and a grid entity didn't. Moved grid entities already found their
+/// pairs with static entities in AppendMovedPairs.
+/// </summary>
+/// <param name="movedStatic">Static entities moved this frame</param>
+void SpatialHashGrid::AppendStaticPairs(std::vector<Entity*>& movedStatic, std::vector<Octree::EntityPair>& out)
+{
+    std::vector<Entity*> candidates;
+    for (Entity* entity : movedStatic)
+    {
+        AABB box = entity->GetAABB();
+
+        candidates.clear();
+        QueryCells(box, candidates);
+        for (Entity* other : candidates)
+            if (!other->hasMoved && box.Overlaps(other->GetAABB()))
+                out.push_back({ entity, other });
+    }
+}
+
+void SpatialHashGrid::ClearMoved()
+{
+    for (Entity* entity : movedEntities)
+        entity->hasMoved = false;
+    movedEntities.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Helpers
+///////////////////////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Key of the cell holding a point, or the overflow key past the
+/// range a key can hold
+/// </summary>
+unsigned long long SpatialHashGrid::GetKey(DirectX::XMFLOAT3 point)
+{
+    long long x = CellCoord(point.x, cellSize);
+    long long y = CellCoord(point.y, cellSize);
+    long long z = CellCoord(point.z, cellSize);
+    if (!InKeyRange(x) || !InKeyRange(y) || !InKeyRange(z))
+        return OverflowKey;
+    return PackKey(x, y, z);
+}
+
+/// <summary>
+/// Finds the cell with a key, creating it if it isn't occupied
+/// </summary>
+unsigned int SpatialHashGrid::GetCell(unsigned long long key)
+{
+    std::unordered_map<unsigned long long, unsigned int>::iterator found = cellLookup.find(key);
+    if (found != cellLookup.end())
+        return found->second;
+
+    unsigned int index;
+    if (freeCells.size() > 0)
+    {
+        index = freeCells.back();
+        freeCells.pop_back();
+    }
+    else
+    {
+        index = (unsigned int)cells.size();
+        cells.emplace_back();
+    }
+
+    Cell& cell = cells[index];
+    cell.key = key;
+    cellLookup[key] = index;
+    if (key == OverflowKey)
+    {
+        // Grown by Insert to hold its entities
+        cell.bounds.min = DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+        cell.bounds.max = DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        return index;
+    }
+
+    float x = UnpackAxis(key, KeyBits * 2) * cellSize;
+    float y = UnpackAxis(key, KeyBits) * cellSize;
+    float z = UnpackAxis(key, 0) * cellSize;
+    AABB core;
+    core.min = DirectX::XMFLOAT3(x, y, z);
+    core.max = DirectX::XMFLOAT3(x + cellSize, y + cellSize, z + cellSize);
+    Grow(extent, core);
+    cell.bounds.min = DirectX::XMFLOAT3(x - maxHalfSize, y - maxHalfSize, z - maxHalfSize);
+    cell.bounds.max = DirectX::XMFLOAT3(
+        x + cellSize + maxHalfSize, y + cellSize + maxHalfSize, z + cellSize + maxHalfSize);
+    return index;
+}
+
+/// <summary>
+/// Finds the occupied cell at cell coordinates in the keyed range
+/// </summary>
+/// <returns>Whether the cell is occupied</returns>
+bool SpatialHashGrid::FindCell(long long x, long long y, long long z, unsigned int& index)
+{
+    if (!InKeyRange(x) || !InKeyRange(y) || !InKeyRange(z))
+        return false;
+    std::unordered_map<unsigned long long, unsigned int>::iterator found = cellLookup.find(PackKey(x, y, z));
+    if (found == cellLookup.end())
+        return false;
+    index = found->second;
+    return true;
+}
+
+void SpatialHashGrid::Insert(std::shared_ptr<Entity> entity, AABB& box)
+{
+    // A bigger entity loosens every cell
+    float halfSize = HalfSize(box);
+    if (halfSize > maxHalfSize)
+    {
+        float growth = halfSize - maxHalfSize;
+        maxHalfSize = halfSize;
+        for (Cell& cell : cells)
+        {
+            cell.bounds.min = DirectX::XMFLOAT3(
+                cell.bounds.min.x - growth, cell.bounds.min.y - growth, cell.bounds.min.z - growth);
+            cell.bounds.max = DirectX::XMFLOAT3(
+                cell.bounds.max.x + growth, cell.bounds.max.y + growth, cell.bounds.max.z + growth);
+        }
+    }
+
+    unsigned int index = GetCell(GetKey(box.Center()));
+    if (cells[index].key == OverflowKey)
+        Grow(cells[index].bounds, box);
+    entity->gridCell = index;
+    entity->gridIndex = (unsigned int)cells[index].entities.size();
+    cells[index].entities.push_back(entity);
+    cells[index].cullBoundsDirty = true;
+}
+
+/// <summary>
+/// Swaps an entity out of its cell, freeing the cell if it empties
+/// </summary>
+void SpatialHashGrid::Detach(Entity* entity)
+{
+    Cell& cell = cells[entity->gridCell];
+    cell.entities[entity->gridIndex] = cell.entities.back();
+    cell.entities[entity->gridIndex]->gridIndex = entity->gridIndex;
+    cell.entities.pop_back();
+    cell.cullBoundsDirty = true;
+
+    if (cell.entities.empty())
+    {
+        cellLookup.erase(cell.key);
+        freeCells.push_back(entity->gridCell);
+    }
+}
+
+/// <summary>
+/// Tests each occupied cell against the frustum, taking cells fully
+/// inside whole and testing entities in the ones crossing a plane
+/// in batches with the culling kernel
+/// </summary>
+/// <param name="testEntities">Whether to test entities in straddling cells</param>
+void SpatialHashGrid::CullCells(Frustum& frustum, std::vector<Entity*>& out, bool testEntities)
+{
+    for (Cell& cell : cells)
+    {
+        if (cell.entities.empty())
+            continue;
+
+        unsigned char planeMask = ALL_PLANES;
+        bool outside = false;
+        for (int i = 0; i < 6 && !outside; i++)
+        {
+            PlaneSide side = cell.bounds.ClassifyPlane(frustum.normals[i]);
+            outside = side == PlaneSide::Outside;
+            if (side == PlaneSide::Inside)
+                planeMask &= ~(1 << i);
+        }
+        if (outside)
+            continue;
+
+        if (planeMask == 0 || !testEntities)
+        {
+            for (const std::shared_ptr<Entity>& entityPtr : cell.entities)
+                out.push_back(entityPtr.get());
+            continue;
+        }
+
+        if (cell.cullBoundsDirty)
+        {
+            // Moved entities can move again before ClearMoved without
+            // telling the grid, so keep refilling until then
+            bool anyMoved = false;
+            cell.cullBounds.Resize(cell.entities.size());
+            for (size_t e = 0; e < cell.entities.size(); e++)
+            {
+                cell.cullBounds.Set(e, cell.entities[e]->GetAABB());
+                anyMoved = anyMoved || cell.entities[e]->hasMoved;
+            }
+            cell.cullBoundsDirty = anyMoved;
+        }
+
+        unsigned int visible[CULLING_BATCH_SIZE];
+        for (unsigned int first = 0, n = (unsigned int)cell.entities.size(); first < n; first += CULLING_BATCH_SIZE)
+        {
+            unsigned int count = n - first < CULLING_BATCH_SIZE ? n - first : CULLING_BATCH_SIZE;
+            unsigned int visibleCount = Culling::Cull(frustum, cell.cullBounds, first, count, planeMask, visible);
+            for (unsigned int v = 0; v < visibleCount; v++)
+                out.push_back(cell.entities[visible[v]].get());
+        }
+    }
+}
+
+/// <summary>
+/// Appends the entities touching a box
+/// </summary>
+void SpatialHashGrid::QueryCells(AABB box, std::vector<Entity*>& out)
+{
+    GatherCells(box);
+    for (unsigned int index : candidateCells)
+        for (const std::shared_ptr<Entity>& entityPtr : cells[index].entities)
+            if (entityPtr->GetAABB().Intersects(box))
+                out.push_back(entityPtr.get());
+}
+
+/// <summary>
+/// Fills candidateCells with the cells whose entities can touch a box,
+/// looking up only the keyed cells whose loose bounds can reach it, or
+/// scanning every cell when that would mean more lookups than there
+/// are cells. The overflow cell is included when its bounds touch.
+/// </summary>
+void SpatialHashGrid::GatherCells(AABB box)
+{
+    candidateCells.clear();
+    long long minX = CellCoord(box.min.x - maxHalfSize, cellSize);
+    long long minY = CellCoord(box.min.y - maxHalfSize, cellSize);
+    long long minZ = CellCoord(box.min.z - maxHalfSize, cellSize);
+    long long maxX = CellCoord(box.max.x + maxHalfSize, cellSize);
+    long long maxY = CellCoord(box.max.y + maxHalfSize, cellSize);
+    long long maxZ = CellCoord(box.max.z + maxHalfSize, cellSize);
+    double lookups = (double)(maxX - minX + 1) * (double)(maxY - minY + 1) * (double)(maxZ - minZ + 1);
+
+    if (lookups > (double)cellLookup.size())
+    {
+        for (unsigned int i = 0; i < cells.size(); i++)
+            if (!cells[i].entities.empty() && cells[i].bounds.Intersects(box))
+                candidateCells.push_back(i);
+        return;
+    }
+
+    unsigned int index;
+    for (long long x = minX; x <= maxX; x++)
+        for (long long y = minY; y <= maxY; y++)
+            for (long long z = minZ; z <= maxZ; z++)
+                if (FindCell(x, y, z, index))
+                    candidateCells.push_back(index);
+
+    std::unordered_map<unsigned long long, unsigned int>::iterator overflow = cellLookup.find(OverflowKey);
+    if (overflow != cellLookup.end() && cells[overflow->second].bounds.Intersects(box))
+        candidateCells.push_back(overflow->second);
+}
+
+/// <summary>
+/// Tests a cell's entities against a ray, keeping the nearest hit
+/// closer than maxDistance and shortening maxDistance to it
+/// </summary>
+/// <returns>Whether a nearer hit was found</returns>
+bool SpatialHashGrid::RaycastCell(Cell& cell, Ray& ray, float& maxDistance, Octree::RayHit& hit)
+{
+    bool found = false;
+    float tNear, tFar;
+    for (const std::shared_ptr<Entity>& entityPtr : cell.entities)
+    {
+        if (entityPtr->GetAABB().Intersects(ray, tNear, tFar) && tNear < maxDistance)
+        {
+            maxDistance = tNear;
+            hit = { entityPtr.get(), tNear };
+            found = true;
+        }
+    }
+    return found;
+}
+
+/// <summary>
+/// Raycasts the occupied cells in a block of cell coordinates
+/// </summary>
+/// <param name="low">Lowest cell coordinate on each axis</param>
+/// <param name="high">Highest cell coordinate on each axis</param>
+bool SpatialHashGrid::RaycastCells(long long* low, long long* high, Ray& ray, float& maxDistance, Octree::RayHit& hit)
+{
+    bool found = false;
+    unsigned int index;
+    for (long long x = low[0]; x <= high[0]; x++)
+        for (long long y = low[1]; y <= high[1]; y++)
+            for (long long z = low[2]; z <= high[2]; z++)
+                if (FindCell(x, y, z, index))
+                    found = RaycastCell(cells[index], ray, maxDistance, hit) || found;
+    return found;
+}
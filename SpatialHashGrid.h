@@ -0,0 +1,84 @@
+#pragma once
+
+#define GRID_CELL_SIZE 8.0f // Default width of a grid cell
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Octree.h"
+#include "CullingKernel.h"
+
+/// <summary>
+/// A uniform grid of cells hashed by their integer coordinates, for
+/// entities that move every frame. Each entity lives in the one cell
+/// holding its center and knows its cell and index there, so adding,
+/// removing and moving an entity are all constant time.
+/// Cells are treated as loose by the largest half size of any entity
+/// added, so an entity never reaches past its cell's culling bounds.
+/// Only occupied cells exist, and empty ones are recycled. Entities
+/// too far out for a cell key share one overflow cell instead.
+/// Entities report their first move each frame, so updating visits only
+/// the entities that moved.
+/// </summary>
+class SpatialHashGrid
+{
+public:
+	SpatialHashGrid(float _cellSize = GRID_CELL_SIZE);
+	~SpatialHashGrid();
+
+	// Modifiers
+	void AddEntity(std::shared_ptr<Entity> entity);
+	bool RemoveEntity(Entity* entity);
+	void MarkMoved(Entity* entity);
+
+	// Getters
+	float GetCellSize();
+	unsigned int GetEntityCount();
+	unsigned int GetCellCount();
+	std::vector<Entity*>& GetMovedEntities();
+	void GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out);
+	void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out);
+	bool Raycast(Ray ray, float maxDistance, Octree::RayHit& hit);
+	void QuerySphere(DirectX::XMFLOAT3 center, float radius, std::vector<Entity*>& out);
+	void QueryAABB(AABB box, std::vector<Entity*>& out);
+
+	// Functions
+	void Update();
+	void AppendMovedPairs(Octree::Node& octree, std::vector<Octree::EntityPair>& out);
+	void AppendStaticPairs(std::vector<Entity*>& movedStatic, std::vector<Octree::EntityPair>& out);
+	void ClearMoved();
+
+private:
+	struct Cell
+	{
+		AABB bounds; // The cell grown by the largest entity half size
+		unsigned long long key;
+		std::vector<std::shared_ptr<Entity>> entities;
+		Culling::BoundsSoA cullBounds; // The entities' bounds for the culling kernel
+		bool cullBoundsDirty = true;
+	};
+
+	float cellSize;
+	float maxHalfSize;
+	unsigned int entityCount;
+	std::vector<Cell> cells;
+	std::vector<unsigned int> freeCells;
+	std::unordered_map<unsigned long long, unsigned int> cellLookup;
+	AABB extent; // Covers every keyed cell ever occupied
+	std::vector<unsigned int> candidateCells; // Reused by the range queries
+
+	// Entities moved since the last ClearMoved, indexed by their movedIndex
+	std::vector<Entity*> movedEntities;
+
+	// Helpers
+	unsigned long long GetKey(DirectX::XMFLOAT3 point);
+	unsigned int GetCell(unsigned long long key);
+	bool FindCell(long long x, long long y, long long z, unsigned int& index);
+	void Insert(std::shared_ptr<Entity> entity, AABB& box);
+	void Detach(Entity* entity);
+	void CullCells(Frustum& frustum, std::vector<Entity*>& out, bool testEntities);
+	void QueryCells(AABB box, std::vector<Entity*>& out);
+	void GatherCells(AABB box);
+	bool RaycastCell(Cell& cell, Ray& ray, float& maxDistance, Octree::RayHit& hit);
+	bool RaycastCells(long long* low, long long* high, Ray& ray, float& maxDistance, Octree::RayHit& hit);
+};
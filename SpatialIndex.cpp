@@ -0,0 +1,25 @@
+#include "SpatialIndex.h"
+
+OctreeIndex::OctreeIndex(std::shared_ptr<Octree::Node> _octree)
+    : octree(_octree) {}
+
+void OctreeIndex::AddEntity(std::shared_ptr<Entity> entity) {}
+void OctreeIndex::RemoveEntity(Entity* entity) {}
+void OctreeIndex::Update() {}
+
+/// <summary>
+/// Nodes fully inside the frustum are taken whole,
+/// entities are only tested in nodes that cross a plane.
+/// Starts at the root, since the node holding the whole frustum
+/// misses entities stored in its ancestors (and in a loose tree,
+/// its siblings).
+/// </summary>
+void OctreeIndex::GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    octree->GetVisibleEntities(frustum, out);
+}
+
+void OctreeIndex::GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out)
+{
+    octree->GetRelevantEntities(frustum, out);
+}
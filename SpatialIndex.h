@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Octree.h"
+
+// Structures a scene can cull its entities with
+enum class SpatialIndexType
+{
+	Octree,
+	BVH
+};
+
+/// <summary>
+/// Finds the entities a frustum can see, for the camera and shadow casters.
+/// Queries append to a caller owned buffer.
+/// Indices that track movement read Entity::hasMoved in Update, so it has
+/// to run before the scene's octree clears those flags.
+/// </summary>
+class SpatialIndex
+{
+public:
+	virtual ~SpatialIndex() {}
+
+	// Modifiers
+	virtual void AddEntity(std::shared_ptr<Entity> entity) = 0;
+	virtual void RemoveEntity(Entity* entity) = 0;
+
+	// Getters
+	// Entities whose bounds intersect the frustum
+	virtual void GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out) = 0;
+	// Entities in nodes that intersect the frustum, without testing each entity
+	virtual void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out) = 0;
+
+	// Functions
+	virtual void Update() = 0;
+};
+
+/// <summary>
+/// Culls with the scene's octree.
+/// The scene adds, removes and updates the octree itself.
+/// </summary>
+class OctreeIndex : public SpatialIndex
+{
+public:
+	OctreeIndex(std::shared_ptr<Octree::Node> _octree);
+
+	// Modifiers
+	void AddEntity(std::shared_ptr<Entity> entity) override;
+	void RemoveEntity(Entity* entity) override;
+
+	// Getters
+	void GetVisibleEntities(Frustum& frustum, std::vector<Entity*>& out) override;
+	void GetRelevantEntities(Frustum& frustum, std::vector<Entity*>& out) override;
+
+	// Functions
+	void Update() override;
+
+private:
+	std::shared_ptr<Octree::Node> octree;
+};
@@ -1,166 +1,215 @@
 #include "Transform.h"
+#include "TransformStore.h"
 
 using namespace DirectX;
 
 
 Transform::Transform() :
-	position(0, 0, 0),
-	pitchYawRoll(0, 0, 0),
-	scale(1, 1, 1),
 	up(0, 1, 0),
 	right(1, 0, 0),
 	forward(0, 0, 1),
-	matricesDirty(false),
 	vectorsDirty(false),
 	parent(nullptr),
 	dirtyCallBack(nullptr)
 {
 	// Start with an identity matrix and basic transform data
-	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
-	XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixIdentity());
+	slot = TransformStore::GetInstance().Allocate(this);
+}
+
+// Copies get their own slot with the same local transformation,
+// outside of any hierarchy and without the original's callback
+Transform::Transform(const Transform& other) :
+	Transform()
+{
+	*this = other;
+}
+Transform& Transform::operator=(const Transform& other)
+{
+	if (this == &other)
+		return *this;
+
+	TransformStore& store = TransformStore::GetInstance();
+	store.SetPosition(slot, store.GetPosition(other.slot));
+	store.SetRotation(slot, store.GetRotation(other.slot));
+	store.SetScale(slot, store.GetScale(other.slot));
+	vectorsDirty = true;
+	if (dirtyCallBack)
+		dirtyCallBack();
+	return *this;
+}
+
+Transform::~Transform()
+{
+	// Leave the hierarchy so no slot is left pointing at ours
+	for (Transform* child : children)
+	{
+		child->parent = nullptr;
+		TransformStore::GetInstance().SetParent(child->slot, TransformStore::Invalid);
+	}
+	if (parent)
+	{
+		auto it = std::find(parent->children.begin(), parent->children.end(), this);
+		if (it != parent->children.end())
+			parent->children.erase(it);
+	}
+
+	TransformStore::GetInstance().Release(slot);
 }
 
 // Augmenters
 void Transform::MoveAbsolute(float x, float y, float z)
 {
+	TransformStore& store = TransformStore::GetInstance();
+	XMFLOAT3 position = store.GetPosition(slot);
 	position.x += x;
 	position.y += y;
 	position.z += z;
-	matricesDirty = true;
+	store.SetPosition(slot, position);
+	if (dirtyCallBack)
+		dirtyCallBack();
 }
 void Transform::MoveAbsolute(DirectX::XMFLOAT3 offset)
 {
-	position.x += offset.x;
-	position.y += offset.y;
-	position.z += offset.z;
-	matricesDirty = true;
+	MoveAbsolute(offset.x, offset.y, offset.z);
 }
 void Transform::MoveRelative(float x, float y, float z)
 {
+	TransformStore& store = TransformStore::GetInstance();
+	XMFLOAT3 position = store.GetPosition(slot);
+	XMFLOAT4 rotation = store.GetRotation(slot);
+
 	// Create a direction vector from the params
-	// and a rotation quaternion
 	XMVECTOR movement = XMVectorSet(x, y, z, 0);
-	XMVECTOR rotQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
+	XMVECTOR rotQuat = XMLoadFloat4(&rotation);
 
 	// Rotate the movement by the quaternion
 	XMVECTOR dir = XMVector3Rotate(movement, rotQuat);
 
 	// Add and store, and invalidate the matrices
 	XMStoreFloat3(&position, XMLoadFloat3(&position) + dir);
-	matricesDirty = true;
+	store.SetPosition(slot, position);
+	if (dirtyCallBack)
+		dirtyCallBack();
 }
 void Transform::MoveRelative(DirectX::XMFLOAT3 offset)
 {
 	// Call the the overload
 	MoveRelative(offset.x, offset.y, offset.z);
 }
+// Pitch and roll turn around the local axes, yaw around the world's up axis.
+// Without roll that's the same as adding to each Euler angle.
 void Transform::Rotate(float p, float y, float r)
 {
-	pitchYawRoll.x += p;
-	pitchYawRoll.y += y;
-	pitchYawRoll.z += r;
-	matricesDirty = true;
+	TransformStore& store = TransformStore::GetInstance();
+	XMFLOAT4 rotation = store.GetRotation(slot);
+	XMVECTOR rotQuat = XMLoadFloat4(&rotation);
+	if (p != 0 || r != 0)
+		rotQuat = XMQuaternionMultiply(XMQuaternionRotationRollPitchYaw(p, 0, r), rotQuat);
+	if (y != 0)
+		rotQuat = XMQuaternionMultiply(rotQuat, XMQuaternionRotationRollPitchYaw(0, y, 0));
+
+	// Renormalize so rounding doesn't build up
+	XMStoreFloat4(&rotation, XMQuaternionNormalize(rotQuat));
+	store.SetRotation(slot, rotation);
 	vectorsDirty = true;
+	if (dirtyCallBack)
+		dirtyCallBack();
 }
 void Transform::Rotate(DirectX::XMFLOAT3 pitchYawRoll)
 {
-	this->pitchYawRoll.x += pitchYawRoll.x;
-	this->pitchYawRoll.y += pitchYawRoll.y;
-	this->pitchYawRoll.z += pitchYawRoll.z;
-	matricesDirty = true;
-	vectorsDirty = true;
+	Rotate(pitchYawRoll.x, pitchYawRoll.y, pitchYawRoll.z);
 }
 void Transform::Scale(float uniformScale)
 {
-	scale.x *= uniformScale;
-	scale.y *= uniformScale;
-	scale.z *= uniformScale;
-	matricesDirty = true;
-	if (dirtyCallBack)
-		dirtyCallBack();
+	Scale(uniformScale, uniformScale, uniformScale);
 }
 void Transform::Scale(float x, float y, float z)
 {
+	TransformStore& store = TransformStore::GetInstance();
+	XMFLOAT3 scale = store.GetScale(slot);
 	scale.x *= x;
 	scale.y *= y;
 	scale.z *= z;
-	matricesDirty = true;
+	store.SetScale(slot, scale);
 	if (dirtyCallBack)
 		dirtyCallBack();
 }
 void Transform::Scale(DirectX::XMFLOAT3 scale)
 {
-	this->scale.x *= scale.x;
-	this->scale.y *= scale.y;
-	this->scale.z *= scale.z;
-	matricesDirty = true;
-	if (dirtyCallBack)
-		dirtyCallBack();
+	Scale(scale.x, scale.y, scale.z);
 }
 // Setters
 void Transform::SetPosition(float x, float y, float z)
 {
-	position.x = x;
-	position.y = y;
-	position.z = z;
-	matricesDirty = true;
-	if (dirtyCallBack)
-		dirtyCallBack();
+	SetPosition(XMFLOAT3(x, y, z));
 }
 void Transform::SetPosition(DirectX::XMFLOAT3 position)
 {
-	this->position = position;
-	matricesDirty = true;
+	TransformStore::GetInstance().SetPosition(slot, position);
 	if (dirtyCallBack)
 		dirtyCallBack();
 }
 void Transform::SetRotation(float p, float y, float r)
 {
-	pitchYawRoll.x = p;
-	pitchYawRoll.y = y;
-	pitchYawRoll.z = r;
-	matricesDirty = true;
-	vectorsDirty = true;
+	SetRotation(XMFLOAT3(p, y, r));
 }
 void Transform::SetRotation(DirectX::XMFLOAT3 pitchYawRoll)
 {
-	this->pitchYawRoll = pitchYawRoll;
-	matricesDirty = true;
-	vectorsDirty = true;
+	XMFLOAT4 rotation;
+	XMStoreFloat4(&rotation, XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll)));
+	SetRotation(rotation);
 }
-void Transform::SetScale(float uniformScale)
+void Transform::SetRotation(DirectX::XMFLOAT4 quaternion)
 {
-	scale.x = uniformScale;
-	scale.y = uniformScale;
-	scale.z = uniformScale;
-	matricesDirty = true;
+	TransformStore::GetInstance().SetRotation(slot, quaternion);
+	vectorsDirty = true;
 	if (dirtyCallBack)
 		dirtyCallBack();
 }
+void Transform::SetScale(float uniformScale)
+{
+	SetScale(XMFLOAT3(uniformScale, uniformScale, uniformScale));
+}
 void Transform::SetScale(float x, float y, float z)
 {
-	scale.x = x;
-	scale.y = y;
-	scale.z = z;
-	matricesDirty = true;
-	if (dirtyCallBack)
-		dirtyCallBack();
+	SetScale(XMFLOAT3(x, y, z));
 }
 void Transform::SetScale(DirectX::XMFLOAT3 scale)
 {
-	this->scale = scale;
-	matricesDirty = true;
+	TransformStore::GetInstance().SetScale(slot, scale);
 	if (dirtyCallBack)
 		dirtyCallBack();
 }
 void Transform::SetTransformsFromMatrix(DirectX::XMFLOAT4X4 worldMatrix)
 {
+	// Split the matrix back into scale, rotation and translation
+	XMVECTOR localScale;
+	XMVECTOR localRotation;
+	XMVECTOR localPosition;
+	if (!XMMatrixDecompose(&localScale, &localRotation, &localPosition, XMLoadFloat4x4(&worldMatrix)))
+		return;
+
+	XMFLOAT3 position;
+	XMFLOAT4 rotation;
+	XMFLOAT3 scale;
+	XMStoreFloat3(&position, localPosition);
+	XMStoreFloat4(&rotation, localRotation);
+	XMStoreFloat3(&scale, localScale);
+
+	TransformStore& store = TransformStore::GetInstance();
+	store.SetPosition(slot, position);
+	store.SetRotation(slot, rotation);
+	store.SetScale(slot, scale);
+	vectorsDirty = true;
+	if (dirtyCallBack)
+		dirtyCallBack();
 }
 void Transform::SetDirtyFunction(std::function<void()> funcPtr) { dirtyCallBack = funcPtr; }
 // Getters
-DirectX::XMFLOAT3 Transform::GetPosition() { return position; }
-DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return pitchYawRoll; }
-DirectX::XMFLOAT3 Transform::GetScale() { return scale; }
+DirectX::XMFLOAT3 Transform::GetPosition() { return TransformStore::GetInstance().GetPosition(slot); }
+DirectX::XMFLOAT3 Transform::GetPitchYawRoll() { return QuaternionToEuler(TransformStore::GetInstance().GetRotation(slot)); }
+DirectX::XMFLOAT4 Transform::GetRotation() { return TransformStore::GetInstance().GetRotation(slot); }
+DirectX::XMFLOAT3 Transform::GetScale() { return TransformStore::GetInstance().GetScale(slot); }
 DirectX::XMFLOAT3 Transform::GetUp()
 {
 	if (vectorsDirty)UpdateVectors();
@@ -178,13 +227,13 @@ DirectX::XMFLOAT3 Transform::GetForward()
 }
 DirectX::XMFLOAT4X4 Transform::GetWorldMatrix()
 {
-	if (matricesDirty) UpdateMatrices();
-	return worldMatrix;
+	UpdateMatrices();
+	return TransformStore::GetInstance().GetWorldMatrix(slot);
 }
 DirectX::XMFLOAT4X4 Transform::GetWorldInverseTransposeMatrix()
 {
-	if(vectorsDirty) UpdateMatrices();
-	return worldMatrix;
+	UpdateMatrices();
+	return TransformStore::GetInstance().GetWorldInverseTransposeMatrix(slot);
 }
 
 // Hierarchy
@@ -225,8 +274,10 @@ void Transform::AddChild(Transform* child, bool makeChildRelative)
 	child->parent = this;
 
 	// This child transform is now out of date
-	child->matricesDirty = true;
-	child->MarkChildTransformsDirty();
+	// (its own children notice when it's rebuilt)
+	TransformStore::GetInstance().SetParent(child->slot, slot);
+	if (child->dirtyCallBack)
+		child->dirtyCallBack();
 }
 
 void Transform::RemoveChild(Transform* child, bool applyParentTransform)
@@ -255,8 +306,9 @@ void Transform::RemoveChild(Transform* child, bool applyParentTransform)
 	child->parent = 0;
 
 	// This child transform is now out of date
-	child->matricesDirty = true;
-	child->MarkChildTransformsDirty();
+	TransformStore::GetInstance().SetParent(child->slot, TransformStore::Invalid);
+	if (child->dirtyCallBack)
+		child->dirtyCallBack();
 }
 
 void Transform::SetParent(Transform* newParent, bool makeChildRelative)
@@ -307,29 +359,8 @@ unsigned int Transform::GetChildCount()
 
 void Transform::UpdateMatrices()
 {
-	// Anything to update?
-	if (!matricesDirty) { return; }
-
-	// Create the three transformation pieces
-	XMMATRIX trans = XMMatrixTranslationFromVector(XMLoadFloat3(&position));
-	XMMATRIX rot = XMMatrixRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
-	XMMATRIX sc = XMMatrixScalingFromVector(XMLoadFloat3(&scale));
-
-	// Combine and store the world
-	XMMATRIX wm = sc * rot * trans;
-	if (parent) 
-	{ 
-		XMFLOAT4X4 parentWorld = parent->GetWorldMatrix();
-		wm *= XMLoadFloat4x4(&parentWorld);
-	}
-	XMStoreFloat4x4(&worldMatrix, wm);
-	// Invert and transpose, too
-	XMStoreFloat4x4(&worldInverseTransposeMatrix, XMMatrixInverse(0, XMMatrixTranspose(wm)));
-
-	// Matrices are up to date
-	matricesDirty = false;
-
-	MarkChildTransformsDirty();
+	// Rebuilds this transform and anything above it that's out of date
+	TransformStore::GetInstance().UpdateWorldMatrix(slot);
 }
 
 void Transform::UpdateVectors()
@@ -339,14 +370,14 @@ void Transform::UpdateVectors()
 		return;
 
 	// Update all three vectors
-	XMVECTOR rotationQuat = XMQuaternionRotationRollPitchYawFromVector(XMLoadFloat3(&pitchYawRoll));
+	XMFLOAT4 rotation = TransformStore::GetInstance().GetRotation(slot);
+	XMVECTOR rotationQuat = XMLoadFloat4(&rotation);
 	XMStoreFloat3(&up, XMVector3Rotate(XMVectorSet(0, 1, 0, 0), rotationQuat));
 	XMStoreFloat3(&right, XMVector3Rotate(XMVectorSet(1, 0, 0, 0), rotationQuat));
 	XMStoreFloat3(&forward, XMVector3Rotate(XMVectorSet(0, 0, 1, 0), rotationQuat));
 
 	// Vectors are up to date
 	vectorsDirty = false;
-	MarkChildTransformsDirty();
 }
 
 DirectX::XMFLOAT3 Transform::QuaternionToEuler(DirectX::XMFLOAT4 quaternion)
@@ -378,13 +409,3 @@ DirectX::XMFLOAT3 Transform::QuaternionToEuler(DirectX::XMFLOAT4 quaternion)
 	return XMFLOAT3(pitch, yaw, roll);
 }
 
-void Transform::MarkChildTransformsDirty()
-{
-	for (Transform* child : children)
-	{
-		child->matricesDirty = true;
-		child->vectorsDirty = true;
-		child->dirtyCallBack();
-		child->MarkChildTransformsDirty();
-	}
-}
@@ -8,6 +8,9 @@ class Transform
 {
 public:
 	Transform();
+	Transform(const Transform& other);
+	Transform& operator=(const Transform& other);
+	~Transform();
 
 	// Transformers
 	void MoveAbsolute(float x, float y, float z);
@@ -25,6 +28,7 @@ public:
 	void SetPosition(DirectX::XMFLOAT3 position);
 	void SetRotation(float p, float y, float r);
 	void SetRotation(DirectX::XMFLOAT3 pitchYawRoll);
+	void SetRotation(DirectX::XMFLOAT4 quaternion);
 	void SetScale(float uniformScale);
 	void SetScale(float x, float y, float z);
 	void SetScale(DirectX::XMFLOAT3 scale);
@@ -34,6 +38,7 @@ public:
 	// Getters
 	DirectX::XMFLOAT3 GetPosition();
 	DirectX::XMFLOAT3 GetPitchYawRoll();
+	DirectX::XMFLOAT4 GetRotation();
 	DirectX::XMFLOAT3 GetScale();
 
 	// Local direction vector getters
@@ -55,10 +60,10 @@ public:
 	unsigned int GetChildCount();
 
 private:
-	// Raw transformation data
-	DirectX::XMFLOAT3 position;
-	DirectX::XMFLOAT3 pitchYawRoll;
-	DirectX::XMFLOAT3 scale;
+	friend class TransformStore;
+
+	// Raw transformation data and the matrices live in the transform store
+	unsigned int slot;
 
 	// Local orientation vectors
 	bool vectorsDirty;
@@ -66,11 +71,6 @@ private:
 	DirectX::XMFLOAT3 right;
 	DirectX::XMFLOAT3 forward;
 
-	// World matrix and inverse transpose of the world matrix
-	bool matricesDirty;
-	DirectX::XMFLOAT4X4 worldMatrix;
-	DirectX::XMFLOAT4X4 worldInverseTransposeMatrix;
-
 	// Helper to update both matrices if necessary
 	void UpdateMatrices();
 	void UpdateVectors();
@@ -80,7 +80,6 @@ private:
 	// Hierarchy
 	Transform* parent;
 	std::vector<Transform*> children;
-	void MarkChildTransformsDirty();
 
 	// Delegates and Callbacks
 	std::function<void()> dirtyCallBack;
@@ -0,0 +1,425 @@
+#include "TransformStore.h"
+#include "Transform.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// Shrinks an array, giving memory back once it's under half used
+	template <typename T>
+	void Trim(std::vector<T>& values, size_t size)
+	{
+		values.resize(size);
+		if (size * 2 < values.capacity())
+			values.shrink_to_fit();
+	}
+}
+
+TransformStore* TransformStore::instance;
+
+
+// Slots
+unsigned int TransformStore::Allocate(Transform* owner)
+{
+	unsigned int slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else
+	{
+		slot = (unsigned int)owners.size();
+		positionX.push_back(0); positionY.push_back(0); positionZ.push_back(0);
+		rotationX.push_back(0); rotationY.push_back(0); rotationZ.push_back(0); rotationW.push_back(1);
+		scaleX.push_back(1); scaleY.push_back(1); scaleZ.push_back(1);
+		parents.push_back(Invalid);
+		owners.push_back(nullptr);
+		dirty.push_back(0);
+		uniformScales.push_back(1);
+		worldVersions.push_back(0);
+		parentVersions.push_back(0);
+		normalVersions.push_back(0);
+		worldMatrices.push_back({});
+		worldInverseTransposeMatrices.push_back({});
+		depths.push_back(0);
+	}
+
+	// Start with an identity matrix and basic transform data
+	positionX[slot] = 0; positionY[slot] = 0; positionZ[slot] = 0;
+	rotationX[slot] = 0; rotationY[slot] = 0; rotationZ[slot] = 0; rotationW[slot] = 1;
+	scaleX[slot] = 1; scaleY[slot] = 1; scaleZ[slot] = 1;
+	parents[slot] = Invalid;
+	owners[slot] = owner;
+	dirty[slot] = 0;
+	uniformScales[slot] = 1;
+	XMStoreFloat4x4(&worldMatrices[slot], XMMatrixIdentity());
+	XMStoreFloat4x4(&worldInverseTransposeMatrices[slot], XMMatrixIdentity());
+	normalVersions[slot] = worldVersions[slot];
+
+	orderDirty = true;
+	return slot;
+}
+
+void TransformStore::Release(unsigned int slot)
+{
+	owners[slot] = nullptr;
+	parents[slot] = Invalid;
+	dirty[slot] = 0;
+	freeSlots.push_back(slot);
+	orderDirty = true;
+}
+
+unsigned int TransformStore::GetCount() { return (unsigned int)(owners.size() - freeSlots.size()); }
+
+
+// Local transformation data
+XMFLOAT3 TransformStore::GetPosition(unsigned int slot) { return XMFLOAT3(positionX[slot], positionY[slot], positionZ[slot]); }
+XMFLOAT4 TransformStore::GetRotation(unsigned int slot) { return XMFLOAT4(rotationX[slot], rotationY[slot], rotationZ[slot], rotationW[slot]); }
+XMFLOAT3 TransformStore::GetScale(unsigned int slot) { return XMFLOAT3(scaleX[slot], scaleY[slot], scaleZ[slot]); }
+void TransformStore::SetPosition(unsigned int slot, XMFLOAT3 position)
+{
+	positionX[slot] = position.x;
+	positionY[slot] = position.y;
+	positionZ[slot] = position.z;
+	dirty[slot] = 1;
+}
+void TransformStore::SetRotation(unsigned int slot, XMFLOAT4 rotation)
+{
+	rotationX[slot] = rotation.x;
+	rotationY[slot] = rotation.y;
+	rotationZ[slot] = rotation.z;
+	rotationW[slot] = rotation.w;
+	dirty[slot] = 1;
+}
+void TransformStore::SetScale(unsigned int slot, XMFLOAT3 scale)
+{
+	scaleX[slot] = scale.x;
+	scaleY[slot] = scale.y;
+	scaleZ[slot] = scale.z;
+	dirty[slot] = 1;
+}
+
+
+// Hierarchy
+void TransformStore::SetParent(unsigned int slot, unsigned int parentSlot)
+{
+	parents[slot] = parentSlot;
+	dirty[slot] = 1;
+	orderDirty = true;
+}
+
+
+// World matrices
+bool TransformStore::IsDirty(unsigned int slot) { return dirty[slot] != 0; }
+XMFLOAT4X4 TransformStore::GetWorldMatrix(unsigned int slot) { return worldMatrices[slot]; }
+
+/// <summary>
+/// Gets the inverse transpose of the world matrix, working it out
+/// first if the world matrix was rebuilt since it was last asked for
+/// </summary>
+XMFLOAT4X4 TransformStore::GetWorldInverseTransposeMatrix(unsigned int slot)
+{
+	if (normalVersions[slot] != worldVersions[slot])
+	{
+		XMStoreFloat4x4(&worldInverseTransposeMatrices[slot], ComputeInverseTranspose(slot));
+		normalVersions[slot] = worldVersions[slot];
+	}
+	return worldInverseTransposeMatrices[slot];
+}
+
+/// <summary>
+/// Brings one world matrix up to date, along with any out of
+/// date ones between it and the root of its hierarchy
+/// </summary>
+void TransformStore::UpdateWorldMatrix(unsigned int slot)
+{
+	chain.clear();
+	for (unsigned int s = slot; s != Invalid; s = parents[s])
+		chain.push_back(s);
+
+	// From the root down, so each parent's new version is seen by its child
+	for (size_t c = chain.size(); c-- > 0;)
+	{
+		unsigned int s = chain[c];
+		bool parentMoved = ParentMoved(s);
+		if (!dirty[s] && !parentMoved)
+			continue;
+
+		FinishWorldMatrix(s, ComposeLocalMatrix(s));
+		if (parentMoved)
+			NotifyOwner(s);
+	}
+}
+
+/// <summary>
+/// Rebuilds every out of date world matrix. One forward scan over the slots
+/// sorted by depth spreads the dirty bits down, since each parent's bit is
+/// final before its children are reached, then the marked slots are rebuilt
+/// in the same order. Owners of transforms that only moved because of their
+/// parents are told afterwards, outside of the loops.
+/// </summary>
+void TransformStore::UpdateWorldMatrices()
+{
+	if (orderDirty)
+		RebuildOrder();
+
+	batch.clear();
+	inherited.clear();
+	for (unsigned int slot : order)
+	{
+		unsigned int parent = parents[slot];
+		if (parent != Invalid && (dirty[parent] || ParentMoved(slot)))
+		{
+			dirty[slot] = 1;
+			inherited.push_back(slot);
+		}
+		if (dirty[slot])
+			batch.push_back(slot);
+	}
+
+	// Four at a time, a short group repeats its last slot. Every local
+	// matrix in a group is built before any is finished, and a parent
+	// always sits before its children, so finishing in order is safe.
+	unsigned int count = (unsigned int)batch.size();
+	for (unsigned int b = 0; b < count; b += 4)
+	{
+		unsigned int slots[4];
+		for (unsigned int k = 0; k < 4; k++)
+			slots[k] = batch[b + k < count ? b + k : count - 1];
+
+		XMMATRIX locals[4];
+		ComposeLocalMatrices(slots, locals);
+		for (unsigned int k = 0; k < 4 && b + k < count; k++)
+			FinishWorldMatrix(slots[k], locals[k]);
+	}
+
+	for (unsigned int slot : inherited)
+		NotifyOwner(slot);
+}
+
+
+// Helpers
+
+/// <summary>
+/// Drops the free slots at the end of the arrays. Slots in use never
+/// move, so the indices Transforms hold stay valid.
+/// </summary>
+void TransformStore::TrimFreeSlots()
+{
+	size_t size = owners.size();
+	while (size > 0 && !owners[size - 1])
+		size--;
+	if (size == owners.size())
+		return;
+
+	Trim(positionX, size); Trim(positionY, size); Trim(positionZ, size);
+	Trim(rotationX, size); Trim(rotationY, size); Trim(rotationZ, size); Trim(rotationW, size);
+	Trim(scaleX, size); Trim(scaleY, size); Trim(scaleZ, size);
+	Trim(parents, size);
+	Trim(owners, size);
+	Trim(dirty, size);
+	Trim(uniformScales, size);
+	Trim(worldVersions, size);
+	Trim(parentVersions, size);
+	Trim(normalVersions, size);
+	Trim(worldMatrices, size);
+	Trim(worldInverseTransposeMatrices, size);
+	Trim(depths, size);
+
+	// Keep only the free slots that are still there
+	size_t kept = 0;
+	for (unsigned int slot : freeSlots)
+	{
+		if (slot < size)
+			freeSlots[kept++] = slot;
+	}
+	Trim(freeSlots, kept);
+}
+
+/// <summary>
+/// Sorts the used slots by depth with a counting sort
+/// </summary>
+void TransformStore::RebuildOrder()
+{
+	TrimFreeSlots();
+
+	// Depth of every used slot, walking up only as far as a known one
+	unsigned int maxDepth = 0;
+	for (unsigned int slot = 0; slot < owners.size(); slot++)
+		depths[slot] = Invalid;
+	for (unsigned int slot = 0; slot < owners.size(); slot++)
+	{
+		if (!owners[slot] || depths[slot] != Invalid)
+			continue;
+
+		chain.clear();
+		unsigned int p = slot;
+		while (p != Invalid && depths[p] == Invalid)
+		{
+			chain.push_back(p);
+			p = parents[p];
+		}
+		unsigned int depth = p == Invalid ? 0 : depths[p] + 1;
+		for (size_t c = chain.size(); c-- > 0; depth++)
+			depths[chain[c]] = depth;
+		maxDepth = depth - 1 > maxDepth ? depth - 1 : maxDepth;
+	}
+
+	// Count each level, then place slots after the levels above them
+	std::vector<unsigned int> levelStarts(maxDepth + 2, 0);
+	for (unsigned int slot = 0; slot < owners.size(); slot++)
+	{
+		if (owners[slot])
+			levelStarts[depths[slot] + 1]++;
+	}
+	for (size_t level = 1; level < levelStarts.size(); level++)
+		levelStarts[level] += levelStarts[level - 1];
+
+	order.resize(levelStarts.back());
+	std::vector<unsigned int> next(levelStarts.begin(), levelStarts.end() - 1);
+	for (unsigned int slot = 0; slot < owners.size(); slot++)
+	{
+		if (owners[slot])
+			order[next[depths[slot]]++] = slot;
+	}
+	orderDirty = false;
+}
+
+/// <summary>
+/// Whether the parent's world matrix was rebuilt since this one was
+/// </summary>
+bool TransformStore::ParentMoved(unsigned int slot)
+{
+	unsigned int parent = parents[slot];
+	return parent != Invalid && parentVersions[slot] != worldVersions[parent];
+}
+
+/// <summary>
+/// Builds one local scale, rotation and translation matrix
+/// </summary>
+XMMATRIX TransformStore::ComposeLocalMatrix(unsigned int slot)
+{
+	// Create the three transformation pieces
+	XMMATRIX trans = XMMatrixTranslation(positionX[slot], positionY[slot], positionZ[slot]);
+	XMMATRIX rot = XMMatrixRotationQuaternion(
+		XMVectorSet(rotationX[slot], rotationY[slot], rotationZ[slot], rotationW[slot]));
+	XMMATRIX sc = XMMatrixScaling(scaleX[slot], scaleY[slot], scaleZ[slot]);
+	return sc * rot * trans;
+}
+
+/// <summary>
+/// Builds four local scale, rotation and translation matrices at once,
+/// with each lane of a vector holding a different slot's value
+/// </summary>
+void TransformStore::ComposeLocalMatrices(unsigned int* slots, XMMATRIX* out)
+{
+	const unsigned int a = slots[0], b = slots[1], c = slots[2], d = slots[3];
+
+	XMVECTOR x = XMVectorSet(rotationX[a], rotationX[b], rotationX[c], rotationX[d]);
+	XMVECTOR y = XMVectorSet(rotationY[a], rotationY[b], rotationY[c], rotationY[d]);
+	XMVECTOR z = XMVectorSet(rotationZ[a], rotationZ[b], rotationZ[c], rotationZ[d]);
+	XMVECTOR w = XMVectorSet(rotationW[a], rotationW[b], rotationW[c], rotationW[d]);
+	XMVECTOR sx = XMVectorSet(scaleX[a], scaleX[b], scaleX[c], scaleX[d]);
+	XMVECTOR sy = XMVectorSet(scaleY[a], scaleY[b], scaleY[c], scaleY[d]);
+	XMVECTOR sz = XMVectorSet(scaleZ[a], scaleZ[b], scaleZ[c], scaleZ[d]);
+
+	// The rows of XMMatrixRotationQuaternion, each scaled by its axis
+	XMVECTOR one = XMVectorSet(1, 1, 1, 1);
+	XMVECTOR x2 = x + x, y2 = y + y, z2 = z + z;
+	XMVECTOR xx = x * x2, yy = y * y2, zz = z * z2;
+	XMVECTOR xy = x * y2, xz = x * z2, yz = y * z2;
+	XMVECTOR wx = w * x2, wy = w * y2, wz = w * z2;
+	XMMATRIX rows[4];
+	rows[0].r[0] = (one - yy - zz) * sx;
+	rows[0].r[1] = (xy + wz) * sx;
+	rows[0].r[2] = (xz - wy) * sx;
+	rows[0].r[3] = XMVectorZero();
+	rows[1].r[0] = (xy - wz) * sy;
+	rows[1].r[1] = (one - xx - zz) * sy;
+	rows[1].r[2] = (yz + wx) * sy;
+	rows[1].r[3] = XMVectorZero();
+	rows[2].r[0] = (xz + wy) * sz;
+	rows[2].r[1] = (yz - wx) * sz;
+	rows[2].r[2] = (one - xx - yy) * sz;
+	rows[2].r[3] = XMVectorZero();
+	rows[3].r[0] = XMVectorSet(positionX[a], positionX[b], positionX[c], positionX[d]);
+	rows[3].r[1] = XMVectorSet(positionY[a], positionY[b], positionY[c], positionY[d]);
+	rows[3].r[2] = XMVectorSet(positionZ[a], positionZ[b], positionZ[c], positionZ[d]);
+	rows[3].r[3] = one;
+
+	// Transposing each row's elements gives that row for each slot
+	for (int row = 0; row < 4; row++)
+	{
+		XMMATRIX lanes = XMMatrixTranspose(rows[row]);
+		for (int k = 0; k < 4; k++)
+			out[k].r[row] = lanes.r[k];
+	}
+}
+
+/// <summary>
+/// Applies the parent's world matrix to a local matrix and stores the result
+/// </summary>
+void TransformStore::FinishWorldMatrix(unsigned int slot, XMMATRIX local)
+{
+	XMMATRIX wm = local;
+	bool uniform = scaleX[slot] == scaleY[slot] && scaleY[slot] == scaleZ[slot];
+	unsigned int parent = parents[slot];
+	if (parent != Invalid)
+	{
+		wm *= XMLoadFloat4x4(&worldMatrices[parent]);
+		parentVersions[slot] = worldVersions[parent];
+		uniform = uniform && uniformScales[parent];
+	}
+	XMStoreFloat4x4(&worldMatrices[slot], wm);
+	uniformScales[slot] = uniform;
+
+	dirty[slot] = 0;
+	worldVersions[slot]++;
+}
+
+/// <summary>
+/// Works out the inverse of the transposed world matrix. Only the upper 3x3
+/// needs inverting: its inverse transpose is its cofactor matrix over its
+/// determinant, and the cofactor rows are just cross products of its rows.
+/// A uniformly scaled rotation is its own cofactor matrix up to the square
+/// of the scale, so that case skips the cross products entirely.
+/// </summary>
+XMMATRIX TransformStore::ComputeInverseTranspose(unsigned int slot)
+{
+	XMMATRIX wm = XMLoadFloat4x4(&worldMatrices[slot]);
+	XMMATRIX it;
+	if (uniformScales[slot])
+	{
+		XMVECTOR scaleSquared = XMVector3LengthSq(wm.r[0]);
+		it.r[0] = wm.r[0] / scaleSquared;
+		it.r[1] = wm.r[1] / scaleSquared;
+		it.r[2] = wm.r[2] / scaleSquared;
+	}
+	else
+	{
+		it.r[0] = XMVector3Cross(wm.r[1], wm.r[2]);
+		it.r[1] = XMVector3Cross(wm.r[2], wm.r[0]);
+		it.r[2] = XMVector3Cross(wm.r[0], wm.r[1]);
+		XMVECTOR determinant = XMVector3Dot(wm.r[0], it.r[0]);
+		it.r[0] /= determinant;
+		it.r[1] /= determinant;
+		it.r[2] /= determinant;
+	}
+
+	// The translation ends up undone in the last column
+	for (int row = 0; row < 3; row++)
+		it.r[row] = XMVectorSetW(it.r[row], -XMVectorGetX(XMVector3Dot(it.r[row], wm.r[3])));
+	it.r[3] = XMVectorSet(0, 0, 0, 1);
+	return it;
+}
+
+/// <summary>
+/// Tells a transform's owner it moved along with its parent
+/// </summary>
+void TransformStore::NotifyOwner(unsigned int slot)
+{
+	Transform* owner = owners[slot];
+	if (owner->dirtyCallBack)
+		owner->dirtyCallBack();
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+class Transform;
+
+/// <summary>
+/// Holds the local position, rotation and scale of every Transform in
+/// structure of arrays form, along with their world matrices.
+/// Each Transform only keeps the index of its slot here.
+/// The hierarchy is flattened into parent indices and a list of slots
+/// sorted by depth, so parents always come before their children.
+/// Each world matrix remembers which version of its parent's it was
+/// built from, so moving a parent never has to visit its descendants:
+/// they notice the new version when they're next rebuilt or asked for.
+/// UpdateWorldMatrices finds and rebuilds everything out of date in one
+/// forward scan over the sorted slots, four local matrices at a time,
+/// with no recursion. Free slots at the end of the arrays are dropped
+/// whenever the order is rebuilt, so a burst of short lived transforms
+/// doesn't leave every later scan walking its empty slots. Rotations are stored as quaternions, so building
+/// a matrix takes no trigonometry. The inverse transpose is only worked
+/// out when asked for, from the 3x3 cofactors of the world matrix, or
+/// straight from the world matrix when every scale above is uniform.
+/// </summary>
+class TransformStore
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static TransformStore& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new TransformStore();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions
+	TransformStore(TransformStore const&) = delete;
+	void operator=(TransformStore const&) = delete;
+
+private:
+	static TransformStore* instance;
+	TransformStore() :
+		orderDirty(false) {};
+#pragma endregion
+
+public:
+	// Slots
+	unsigned int Allocate(Transform* owner);
+	void Release(unsigned int slot);
+	unsigned int GetCount();
+
+	// Local transformation data
+	DirectX::XMFLOAT3 GetPosition(unsigned int slot);
+	DirectX::XMFLOAT4 GetRotation(unsigned int slot);
+	DirectX::XMFLOAT3 GetScale(unsigned int slot);
+	void SetPosition(unsigned int slot, DirectX::XMFLOAT3 position);
+	void SetRotation(unsigned int slot, DirectX::XMFLOAT4 rotation);
+	void SetScale(unsigned int slot, DirectX::XMFLOAT3 scale);
+
+	// Hierarchy
+	void SetParent(unsigned int slot, unsigned int parentSlot);
+
+	// World matrices
+	bool IsDirty(unsigned int slot);
+	DirectX::XMFLOAT4X4 GetWorldMatrix(unsigned int slot);
+	DirectX::XMFLOAT4X4 GetWorldInverseTransposeMatrix(unsigned int slot);
+	void UpdateWorldMatrix(unsigned int slot);
+	void UpdateWorldMatrices();
+
+	// Marks an unused index
+	static constexpr unsigned int Invalid = 0xFFFFFFFF;
+
+private:
+	// Local transformation data, one entry per slot
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;	// Unit quaternions
+	std::vector<float> scaleX, scaleY, scaleZ;
+
+	// Hierarchy, parents are slots too
+	std::vector<unsigned int> parents;
+	std::vector<Transform*> owners;	// Null for free slots
+	std::vector<unsigned int> freeSlots;
+
+	// World matrix and inverse transpose of the world matrix
+	std::vector<unsigned char> dirty;			// Local data changed since the last build
+	std::vector<unsigned char> uniformScales;	// This and every parent scale evenly on all axes
+	std::vector<unsigned int> worldVersions;	// Bumped whenever the world matrix is built
+	std::vector<unsigned int> parentVersions;	// The parent's version it was built from
+	std::vector<unsigned int> normalVersions;	// The version the inverse transpose was made from
+	std::vector<DirectX::XMFLOAT4X4> worldMatrices;
+	std::vector<DirectX::XMFLOAT4X4> worldInverseTransposeMatrices;
+
+	// Used slots sorted by their depth in the hierarchy, rebuilt
+	// whenever slots are allocated, released or reparented
+	std::vector<unsigned int> order;
+	std::vector<unsigned int> depths;
+	std::vector<unsigned int> batch;
+	std::vector<unsigned int> inherited;	// Rebuilt because something above moved
+	std::vector<unsigned int> chain;
+	bool orderDirty;
+
+	// Helpers
+	void TrimFreeSlots();
+	void RebuildOrder();
+	bool ParentMoved(unsigned int slot);
+	DirectX::XMMATRIX ComposeLocalMatrix(unsigned int slot);
+	void ComposeLocalMatrices(unsigned int* slots, DirectX::XMMATRIX* out);
+	void FinishWorldMatrix(unsigned int slot, DirectX::XMMATRIX local);
+	DirectX::XMMATRIX ComputeInverseTranspose(unsigned int slot);
+	void NotifyOwner(unsigned int slot);
+};
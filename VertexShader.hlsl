@@ -12,8 +12,12 @@ cbuffer PerFrame : register(b0)
 }
 cbuffer PerObject : register(b1)
 {
+#ifdef WORLD_MATRIX_3X4
+    row_major float3x4 world;
+#else
     matrix world;
     matrix worldInvTranspose;
+#endif
 }
 
 VertexToPixel main( VertexShaderInput input )
@@ -21,6 +25,21 @@ VertexToPixel main( VertexShaderInput input )
 	// Set up output struct
     VertexToPixel output;
 	
+#ifdef WORLD_MATRIX_3X4
+    // No 4x4 world to combine with, so go through world space instead
+    float4 worldPosition = float4(mul(world, float4(input.localPosition, 1)), 1);
+    output.screenPosition = mul(proj, mul(view, worldPosition));
+    output.uv = input.uv;
+    output.normal = TransformNormal(world, input.normal);
+    output.worldPosition = worldPosition.xyz;
+    output.tangent = mul((float3x3) world, input.tangent);
+    
+	// Calculate where this vertex is from the light's point of view
+    for (int i = 0; i < shadowlightCount; i++)
+    {
+        output.shadowMapPos[i] = mul(shadowProjections[i], mul(shadowViews[i], worldPosition));
+    }
+#else
     matrix wvp = mul(proj, mul(view, world));
 	
     output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
@@ -35,6 +54,7 @@ VertexToPixel main( VertexShaderInput input )
         matrix shadowWVP = mul(shadowProjections[i], mul(shadowViews[i], world));
         output.shadowMapPos[i] = mul(shadowWVP, float4(input.localPosition, 1.0f));
     }
+#endif
 	
     output.shadowlightCount = shadowlightCount;
     